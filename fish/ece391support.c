@@ -51,3 +51,104 @@ ece391_strncmp (const uint8_t* s1, const uint8_t* s2, uint32_t n)
     return ((int32_t)*s1) - ((int32_t)*s2);
 }
 
+/* Sits in front of every block; 8 bytes so payloads stay 8-byte aligned */
+typedef struct malloc_header {
+    uint32_t size;      /* bytes the block holds */
+    uint32_t unused;
+} malloc_header_t;
+
+/* A program's image is copied in without clearing its bss, so the state
+   below is only trusted once malloc_ready has been set from its .data value */
+static int32_t malloc_ready = -1;
+static void* free_lists[MALLOC_NUM_CLASSES];   /* freed blocks of each class */
+static void* big_list;      /* freed blocks above MALLOC_MAX_CLASS, first fit */
+static uint8_t* bump;       /* next byte never handed out */
+static uint8_t* bump_end;   /* the break */
+
+/* Carve n bytes off the end of the heap, growing it a chunk at a time */
+static uint8_t*
+bump_alloc (uint32_t n)
+{
+    uint8_t* p;
+    uint32_t grow;
+
+    if ((uint32_t)(bump_end - bump) < n) {
+        grow = (n - (bump_end - bump) + MALLOC_CHUNK - 1) & ~(MALLOC_CHUNK - 1);
+        if ((void*)-1 == ece391_sbrk (grow))
+            return 0;
+        bump_end += grow;
+    }
+    p = bump;
+    bump += n;
+    return p;
+}
+
+/* Allocate size bytes, 0 if the heap cannot grow */
+void*
+ece391_malloc (uint32_t size)
+{
+    malloc_header_t* h;
+    void** prev;
+    uint32_t cls, cap;
+    int32_t i;
+
+    if (-1 == malloc_ready) {
+        for (i = 0; i < MALLOC_NUM_CLASSES; i++)
+            free_lists[i] = 0;
+        big_list = 0;
+        bump = bump_end = (uint8_t*)ece391_sbrk (0);
+        malloc_ready = 1;
+    }
+    if (0 == size)
+        return 0;
+    if (size <= MALLOC_MAX_CLASS) {
+        for (cls = 0, cap = MALLOC_MIN_CLASS; cap < size; cls++, cap <<= 1);
+        if (0 != free_lists[cls]) {
+            h = (malloc_header_t*)free_lists[cls] - 1;
+            free_lists[cls] = *(void**)free_lists[cls];
+            return h + 1;
+        }
+    }
+    else {
+        cap = ((size + sizeof (malloc_header_t) + 4095) & ~4095) - sizeof (malloc_header_t);
+        for (prev = &big_list; 0 != *prev; prev = (void**)*prev) {
+            h = (malloc_header_t*)*prev - 1;
+            if (h->size >= size) {
+                *prev = *(void**)*prev;
+                return h + 1;
+            }
+        }
+    }
+    if (0 == (h = (malloc_header_t*)bump_alloc (cap + sizeof (malloc_header_t))))
+        return 0;
+    h->size = cap;
+    return h + 1;
+}
+
+/* Return a block from ece391_malloc to its free list; 0 is ignored */
+void
+ece391_free (void* ptr)
+{
+    malloc_header_t* h = (malloc_header_t*)ptr - 1;
+    uint32_t cls, cap;
+
+    if (0 == ptr)
+        return;
+    if (h->size > MALLOC_MAX_CLASS) {
+        *(void**)ptr = big_list;
+        big_list = ptr;
+        return;
+    }
+    for (cls = 0, cap = MALLOC_MIN_CLASS; cap < h->size; cls++, cap <<= 1);
+    *(void**)ptr = free_lists[cls];
+    free_lists[cls] = ptr;
+}
+
+/* Set the end of the heap to addr, returns 0 or -1 */
+int32_t
+ece391_brk (void* addr)
+{
+    uint8_t* cur = (uint8_t*)ece391_sbrk (0);
+
+    return ((void*)-1 == ece391_sbrk ((uint8_t*)addr - cur)) ? -1 : 0;
+}
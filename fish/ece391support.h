@@ -7,4 +7,17 @@ extern void ece391_fdputs (int32_t fd, const uint8_t* s);
 extern int32_t ece391_strcmp (const uint8_t* s1, const uint8_t* s2);
 extern int32_t ece391_strncmp (const uint8_t* s1, const uint8_t* s2, uint32_t n);
 
+/* Heap allocation on top of ece391_sbrk.  Requests up to MALLOC_MAX_CLASS
+ * bytes come from power-of-two size classes with one free list each; larger
+ * ones are rounded up to whole pages.  Not safe to call from two threads at
+ * once without a lock. */
+#define MALLOC_MIN_CLASS    16
+#define MALLOC_MAX_CLASS    2048
+#define MALLOC_NUM_CLASSES  8       /* 16, 32, ... 2048 */
+#define MALLOC_CHUNK        16384   /* bytes taken from sbrk at a time */
+
+extern void* ece391_malloc (uint32_t size);
+extern void ece391_free (void* ptr);
+extern int32_t ece391_brk (void* addr);
+
 #endif /* ECE391SUPPORT_H */
@@ -5,6 +5,7 @@
 
 #define NULL 0
 #define WAIT 100
+#define LINEMAX 1024
 uint8_t *vmem_base_addr;
 uint8_t *mp1_set_video_mode (void);
 void add_frames(uint8_t *, uint8_t *, int32_t);
@@ -18,15 +19,61 @@ uint8_t file1[] = "frame1.txt";
 extern int mp1_ioctl(unsigned long arg, unsigned long cmd);
 extern void mp1_rtc_tasklet(unsigned long trash);
 
-static struct mp1_blink_struct blink_array[80*25];
+#ifdef FISH_KEYBOARD
+/*
+ * Keyboard variant, built as fishkb. It animates until "q" is entered and
+ * "p" pauses the blinking. stdin is non-blocking, so every frame checks for
+ * a line and still waits for its RTC tick.
+ */
+int main(void)
+{
+    int32_t rtc_fd, ret_val, garbage, stdin_flags, cnt;
+    int32_t paused = 0;
+    uint8_t line[LINEMAX];
+
+    if(mp1_set_video_mode() == NULL) {
+        return -1;
+    }
+
+    rtc_fd = ece391_open((uint8_t*)"rtc");
+
+    add_frames(file0, file1, rtc_fd);
+
+    ret_val = 32;
+    ret_val = ece391_write(rtc_fd, &ret_val, 4);
+
+    stdin_flags = ece391_fcntl(0, F_GETFL, 0);
+    ece391_fcntl(0, F_SETFL, stdin_flags | O_NONBLOCK);
+
+    while(1) {
+        ece391_read(rtc_fd, &garbage, 4);
+        if(!paused) {
+            mp1_rtc_tasklet(garbage);
+        }
+
+        cnt = ece391_read(0, line, LINEMAX-1);
+        if(cnt == WOULD_BLOCK || cnt <= 0) {
+            continue;
+        }
+        if(line[0] == 'q') {
+            break;
+        }
+        if(line[0] == 'p') {
+            paused = !paused;
+        }
+    }
 
+    ece391_fcntl(0, F_SETFL, stdin_flags);
+    ece391_close(rtc_fd);
+
+    return 0;
+}
+#else
 int main(void)
 {
     int rtc_fd, ret_val, i, garbage;
     struct mp1_blink_struct blink_struct;
 
-    ece391_memset(blink_array, 0, sizeof(struct mp1_blink_struct)*80*25);
-
     if(mp1_set_video_mode() == NULL) {
         return -1;
     }
@@ -74,6 +121,7 @@ int main(void)
 
     return 0;
 }
+#endif /* FISH_KEYBOARD */
 
 void
 add_frames(uint8_t *f0, uint8_t *f1, int32_t rtc_fd)
@@ -157,21 +205,19 @@ mp1_set_video_mode (void)
     }
 }
 
+/* Blink structs come from the heap, so there is no fixed limit on them */
 void* mp1_malloc(int32_t size)
 {
-    int32_t i;
-    for(i=0; i< 80*25; i++) {
-        if(blink_array[i].location == 0) {
-            return &blink_array[i];
-        }
+    void* memory = ece391_malloc(size);
+    if(memory != NULL) {
+        ece391_memset(memory, 0, size);
     }
-
-    return NULL;
+    return memory;
 }
 
 void mp1_free(void* memory)
 {
-    ece391_memset(memory, 0, sizeof(struct mp1_blink_struct));
+    ece391_free(memory);
 }
 
 void ece391_memset(void* memory, char c, int n)
@@ -0,0 +1,134 @@
+/* clock.c - Monotonic nanosecond clock read from the TSC. The TSC rate is
+ * measured against PIT channel 2 once at boot; after that reading the clock
+ * is an rdtsc, two multiplies and a shift. The numbers it needs sit in a
+ * page every process maps read-only, so user programs read the same clock
+ * without a system call (see ece391_clock_ns).
+ * vim:ts=4 noexpandtab
+ */
+
+#include "clock.h"
+#include "pit.h"
+#include "lib.h"
+#include "syscalls.h"
+
+/*
+ * clock_calibrate()
+ *   DESCRIPTION: Counts the TSC cycles PIT channel 2 takes to count down
+ *                CLOCK_CAL_COUNTS, about CLOCK_CAL_MS
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the cycles, 0 if the channel never finished
+ *   SIDE EFFECTS: call with interrupts disabled, leaves channel 2 gated on
+ */
+static uint32_t clock_calibrate() {
+    uint64_t start;
+    uint32_t polls;
+    /* gate the channel on with the speaker off, then load the count */
+    outb((inb(PIT_GATE_PORT) & ~PIT_SPEAKER) | PIT_GATE2, PIT_GATE_PORT);
+    outb(PIT_CH2_ONESHOT, PIT_COMMAND);
+    outb(CLOCK_CAL_COUNTS & 0xFF, PIT_CHANNEL2);
+    outb((CLOCK_CAL_COUNTS >> 8) & 0xFF, PIT_CHANNEL2);
+    start = rdtsc64();
+    for (polls = 0; (inb(PIT_GATE_PORT) & PIT_OUT2) == 0; polls++) {
+        if (polls == CLOCK_CAL_MAX_POLLS) {
+            return 0;
+        }
+    }
+    return (uint32_t)(rdtsc64() - start);
+}
+
+/*
+ * cycles_to_ns()
+ *   DESCRIPTION: Converts TSC cycles to nanoseconds. The cycles are
+ *                multiplied 32 bits at a time so no product overflows, however
+ *                long the clock has run.
+ *   INPUTS: cycles -- cycles since clock_page.base_tsc
+ *   OUTPUTS: none
+ *   RETURN VALUE: nanoseconds, rounded down
+ *   SIDE EFFECTS: none
+ */
+static uint64_t cycles_to_ns(uint64_t cycles) {
+    uint32_t mult = clock_page.mult, shift = clock_page.shift;
+    return (((uint64_t)(uint32_t)cycles * mult) >> shift) +
+           (((uint64_t)(uint32_t)(cycles >> 32) * mult) << (32 - shift));
+}
+
+/*
+ * clock_init()
+ *   DESCRIPTION: Measures the TSC rate against the PIT and starts the clock
+ *                at 0. The TSC is taken to tick at a constant rate, as it does
+ *                on current processors and in QEMU.
+ *   INPUTS: none
+ *   OUTPUTS: the measured rate
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call with interrupts disabled, before anything reads the
+ *                 clock; uses PIT channel 2 for about 30ms
+ */
+void clock_init() {
+    uint8_t gate = inb(PIT_GATE_PORT);
+    uint32_t i, cycles, best = 0, khz;
+    for (i = 0; i < CLOCK_CAL_TRIES; i++) {
+        cycles = clock_calibrate();
+        if (cycles != 0 && (best == 0 || cycles < best)) {
+            best = cycles;
+        }
+    }
+    outb(gate, PIT_GATE_PORT);
+    /* cycles * counts per second / counts is cycles per second */
+    khz = (uint32_t)div64_32((uint64_t)best * PIT_INPUT_HZ, CLOCK_CAL_COUNTS * 1000, NULL);
+    if (khz < CLOCK_MIN_KHZ) {
+        printf("clock: calibration failed, assuming %u kHz\n", CLOCK_DEFAULT_KHZ);
+        khz = CLOCK_DEFAULT_KHZ;
+    }
+    clock_page.tsc_khz = khz;
+    clock_page.shift = CLOCK_SHIFT;
+    clock_page.mult = (uint32_t)div64_32((uint64_t)(NSEC_PER_SEC / 1000) << CLOCK_SHIFT, khz, NULL);
+    clock_page.base_tsc = rdtsc64();
+}
+
+/*
+ * clock_ns()
+ *   DESCRIPTION: Reads the monotonic clock, what kernel timestamps and
+ *                profiling counters are taken with
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: nanoseconds since clock_init, 0 before it
+ *   SIDE EFFECTS: none
+ */
+uint64_t clock_ns() {
+    return cycles_to_ns(rdtsc64() - clock_page.base_tsc);
+}
+
+/*
+ * clock_tsc_khz()
+ *   DESCRIPTION: Returns the TSC rate clock_init measured
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the rate in kHz
+ *   SIDE EFFECTS: none
+ */
+uint32_t clock_tsc_khz() {
+    return clock_page.tsc_khz;
+}
+
+/*
+ *  sys_clock_gettime
+ *  Description: Reads the monotonic clock. Programs can read it without the
+ *               system call through the clock page, see ece391_clock_ns.
+ *  Inputs: clock_id -- CLOCK_MONOTONIC
+ *          ts -- where to put the time
+ *  Outputs: seconds and nanoseconds since boot
+ *  Return value: 0 on success, -1 for another clock or if ts is not user memory
+ *  Side effects: none
+ */
+int32_t sys_clock_gettime(int32_t clock_id, clock_ts_t* ts) {
+    uint64_t now = clock_ns();
+    if (clock_id != CLOCK_MONOTONIC) {
+        return -1;
+    }
+    if (user_range_check(ts, sizeof(clock_ts_t)) == -1) {
+        return -1;
+    }
+    ts->sec = (uint32_t)div64_32(now, NSEC_PER_SEC, &ts->nsec);
+    return 0;
+}
@@ -0,0 +1,58 @@
+/* clock.h - Defines for the TSC-based monotonic clock
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _CLOCK_H
+#define _CLOCK_H
+
+#include "types.h"
+#include "pit.h"
+
+#define NSEC_PER_SEC        1000000000
+#define CLOCK_MONOTONIC     1       /* the only clock, nanoseconds since boot */
+
+/* The TSC is timed against CLOCK_CAL_MS of PIT channel 2, CLOCK_CAL_TRIES
+   times, and the shortest run is kept: anything that interrupts a run only
+   makes it longer */
+#define CLOCK_CAL_MS        10
+#define CLOCK_CAL_COUNTS    ((PIT_INPUT_HZ * CLOCK_CAL_MS) / 1000)
+#define CLOCK_CAL_TRIES     3
+#define CLOCK_CAL_MAX_POLLS 1000000     /* port reads before giving up on channel 2 */
+#define CLOCK_MIN_KHZ       4000        /* slower and the multiplier overflows */
+#define CLOCK_DEFAULT_KHZ   1000000     /* guess used if calibration fails */
+
+/* Cycles become nanoseconds as (cycles * mult) >> CLOCK_SHIFT */
+#define CLOCK_SHIFT         24
+
+/* What a reader needs to turn the TSC into time. It fills the first bytes of
+   a page mapped read-only at USER_CLOCK_PAGE in every process, so the layout
+   is part of the user interface (see ece391syscall.h) */
+typedef struct clock_data {
+    uint64_t base_tsc;  /* TSC when the clock read 0 */
+    uint32_t mult;      /* nanoseconds per cycle << shift, 0 before calibration */
+    uint32_t shift;
+    uint32_t tsc_khz;   /* measured TSC rate */
+} clock_data_t;
+
+/* Page holding the clock data (declared in x86_desc.S) */
+extern clock_data_t clock_page;
+
+/* clock_gettime result */
+typedef struct clock_ts {
+    uint32_t sec;
+    uint32_t nsec;
+} clock_ts_t;
+
+/* Measures the TSC against the PIT and starts the clock at 0 */
+void clock_init();
+
+/* Nanoseconds since clock_init */
+uint64_t clock_ns();
+
+/* Measured TSC rate in kHz */
+uint32_t clock_tsc_khz();
+
+/* System call */
+int32_t sys_clock_gettime(int32_t clock_id, clock_ts_t* ts);
+
+#endif /* _CLOCK_H */
@@ -217,7 +217,7 @@ int32_t file_read(uint32_t fd, void* buf, uint32_t nbytes) {
     
     //uint8_t* buff = (uint8_t*)buf;
     pcb_t* cur_pcb = (pcb_t *)get_pcb_from_pid(get_cur_pid());
-    file_descriptor_t* curr_fd_entry = &(cur_pcb->file_descriptor[fd]);
+    file_descriptor_t* curr_fd_entry = &(cur_pcb->fd_table[fd]);
 
     inode_t* current_inode_pos = (inode_t *)(in_memory_FS + (curr_fd_entry->inode + 1) * FILE_BLOCK_SIZE);
     if(curr_fd_entry->file_position >= current_inode_pos->length){
@@ -320,7 +320,7 @@ int32_t directory_read(uint32_t fd, void * buf, uint32_t nbytes) {
      }
     
     pcb_t* cur_pcb = (pcb_t *)get_pcb_from_pid(get_cur_pid());
-    file_descriptor_t* curr_fd_entry = &(cur_pcb->file_descriptor[fd]);
+    file_descriptor_t* curr_fd_entry = &(cur_pcb->fd_table[fd]);
 
     val = read_dentry_by_index(curr_fd_entry->file_position, &dir_entry);        // get directory entry for respective file's index within directory
     if (val == -1) {
@@ -0,0 +1,114 @@
+/* futex.c - Futexes, wait queues keyed by a user word so user code only
+ * enters the kernel when a lock is contended. Words in shared memory are
+ * keyed by physical address, private ones by thread group and address
+ * vim:ts=4 noexpandtab
+ */
+
+#include "futex.h"
+#include "syscalls.h"
+#include "paging.h"
+#include "shm.h"
+#include "lib.h"
+
+/* Local variables */
+wait_queue_t futex_queues[FUTEX_HASH_SIZE];  /* sleepers hashed by key */
+
+/*
+ * futex_key()
+ *   DESCRIPTION: Finds the key that identifies the futex at a user address
+ *                of the current process. A word in the program page or the
+ *                heap is only reachable by the thread group, and its frame
+ *                moves under copy on write, demand paging and swap, so it is
+ *                keyed by group and virtual address. A word in shared memory
+ *                is keyed by its physical address, so processes that attached
+ *                the segment at different addresses find the same queue.
+ *   INPUTS: addr -- the user address
+ *   OUTPUTS: none
+ *   RETURN VALUE: the key, or 0 if addr is not a word-aligned address the
+ *                 process can use
+ *   SIDE EFFECTS: none
+ */
+static uint32_t futex_key(int32_t* addr) {
+    uint32_t vaddr = (uint32_t)addr;
+    int32_t slot, id;
+    pcb_t* cur_pcb = (pcb_t*)get_pcb_from_pid(get_cur_pid());
+    pcb_t* leader = (pcb_t*)get_pcb_from_pid(cur_pcb->group_pid);
+    if ((vaddr & (sizeof(int32_t) - 1)) != 0) {
+        return 0;
+    }
+    /* the group's program page or its heap below the break */
+    if (user_range_check(addr, sizeof(int32_t)) == 0) {
+        return FUTEX_PRIVATE_KEY(leader->pid, vaddr);
+    }
+    /* an attached shared memory segment */
+    if (vaddr >= SHM_VIRT_START && vaddr < SHM_VIRT_START + NUM_SHM_SLOTS * SIZE_4MB) {
+        slot = (vaddr - SHM_VIRT_START) / SIZE_4MB;
+        id = leader->shm_map[slot];
+        if (id != -1) {
+            return SHM_START + id * SHM_SEGMENT_SIZE + (vaddr & (SIZE_4MB - 1));
+        }
+    }
+    return 0;
+}
+
+/*
+ * sys_futex_wait()
+ *   DESCRIPTION: Sleeps until futex_wake is called on the same word, unless
+ *                the word no longer holds the expected value
+ *   INPUTS: addr -- the user word
+ *           expected -- value the caller last saw in the word
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 after being woken, -1 if the word changed or addr is bad
+ *   SIDE EFFECTS: blocks the caller
+ */
+int32_t sys_futex_wait(int32_t* addr, int32_t expected) {
+    uint32_t flags;
+    uint32_t key = futex_key(addr);
+    pcb_t* cur_pcb = (pcb_t*)get_pcb_from_pid(get_cur_pid());
+    if (key == 0) {
+        return -1;
+    }
+    /* checking the word and going to sleep must not be split by a wake */
+    cli_and_save(flags);
+    if (*addr != expected) {
+        restore_flags(flags);
+        return -1;
+    }
+    cur_pcb->futex_key = key;
+    sleep_on(&futex_queues[(key >> 2) % FUTEX_HASH_SIZE]);
+    restore_flags(flags);
+    return 0;
+}
+
+/*
+ * sys_futex_wake()
+ *   DESCRIPTION: Wakes processes sleeping in futex_wait on a word
+ *   INPUTS: addr -- the user word
+ *           n -- the most processes to wake
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of processes woken, -1 if addr is bad
+ *   SIDE EFFECTS: none
+ */
+int32_t sys_futex_wake(int32_t* addr, int32_t n) {
+    uint32_t flags;
+    int i;
+    int32_t woken = 0;
+    pcb_t* pcb;
+    uint32_t key = futex_key(addr);
+    wait_queue_t* queue;
+    if (key == 0) {
+        return -1;
+    }
+    queue = &futex_queues[(key >> 2) % FUTEX_HASH_SIZE];
+    cli_and_save(flags);
+    /* the bucket may hold sleepers on other words, only wake ours */
+    for (i = 0; i < NUM_PROCESS && woken < n && queue->waiters != 0; i++) {
+        pcb = (pcb_t*)get_pcb_from_pid(i);
+        if (pcb->active != 0 && pcb->state == PROC_WAITING && pcb->wait_channel == queue && pcb->futex_key == key) {
+            make_runnable(pcb);
+            woken++;
+        }
+    }
+    restore_flags(flags);
+    return woken;
+}
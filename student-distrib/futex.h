@@ -0,0 +1,26 @@
+/* futex.h - Defines for the futex system calls
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _FUTEX_H
+#define _FUTEX_H
+
+#include "types.h"
+#include "scheduling.h"
+
+#define FUTEX_HASH_SIZE     16
+
+/* Key of a word private to a thread group, in its program page or heap:
+   the group and the virtual address, whose frame can change under copy on
+   write, demand paging and swap. Private addresses are below 256MB and
+   the group number starts at 1, so these keys are all at least 256MB and
+   never equal a shared memory key, which is a physical address below it */
+#define FUTEX_PRIVATE_KEY(pid, vaddr)   ((((pid) + 1) << 28) | ((vaddr) & 0x0FFFFFFF))
+
+/* Sleeps while the word at addr still holds expected */
+int32_t sys_futex_wait(int32_t* addr, int32_t expected);
+
+/* Wakes up to n processes sleeping on the word at addr */
+int32_t sys_futex_wake(int32_t* addr, int32_t n);
+
+#endif /* _FUTEX_H */
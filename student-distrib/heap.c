@@ -0,0 +1,304 @@
+/* heap.c - User heaps. sbrk only moves the break; the pages below it are
+ * mapped and zeroed the first time they are touched. The frame pool behind
+ * them also backs the demand-zero stack and bss pages of every program.
+ * vim:ts=4 noexpandtab
+ */
+
+#include "heap.h"
+#include "syscalls.h"
+#include "paging.h"
+#include "lib.h"
+#include "zswap.h"
+
+/* Local variables */
+static uint16_t heap_frames[HEAP_POOL_FRAMES];  /* stack of free frame numbers */
+static uint32_t num_heap_frames = 0;
+static uint32_t heap_committed = 0;     /* pages below every process' break */
+
+/*
+ * get_leader()
+ *   DESCRIPTION: Finds the PCB that holds the break of the current process,
+ *                which belongs to the whole thread group
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the group leader's PCB
+ *   SIDE EFFECTS: none
+ */
+static pcb_t* get_leader() {
+    pcb_t* cur_pcb = (pcb_t*)get_pcb_from_pid(get_cur_pid());
+    return (pcb_t*)get_pcb_from_pid(cur_pcb->group_pid);
+}
+
+/*
+ * heap_pages()
+ *   DESCRIPTION: Returns the number of pages needed to hold a heap up to a break
+ *   INPUTS: brk -- the break
+ *   OUTPUTS: none
+ *   RETURN VALUE: page count
+ *   SIDE EFFECTS: none
+ */
+static uint32_t heap_pages(uint32_t brk) {
+    return (brk - HEAP_START + PAGE_4K_SIZE - 1) / PAGE_4K_SIZE;
+}
+
+/*
+ * heap_init()
+ *   DESCRIPTION: Puts every frame of the pool on the free stack
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void heap_init() {
+    int i;
+    for (i = 0; i < HEAP_POOL_FRAMES; i++) {
+        heap_frames[i] = HEAP_POOL_FRAMES - 1 - i;
+    }
+    num_heap_frames = HEAP_POOL_FRAMES;
+    heap_committed = 0;
+}
+
+/*
+ * pool_commit()
+ *   DESCRIPTION: Reserves frames for pages that will be mapped when they are
+ *                first touched, so the fault always finds one. Pages in the
+ *                swap store keep their reservation without a frame, so when
+ *                the pool is short cold pages of idle processes are swapped
+ *                out to make room.
+ *   INPUTS: npages -- number of frames
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the pool cannot back them
+ *   SIDE EFFECTS: may compress pages of other processes
+ */
+int32_t pool_commit(uint32_t npages) {
+    uint32_t flags, limit;
+    cli_and_save(flags);
+    limit = HEAP_POOL_FRAMES + zswap_swapped_pages();
+    if (heap_committed + npages > limit) {
+        zswap_reclaim(heap_committed + npages - limit, 1);
+        limit = HEAP_POOL_FRAMES + zswap_swapped_pages();
+    }
+    if (heap_committed + npages > limit) {
+        restore_flags(flags);
+        return -1;
+    }
+    heap_committed += npages;
+    restore_flags(flags);
+    return 0;
+}
+
+/*
+ * pool_uncommit()
+ *   DESCRIPTION: Gives back a reservation made with pool_commit
+ *   INPUTS: npages -- number of frames
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void pool_uncommit(uint32_t npages) {
+    uint32_t flags;
+    cli_and_save(flags);
+    heap_committed -= npages;
+    restore_flags(flags);
+}
+
+/*
+ * pool_take()
+ *   DESCRIPTION: Takes a committed frame off the free stack and zeroes it
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: page frame number of the frame, for a page table entry
+ *   SIDE EFFECTS: none
+ */
+uint32_t pool_take() {
+    uint32_t flags, frame;
+    cli_and_save(flags);
+    frame = heap_frames[--num_heap_frames];   /* the commit made sure there is one */
+    restore_flags(flags);
+    memset((void*)(HEAP_POOL_START + frame * PAGE_4K_SIZE), 0, PAGE_4K_SIZE);
+    return (HEAP_POOL_START >> 12) + frame;
+}
+
+/*
+ * pool_give()
+ *   DESCRIPTION: Puts a frame from pool_take back on the free stack; the
+ *                reservation stays until pool_uncommit
+ *   INPUTS: pfn -- page frame number of the frame
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void pool_give(uint32_t pfn) {
+    uint32_t flags;
+    cli_and_save(flags);
+    heap_frames[num_heap_frames++] = pfn - (HEAP_POOL_START >> 12);
+    restore_flags(flags);
+}
+
+/*
+ * pool_free_frames()
+ *   DESCRIPTION: Returns the number of frames not mapped anywhere
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: free frame count
+ *   SIDE EFFECTS: none
+ */
+uint32_t pool_free_frames() {
+    return num_heap_frames;
+}
+
+/*
+ * pool_committed_frames()
+ *   DESCRIPTION: Returns the number of frames promised to heaps, bss and
+ *                stacks, mapped or not
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: committed frame count
+ *   SIDE EFFECTS: none
+ */
+uint32_t pool_committed_frames() {
+    return heap_committed;
+}
+
+/*
+ * sys_sbrk()
+ *   DESCRIPTION: Moves the break of the caller's heap. Growing maps nothing,
+ *                but reserves frames so a later fault always finds one.
+ *                Shrinking frees the pages that are wholly above the new break.
+ *   INPUTS: increment -- bytes to add, negative to give memory back
+ *   OUTPUTS: none
+ *   RETURN VALUE: the old break, or -1 if the heap would leave its 4MB
+ *                 window or the pool cannot back it
+ *   SIDE EFFECTS: new memory reads as zero
+ */
+int32_t sys_sbrk(int32_t increment) {
+    uint32_t flags, old_brk, new_brk, old_pages, new_pages, i;
+    pcb_t* leader = get_leader();
+    p_table_entry_4k_p* table = heap_page_tables[leader->pid];
+    cli_and_save(flags);
+    old_brk = leader->brk;
+    new_brk = old_brk + increment;
+    if ((increment > 0 && new_brk < old_brk) || (increment < 0 && new_brk > old_brk) ||
+        new_brk < HEAP_START || new_brk > HEAP_START + HEAP_MAX_SIZE) {
+        restore_flags(flags);
+        return -1;
+    }
+    old_pages = heap_pages(old_brk);
+    new_pages = heap_pages(new_brk);
+    if (new_pages > old_pages) {
+        if (pool_commit(new_pages - old_pages) == -1) {
+            restore_flags(flags);
+            return -1;
+        }
+    }
+    else {
+        for (i = new_pages; i < old_pages; i++) {
+            if (table[i].present == 1) {
+                table[i].present = 0;
+                pool_give(table[i].page_base_address);
+                tlb_invalidate(HEAP_START + i * PAGE_4K_SIZE);
+                leader->rss_heap--;
+            }
+            else if ((table[i].avail & PTE_SWAPPED) != 0) {
+                zswap_drop(&table[i]);
+                leader->rss_swap--;
+            }
+        }
+        tlb_commit();
+        pool_uncommit(old_pages - new_pages);
+    }
+    leader->brk = new_brk;
+    restore_flags(flags);
+    return old_brk;
+}
+
+/*
+ * heap_fault()
+ *   DESCRIPTION: Resolves a fault on a heap page that has not been touched
+ *                yet by mapping a zeroed frame there. Called by the page
+ *                fault handler, from user code or from a system call copying
+ *                into the heap.
+ *   INPUTS: addr -- the faulting address
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if the page is mapped now, -1 if addr is not below the break
+ *   SIDE EFFECTS: takes a frame reserved by sbrk
+ */
+int32_t heap_fault(uint32_t addr) {
+    uint32_t flags, index;
+    pcb_t* leader;
+    p_table_entry_4k_p* pte;
+    if (get_cur_pid() == -1) {
+        return -1;
+    }
+    leader = get_leader();
+    if (leader->kthread == 1 || addr < HEAP_START || addr >= HEAP_START + heap_pages(leader->brk) * PAGE_4K_SIZE) {
+        return -1;
+    }
+    index = (addr - HEAP_START) / PAGE_4K_SIZE;
+    pte = &heap_page_tables[leader->pid][index];
+    cli_and_save(flags);
+    if (pte->present == 0 && (pte->avail & PTE_SWAPPED) != 0) {
+        restore_flags(flags);
+        return -1;  /* zswap_fault could not bring it back */
+    }
+    if (pte->present == 0) {
+        pte->page_base_address = pool_take();   /* sbrk made sure there is one */
+        pte->present = 1;
+        pte->read_write = 1;
+        pte->user_supervisor = 1;
+        pte->global_page = 0;
+        pte->avail = 0;
+        leader->rss_heap++;
+        /* the entry was not present, so the TLB has nothing to drop */
+    }
+    restore_flags(flags);
+    return 0;
+}
+
+/*
+ * heap_load()
+ *   DESCRIPTION: Points the heap window of a process' page directory at its
+ *                page table. Called when the directory is built.
+ *   INPUTS: pid -- the process, or the leader of a thread group
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes a page directory entry
+ */
+void heap_load(int32_t pid) {
+    int _4k_index = (uint32_t)(HEAP_START >> 22);
+    union directory_entry* directory = process_directories[pid];
+    directory[_4k_index]._4k_pt.present = 1;
+    directory[_4k_index]._4k_pt.read_write = 1;
+    directory[_4k_index]._4k_pt.user_supervisor = 1;
+    directory[_4k_index]._4k_pt.page_size = 0;
+    directory[_4k_index]._4k_pt.pt_base_address = ((uint32_t)heap_page_tables[pid] >> 12);
+}
+
+/*
+ * heap_release()
+ *   DESCRIPTION: Frees every heap page of a halting process and its reservation
+ *   INPUTS: pid -- the process
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the page directory is switched away from by the caller
+ */
+void heap_release(int32_t pid) {
+    uint32_t flags, i;
+    pcb_t* pcb = (pcb_t*)get_pcb_from_pid(pid);
+    p_table_entry_4k_p* table = heap_page_tables[pid];
+    cli_and_save(flags);
+    for (i = 0; i < P_TABLE_SIZE; i++) {
+        if (table[i].present == 1) {
+            table[i].present = 0;
+            pool_give(table[i].page_base_address);
+        }
+        else if ((table[i].avail & PTE_SWAPPED) != 0) {
+            zswap_drop(&table[i]);
+            pcb->rss_swap--;
+        }
+    }
+    pool_uncommit(heap_pages(pcb->brk));
+    pcb->brk = HEAP_START;
+    pcb->rss_heap = 0;
+    restore_flags(flags);
+}
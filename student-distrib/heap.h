@@ -0,0 +1,50 @@
+/* heap.h - Defines for the user heap grown with sbrk
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _HEAP_H
+#define _HEAP_H
+
+#include "types.h"
+#include "slab.h"
+
+/* Physical 4KB frames for heap, stack and bss pages, 16MB after the kernel heap */
+#define HEAP_POOL_START     (KHEAP_START + KHEAP_SIZE)
+#define HEAP_POOL_SIZE      (4 * SIZE_4MB)
+#define HEAP_POOL_FRAMES    (HEAP_POOL_SIZE / PAGE_4K_SIZE)
+
+/* Each process' heap starts 4MB above the IPC window and holds up to 4MB */
+#define HEAP_START          0x09000000
+#define HEAP_MAX_SIZE       SIZE_4MB
+
+/* Page fault error code bits */
+#define PF_PRESENT          0x1     /* the page was present, so it is a protection fault */
+
+/* Sets up the frame pool */
+void heap_init();
+
+/* Reserves and gives back frames of the pool */
+int32_t pool_commit(uint32_t npages);
+void pool_uncommit(uint32_t npages);
+
+/* Takes a zeroed frame the caller committed, and puts one back */
+uint32_t pool_take();
+void pool_give(uint32_t pfn);
+
+/* Frames on the free stack, and frames reserved by commits */
+uint32_t pool_free_frames();
+uint32_t pool_committed_frames();
+
+/* Moves the caller's break by increment bytes */
+int32_t sys_sbrk(int32_t increment);
+
+/* Maps a zeroed page for a fault below the break */
+int32_t heap_fault(uint32_t addr);
+
+/* Points a process' page directory at its heap page table */
+void heap_load(int32_t pid);
+
+/* Frees the heap of a halting process */
+void heap_release(int32_t pid);
+
+#endif /* _HEAP_H */
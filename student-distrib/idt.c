@@ -9,6 +9,8 @@
 #include "x86_desc.h"
 #include "linkage.h"
 #include "syscalls.h"
+#include "heap.h"
+#include "zswap.h"
 
 /* ****FOR REFERENCE**** */
 /* typedef union idt_desc_t {
@@ -43,8 +45,9 @@ void setup_idt() {
     for (i = 0; i < NUM_VEC; i++) {
         gate.seg_selector = KERNEL_CS;
         gate.reserved4 = 0x00;
-        /* Check if the current index is an exception */
-        if (i < NUM_EXC || i == SYS_INDEX) {
+        /* Check if the current index is an exception, a page fault keeps
+         * interrupts off until CR2 is read so an IRQ that faults cannot replace it */
+        if ((i < NUM_EXC && i != PF_INDEX) || i == SYS_INDEX) {
             gate.reserved3 = 1; /* If it is, use a Trap gate */
         } else {
             gate.reserved3 = 0; /* Otherwise, use an interrupt gate */
@@ -83,7 +86,7 @@ void setup_idt() {
     SET_IDT_ENTRY(idt[11], handle_NP);
     SET_IDT_ENTRY(idt[12], handle_SS);
     SET_IDT_ENTRY(idt[13], handle_GP);
-    SET_IDT_ENTRY(idt[14], handle_PF);
+    SET_IDT_ENTRY(idt[PF_INDEX], pf_linkage);
     SET_IDT_ENTRY(idt[16], handle_MF);
     SET_IDT_ENTRY(idt[17], handle_AC);
     SET_IDT_ENTRY(idt[18], handle_MC);
@@ -270,12 +273,21 @@ void handle_GP() {
 }
 
 /*
- * void handle_PF(void);
- * Inputs: void
+ * void handle_PF(uint32_t addr, uint32_t error);
+ * Inputs: addr -- faulting address, read from CR2 before interrupts could run
+ *         error -- error code pushed by the CPU
  * Return Value: none
- * Function: Prints a statement describing the exception that occurred
+ * Function: Brings the page back if it was swapped out, maps it if the fault
+ *           is the first touch of a heap, bss or stack page, copies it if it is the first write to a shared image page,
+ *           otherwise prints a statement describing the exception that occurred
  */
-void handle_PF() {
+void handle_PF(uint32_t addr, uint32_t error) {
+    if ((error & PF_PRESENT) == 0 && (zswap_fault(addr) == 0 || heap_fault(addr) == 0 || user_demand_fault(addr) == 0)) {
+        return;     /* pf_linkage retries the access */
+    }
+    if ((error & PF_PRESENT) != 0 && (error & PF_WRITE) != 0 && user_cow_fault(addr) == 0) {
+        return;     /* first write to a shared image page */
+    }
     printf("Exception - Page fault\n");
     sys_halt (255);
     return;
@@ -10,6 +10,7 @@
 /* Local Variables */
 #define KEYBOARD_INDEX  33  /* Index in the IDT for keyboard interrupts. */
 #define RTC_INDEX   40  /* Index in the IDT for RTC interrupts */
+#define PF_INDEX    14  /* Page fault, the one exception taken through an interrupt gate */
 #define RESERVED    15  /* Exception reserved for Intel */
 #define NUM_EXC 32  /* Number of exceptions */
 #define NUM_OUR_EXC 20  /* Number of exceptions not Intel reserved */
@@ -34,7 +35,7 @@ void handle_TS(); /* Invalid TSS exception handler. */
 void handle_NP(); /* Segment not present exception handler. */
 void handle_SS(); /* Stack segment fault exception handler. */
 void handle_GP(); /* General protection exception handler. */
-void handle_PF(); /* Page fault exception handler. */
+void handle_PF(uint32_t addr, uint32_t error); /* Page fault exception handler. */
 void handle_MF(); /* x87 FPU floating-point error exception handler. */
 void handle_AC(); /* Alignment check exception handler. */
 void handle_MC(); /* Machine check exception handler. */
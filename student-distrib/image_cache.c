@@ -0,0 +1,200 @@
+/* image_cache.c - Keeps pristine copies of frequently executed programs so a
+ * respawn maps the copy instead of a lookup, parse, and block-by-block read.
+ * Every process running a program shares the copy until it writes a page.
+ * vim:ts=4 noexpandtab
+ */
+
+#include "image_cache.h"
+#include "lib.h"
+
+/* Local variables */
+exec_image_t images[NUM_CACHED_IMAGES];  /* programs we have seen executed */
+uint32_t cache_top = IMAGE_CACHE_START;  /* next free byte in the cache page */
+
+/*
+ * find_image()
+ *   DESCRIPTION: Finds the cache entry tracking a program
+ *   INPUTS: name -- the name of the program
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to the entry, or NULL if the program is not tracked
+ *   SIDE EFFECTS: none
+ */
+static exec_image_t* find_image(const uint8_t* name) {
+    int i;
+    for (i = 0; i < NUM_CACHED_IMAGES; i++) {
+        if (images[i].in_use == 1 && strncmp((const int8_t*)images[i].name, (const int8_t*)name, MAX_SIZE_FNAME + 1) == 0) {
+            return &images[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * snapshot_image()
+ *   DESCRIPTION: Copies a program from the file system into the cache page
+ *   INPUTS: image -- the entry to snapshot
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the cache is full
+ *   SIDE EFFECTS: advances cache_top
+ */
+static int32_t snapshot_image(exec_image_t* image) {
+    uint32_t size = (image->length + PAGE_4K_SIZE - 1) & ~(PAGE_4K_SIZE - 1);  /* whole pages, so they can be mapped */
+    if (cache_top + size > IMAGE_CACHE_START + IMAGE_CACHE_SIZE) {
+        return -1;  /* no room left, keep loading this program from the file system */
+    }
+    if (read_data(image->inode, 0, (uint8_t*)cache_top, image->length) != image->length) {
+        return -1;
+    }
+    /* the tail of the last page is the start of the bss, which reads as zero */
+    memset((void*)(cache_top + image->length), 0, size - image->length);
+    image->snapshot = (uint8_t*)cache_top;
+    cache_top += size;
+    return 0;
+}
+
+/*
+ * image_cache_init()
+ *   DESCRIPTION: Clears the cache and snapshots the shell, which is the program
+ *                respawned by sys_halt and the first terminal switches
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: fills the start of the cache page
+ */
+void image_cache_init() {
+    int i;
+    dentry_t dentry;
+    uint32_t eip;
+    for (i = 0; i < NUM_CACHED_IMAGES; i++) {
+        images[i].in_use = 0;
+        images[i].snapshot = NULL;
+    }
+    cache_top = IMAGE_CACHE_START;
+
+    /* The shell is always worth caching, so take its snapshot up front */
+    if (check_executable((const uint8_t*)"shell", &dentry, &eip) == 0) {
+        inode_t* shell_inode = (inode_t*)(in_memory_FS + ((dentry.inode_number + 1) * FILE_BLOCK_SIZE));
+        image_cache_note_launch((const uint8_t*)"shell", dentry.inode_number, shell_inode->length, eip);
+        exec_image_t* shell = find_image((const uint8_t*)"shell");
+        if (shell != NULL && shell->snapshot == NULL) {
+            snapshot_image(shell);
+        }
+    }
+}
+
+/*
+ * image_cache_lookup()
+ *   DESCRIPTION: Returns the snapshot of a program if one has been taken
+ *   INPUTS: name -- the name of the program
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to the entry, or NULL if there is no snapshot
+ *   SIDE EFFECTS: none
+ */
+exec_image_t* image_cache_lookup(const uint8_t* name) {
+    exec_image_t* image = find_image(name);
+    if (image == NULL || image->snapshot == NULL) {
+        return NULL;
+    }
+    return image;
+}
+
+/*
+ * image_cache_note_launch()
+ *   DESCRIPTION: Counts a launch of a program that was loaded from the file
+ *                system, and snapshots it once it has been launched often enough
+ *   INPUTS: name -- the name of the program
+ *           inode -- its inode number
+ *           length -- its size in bytes
+ *           eip -- its entry point
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may take a snapshot of the program
+ */
+void image_cache_note_launch(const uint8_t* name, uint32_t inode, uint32_t length, uint32_t eip) {
+    int i;
+    exec_image_t* image = find_image(name);
+    if (image == NULL) {
+        /* Start tracking the program in the first free entry */
+        for (i = 0; i < NUM_CACHED_IMAGES; i++) {
+            if (images[i].in_use == 0) {
+                image = &images[i];
+                break;
+            }
+        }
+        if (image == NULL) {
+            return; /* every entry is taken, nothing to track */
+        }
+        strncpy((int8_t*)image->name, (const int8_t*)name, MAX_SIZE_FNAME);
+        image->name[MAX_SIZE_FNAME] = '\0';
+        image->inode = inode;
+        image->length = length;
+        image->eip = eip;
+        image->snapshot = NULL;
+        image->launches = 0;
+        image->hits = 0;
+        image->mappers = 0;
+        image->in_use = 1;
+    }
+    image->launches++;
+    if (image->snapshot == NULL && image->launches >= IMAGE_CACHE_MIN_LAUNCHES) {
+        snapshot_image(image);
+    }
+}
+
+/*
+ * image_cache_map()
+ *   DESCRIPTION: Points the program pages a snapshot covers at the snapshot
+ *                itself, read-only and marked copy-on-write; user_cow_fault gives
+ *                the process its own copy of a page the first time it writes it
+ *   INPUTS: image -- the entry returned by image_cache_lookup
+ *           pid -- the process, whose image pages map_user_image mapped
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes page table entries and invalidates them
+ */
+void image_cache_map(exec_image_t* image, uint32_t pid) {
+    uint32_t i;
+    p_table_entry_4k_p* table = user_page_tables[pid];
+    pcb_t* process = (pcb_t*)get_pcb_from_pid(pid);
+    uint32_t first = (VIRT_USER_LOAD >> 12) & TEN_LSB_MASK;
+    uint32_t npages = (image->length + PAGE_4K_SIZE - 1) / PAGE_4K_SIZE;
+    image->launches++;
+    image->hits++;
+    image->mappers++;
+    for (i = 0; i < npages; i++) {
+        table[first + i].read_write = 0;
+        table[first + i].avail = PTE_COW;
+        table[first + i].page_base_address = ((uint32_t)image->snapshot >> 12) + i;
+    }
+    process->rss_image -= npages;
+    process->rss_shared += npages;
+    tlb_invalidate_range(VIRT_USER_LOAD, npages);
+    tlb_commit();
+}
+
+/*
+ * image_cache_unmap()
+ *   DESCRIPTION: Drops a reference taken by image_cache_map when the process
+ *                halts; its page table is rebuilt by the next exec
+ *   INPUTS: image -- the entry the process mapped
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void image_cache_unmap(exec_image_t* image) {
+    if (image->mappers > 0) {
+        image->mappers--;
+    }
+}
+
+/*
+ * image_cache_used()
+ *   DESCRIPTION: Returns how much of the cache page the snapshots take
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: bytes used
+ *   SIDE EFFECTS: none
+ */
+uint32_t image_cache_used() {
+    return cache_top - IMAGE_CACHE_START;
+}
@@ -0,0 +1,51 @@
+/* image_cache.h - Defines for the post-load executable image cache
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _IMAGE_CACHE_H
+#define _IMAGE_CACHE_H
+
+#include "types.h"
+#include "paging.h"
+#include "syscalls.h"
+#include "file_system_driver.h"
+
+/* The cache lives in its own 4MB page right after the user program frames.
+   Snapshots start on a 4KB boundary so processes can map them directly */
+#define IMAGE_CACHE_START       (PHYS_USER_PROG_STR + (NUM_PROCESS * SIZE_4MB))
+#define IMAGE_CACHE_SIZE        SIZE_4MB
+#define NUM_CACHED_IMAGES       8
+#define IMAGE_CACHE_MIN_LAUNCHES    2   /* launches before a program is snapshotted */
+
+/* Struct for one cached executable */
+typedef struct exec_image {
+    uint8_t name[MAX_SIZE_FNAME + 1];   /* file name, null terminated */
+    uint32_t inode;     /* inode number of the executable */
+    uint32_t length;    /* size of the image in bytes */
+    uint32_t eip;       /* entry point read from the ELF header */
+    uint8_t* snapshot;  /* pristine copy of the image, NULL if not cached yet */
+    uint32_t launches;  /* number of times this program was executed */
+    uint32_t hits;      /* number of launches served from the snapshot */
+    uint32_t in_use;    /* 1 if this entry is tracking a program, 0 otherwise */
+    uint32_t mappers;   /* processes whose program pages map the snapshot */
+} exec_image_t;
+
+/* Set up the cache and snapshot the shell */
+void image_cache_init();
+
+/* Returns the cache entry for a program if it has a snapshot, NULL otherwise */
+exec_image_t* image_cache_lookup(const uint8_t* name);
+
+/* Records a launch of a program, snapshotting it once it is launched often */
+void image_cache_note_launch(const uint8_t* name, uint32_t inode, uint32_t length, uint32_t eip);
+
+/* Maps a cached image read-only into a process' program page table */
+void image_cache_map(exec_image_t* image, uint32_t pid);
+
+/* Drops a process' reference to a cached image */
+void image_cache_unmap(exec_image_t* image);
+
+/* Bytes of the cache page holding snapshots */
+uint32_t image_cache_used();
+
+#endif /* _IMAGE_CACHE_H */
@@ -0,0 +1,411 @@
+/* ipc.c - Message ports. Small messages are copied through a fixed inline
+ * buffer, page payloads move between processes by remapping 4KB pages
+ * vim:ts=4 noexpandtab
+ */
+
+#include "ipc.h"
+#include "syscalls.h"
+#include "paging.h"
+#include "lib.h"
+
+/* Local variables */
+port_t ports[NUM_PORTS];
+uint32_t frame_map[IPC_POOL_FRAMES / 32];  /* bit set for every frame in use */
+
+/*
+ * alloc_frame()
+ *   DESCRIPTION: Takes a free frame from the pool
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: frame number, or -1 if the pool is empty
+ *   SIDE EFFECTS: call with interrupts disabled
+ */
+static int32_t alloc_frame() {
+    int i, bit;
+    for (i = 0; i < IPC_POOL_FRAMES / 32; i++) {
+        if (frame_map[i] == 0xFFFFFFFF) {
+            continue;
+        }
+        for (bit = 0; bit < 32; bit++) {
+            if ((frame_map[i] & (1 << bit)) == 0) {
+                frame_map[i] |= (1 << bit);
+                return i * 32 + bit;
+            }
+        }
+    }
+    return -1;
+}
+
+/*
+ * free_frame()
+ *   DESCRIPTION: Gives a frame back to the pool
+ *   INPUTS: frame -- the frame number
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call with interrupts disabled
+ */
+static void free_frame(uint32_t frame) {
+    frame_map[frame / 32] &= ~(1 << (frame % 32));
+}
+
+/*
+ * get_window()
+ *   DESCRIPTION: Finds the IPC window page table of the current process,
+ *                which belongs to the whole thread group
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the page table
+ *   SIDE EFFECTS: none
+ */
+static p_table_entry_4k_p* get_window() {
+    pcb_t* cur_pcb = (pcb_t*)get_pcb_from_pid(get_cur_pid());
+    return ipc_page_tables[cur_pcb->group_pid];
+}
+
+/*
+ * map_frame()
+ *   DESCRIPTION: Maps a pool frame at one entry of an IPC window
+ *   INPUTS: pte -- the page table entry
+ *           frame -- the frame number
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the caller flushes the TLB
+ */
+static void map_frame(p_table_entry_4k_p* pte, uint32_t frame) {
+    pte->present = 1;
+    pte->read_write = 1;
+    pte->user_supervisor = 1;
+    pte->global_page = 0;
+    pte->avail = 0;
+    pte->page_base_address = (IPC_POOL_START >> 12) + frame;
+}
+
+/*
+ * find_free_run()
+ *   DESCRIPTION: Finds npages unmapped pages in a row in an IPC window
+ *   INPUTS: window -- the page table
+ *           npages -- number of pages needed
+ *   OUTPUTS: none
+ *   RETURN VALUE: index of the first page, or -1 if there is no such run
+ *   SIDE EFFECTS: none
+ */
+static int32_t find_free_run(p_table_entry_4k_p* window, uint32_t npages) {
+    uint32_t i, run = 0;
+    for (i = 0; i < P_TABLE_SIZE; i++) {
+        run = (window[i].present == 0) ? run + 1 : 0;
+        if (run == npages) {
+            return i + 1 - npages;
+        }
+    }
+    return -1;
+}
+
+/*
+ * window_index()
+ *   DESCRIPTION: Checks that npages pages from addr are in the IPC window and
+ *                mapped, and returns the page index of addr
+ *   INPUTS: window -- the page table
+ *           addr -- page aligned user address
+ *           npages -- number of pages
+ *   OUTPUTS: none
+ *   RETURN VALUE: index of the first page, or -1 if the range is not all mapped
+ *   SIDE EFFECTS: none
+ */
+static int32_t window_index(p_table_entry_4k_p* window, uint32_t addr, uint32_t npages) {
+    uint32_t i, first;
+    if (addr < IPC_WINDOW_START || (addr & (PAGE_4K_SIZE - 1)) != 0) {
+        return -1;
+    }
+    first = (addr - IPC_WINDOW_START) / PAGE_4K_SIZE;
+    if (npages == 0 || npages > P_TABLE_SIZE || first + npages > P_TABLE_SIZE) {
+        return -1;
+    }
+    for (i = first; i < first + npages; i++) {
+        if (window[i].present == 0) {
+            return -1;
+        }
+    }
+    return first;
+}
+
+/*
+ * ipc_load()
+ *   DESCRIPTION: Points the IPC window of a process' page directory at its
+ *                page table. Called when the directory is built.
+ *   INPUTS: pid -- the process, or the leader of a thread group
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes a page directory entry
+ */
+void ipc_load(int32_t pid) {
+    int _4k_index = (uint32_t)(IPC_WINDOW_START >> 22);
+    union directory_entry* directory = process_directories[pid];
+    directory[_4k_index]._4k_pt.present = 1;
+    directory[_4k_index]._4k_pt.read_write = 1;
+    directory[_4k_index]._4k_pt.user_supervisor = 1;
+    directory[_4k_index]._4k_pt.page_size = 0;
+    directory[_4k_index]._4k_pt.pt_base_address = ((uint32_t)ipc_page_tables[pid] >> 12);
+}
+
+/*
+ * sys_ipc_alloc()
+ *   DESCRIPTION: Maps zeroed pages into the caller's IPC window, to fill in
+ *                and send with a message
+ *   INPUTS: npages -- number of pages
+ *   OUTPUTS: none
+ *   RETURN VALUE: user address of the first page, or -1 on failure
+ *   SIDE EFFECTS: takes frames from the pool
+ */
+int32_t sys_ipc_alloc(uint32_t npages) {
+    uint32_t flags, i;
+    int32_t first, frame;
+    p_table_entry_4k_p* window = get_window();
+    if (npages == 0 || npages > MSG_MAX_PAGES) {
+        return -1;
+    }
+    cli_and_save(flags);
+    first = find_free_run(window, npages);
+    if (first == -1) {
+        restore_flags(flags);
+        return -1;
+    }
+    for (i = 0; i < npages; i++) {
+        frame = alloc_frame();
+        if (frame == -1) {
+            /* give back what we took */
+            while (i-- > 0) {
+                window[first + i].present = 0;
+                free_frame(window[first + i].page_base_address - (IPC_POOL_START >> 12));
+            }
+            /* nothing touched these pages yet, so the TLB cannot hold them */
+            restore_flags(flags);
+            return -1;
+        }
+        memset((void*)(IPC_POOL_START + frame * PAGE_4K_SIZE), 0, PAGE_4K_SIZE);
+        map_frame(&window[first + i], frame);
+    }
+    /* the pages were not present, so the TLB has nothing to drop */
+    restore_flags(flags);
+    return IPC_WINDOW_START + first * PAGE_4K_SIZE;
+}
+
+/*
+ * sys_ipc_free()
+ *   DESCRIPTION: Unmaps pages from the caller's IPC window and frees them
+ *   INPUTS: addr -- address of the first page
+ *           npages -- number of pages
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the range is not all mapped
+ *   SIDE EFFECTS: gives frames back to the pool
+ */
+int32_t sys_ipc_free(uint32_t addr, uint32_t npages) {
+    uint32_t flags, i;
+    int32_t first;
+    p_table_entry_4k_p* window = get_window();
+    cli_and_save(flags);
+    first = window_index(window, addr, npages);
+    if (first == -1) {
+        restore_flags(flags);
+        return -1;
+    }
+    for (i = first; i < first + npages; i++) {
+        window[i].present = 0;
+        free_frame(window[i].page_base_address - (IPC_POOL_START >> 12));
+    }
+    tlb_invalidate_range(addr, npages);
+    tlb_commit();
+    restore_flags(flags);
+    return 0;
+}
+
+/*
+ * sys_port_create()
+ *   DESCRIPTION: Returns the port created with a key, or creates one owned by
+ *                the caller
+ *   INPUTS: key -- the key
+ *   OUTPUTS: none
+ *   RETURN VALUE: port ID on success, -1 if every port is in use
+ *   SIDE EFFECTS: none
+ */
+int32_t sys_port_create(uint32_t key) {
+    uint32_t flags;
+    int i;
+    pcb_t* cur_pcb = (pcb_t*)get_pcb_from_pid(get_cur_pid());
+    cli_and_save(flags);
+    for (i = 0; i < NUM_PORTS; i++) {
+        if (ports[i].in_use == 1 && ports[i].key == key) {
+            restore_flags(flags);
+            return i;
+        }
+    }
+    for (i = 0; i < NUM_PORTS; i++) {
+        if (ports[i].in_use == 0) {
+            ports[i].in_use = 1;
+            ports[i].key = key;
+            ports[i].owner = cur_pcb->group_pid;
+            ports[i].head = 0;
+            ports[i].count = 0;
+            ports[i].recv_wait.waiters = 0;
+            ports[i].send_wait.waiters = 0;
+            restore_flags(flags);
+            return i;
+        }
+    }
+    restore_flags(flags);
+    return -1;
+}
+
+/*
+ * sys_msg_send()
+ *   DESCRIPTION: Queues a message on a port. The inline bytes are copied; the
+ *                pages are unmapped from the caller and handed to the receiver
+ *                without copying. Blocks while the port is full.
+ *   INPUTS: port -- the port
+ *           msg -- the message, pages/npages name pages in the IPC window
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: the caller loses access to the pages
+ */
+int32_t sys_msg_send(int32_t port, msg_t* msg) {
+    uint32_t flags, i;
+    int32_t first = 0;
+    msg_t copy;
+    port_t* p;
+    port_msg_t* slot;
+    p_table_entry_4k_p* window = get_window();
+    if (port < 0 || port >= NUM_PORTS) {
+        return -1;
+    }
+    if (user_range_check(msg, sizeof(msg_t)) == -1) {
+        return -1;
+    }
+    /* another thread of the caller can rewrite msg while we sleep, so only the copy is used */
+    memcpy((void*)&copy, (const void*)msg, sizeof(msg_t));
+    if (copy.length > MSG_INLINE_SIZE || copy.npages > MSG_MAX_PAGES) {
+        return -1;
+    }
+    p = &ports[port];
+    cli_and_save(flags);
+    if (copy.npages != 0 && window_index(window, copy.pages, copy.npages) == -1) {
+        restore_flags(flags);
+        return -1;
+    }
+    while (p->in_use == 1 && p->count == PORT_QUEUE_LEN) {
+        sleep_on(&p->send_wait);
+    }
+    if (p->in_use == 0) {
+        restore_flags(flags);
+        return -1;
+    }
+    /* the pages may have been freed or sent by another thread while we slept */
+    if (copy.npages != 0 && (first = window_index(window, copy.pages, copy.npages)) == -1) {
+        restore_flags(flags);
+        return -1;
+    }
+    slot = &p->queue[(p->head + p->count) % PORT_QUEUE_LEN];
+    slot->length = copy.length;
+    memcpy((void*)slot->data, (const void*)copy.data, copy.length);
+    slot->npages = copy.npages;
+    for (i = 0; i < copy.npages; i++) {
+        slot->frames[i] = window[first + i].page_base_address - (IPC_POOL_START >> 12);
+        window[first + i].present = 0;
+    }
+    if (copy.npages != 0) {
+        tlb_invalidate_range(IPC_WINDOW_START + first * PAGE_4K_SIZE, copy.npages);
+        tlb_commit();
+    }
+    p->count++;
+    wake_up(&p->recv_wait);
+    restore_flags(flags);
+    return 0;
+}
+
+/*
+ * sys_msg_recv()
+ *   DESCRIPTION: Takes the oldest message off a port, sleeping until there is
+ *                one. Its pages are mapped into the caller's IPC window.
+ *   INPUTS: port -- the port
+ *           msg -- filled in with the message, pages is where the payload landed
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: the caller owns the payload pages and frees them with ipc_free
+ */
+int32_t sys_msg_recv(int32_t port, msg_t* msg) {
+    uint32_t flags, i;
+    int32_t first = 0;
+    port_t* p;
+    port_msg_t* slot;
+    p_table_entry_4k_p* window = get_window();
+    if (port < 0 || port >= NUM_PORTS) {
+        return -1;
+    }
+    if (user_range_check(msg, sizeof(msg_t)) == -1) {
+        return -1;
+    }
+    p = &ports[port];
+    cli_and_save(flags);
+    while (p->in_use == 1 && p->count == 0) {
+        sleep_on(&p->recv_wait);
+    }
+    if (p->in_use == 0) {
+        restore_flags(flags);
+        return -1;
+    }
+    slot = &p->queue[p->head];
+    if (slot->npages != 0 && (first = find_free_run(window, slot->npages)) == -1) {
+        restore_flags(flags);
+        return -1;  /* no room in the window, the message stays queued */
+    }
+    for (i = 0; i < slot->npages; i++) {
+        map_frame(&window[first + i], slot->frames[i]);
+    }
+    /* mapping into not present entries needs no invalidation */
+    msg->length = slot->length;
+    memcpy((void*)msg->data, (const void*)slot->data, slot->length);
+    msg->npages = slot->npages;
+    msg->pages = (slot->npages != 0) ? IPC_WINDOW_START + first * PAGE_4K_SIZE : 0;
+    p->head = (p->head + 1) % PORT_QUEUE_LEN;
+    p->count--;
+    wake_up(&p->send_wait);
+    restore_flags(flags);
+    return 0;
+}
+
+/*
+ * ipc_release()
+ *   DESCRIPTION: Frees the pages in a halting process' IPC window and closes
+ *                the ports it owns, along with the pages of queued messages
+ *   INPUTS: pid -- the process
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: wakes anyone blocked on the closed ports
+ */
+void ipc_release(int32_t pid) {
+    uint32_t flags, i, j;
+    p_table_entry_4k_p* window = ipc_page_tables[pid];
+    port_msg_t* slot;
+    cli_and_save(flags);
+    for (i = 0; i < P_TABLE_SIZE; i++) {
+        if (window[i].present == 1) {
+            window[i].present = 0;
+            free_frame(window[i].page_base_address - (IPC_POOL_START >> 12));
+        }
+    }
+    for (i = 0; i < NUM_PORTS; i++) {
+        if (ports[i].in_use == 0 || ports[i].owner != pid) {
+            continue;
+        }
+        while (ports[i].count != 0) {
+            slot = &ports[i].queue[ports[i].head];
+            for (j = 0; j < slot->npages; j++) {
+                free_frame(slot->frames[j]);
+            }
+            ports[i].head = (ports[i].head + 1) % PORT_QUEUE_LEN;
+            ports[i].count--;
+        }
+        ports[i].in_use = 0;
+        wake_up(&ports[i].recv_wait);
+        wake_up(&ports[i].send_wait);
+    }
+    restore_flags(flags);
+}
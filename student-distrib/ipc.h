@@ -0,0 +1,73 @@
+/* ipc.h - Defines for message ports
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _IPC_H
+#define _IPC_H
+
+#include "types.h"
+#include "shm.h"
+#include "scheduling.h"
+
+/* Physical 4KB frames for page payloads, a 4MB pool after the shared memory segments */
+#define IPC_POOL_START      (SHM_START + NUM_SHM_SEGMENTS * SHM_SEGMENT_SIZE)
+#define IPC_POOL_FRAMES     (SIZE_4MB / PAGE_4K_SIZE)
+
+/* Each process maps payload pages in a 4MB window above the vidmap page */
+#define IPC_WINDOW_START    0x08C00000
+
+#define NUM_PORTS           8
+#define PORT_QUEUE_LEN      4       /* messages a port holds before senders block */
+#define MSG_INLINE_SIZE     64      /* bytes copied with every message */
+#define MSG_MAX_PAGES       256     /* 1MB of pages per message */
+
+/* A message as user programs see it */
+typedef struct msg {
+    uint32_t length;                /* bytes used in data */
+    uint8_t data[MSG_INLINE_SIZE];  /* small payload, copied */
+    uint32_t pages;                 /* page aligned address of the page payload, 0 if none */
+    uint32_t npages;                /* number of pages moved with the message */
+} msg_t;
+
+/* A message waiting in a port, its pages are unmapped from everyone */
+typedef struct port_msg {
+    uint32_t length;
+    uint8_t data[MSG_INLINE_SIZE];
+    uint32_t npages;
+    uint16_t frames[MSG_MAX_PAGES]; /* pool frame numbers of the payload */
+} port_msg_t;
+
+/* Struct for one message port */
+typedef struct port {
+    uint32_t key;       /* key the port was created with */
+    int32_t owner;      /* process that created it, the port goes away when it halts */
+    uint32_t in_use;    /* 1 if the port exists, 0 otherwise */
+    uint32_t head;      /* index of the oldest message */
+    uint32_t count;     /* number of queued messages */
+    port_msg_t queue[PORT_QUEUE_LEN];
+    wait_queue_t recv_wait;     /* receivers waiting for a message */
+    wait_queue_t send_wait;     /* senders waiting for room */
+} port_t;
+
+/* Returns the port with a key, creating it if needed */
+int32_t sys_port_create(uint32_t key);
+
+/* Queues a message on a port, moving its pages out of the caller */
+int32_t sys_msg_send(int32_t port, msg_t* msg);
+
+/* Takes the oldest message off a port, mapping its pages into the caller */
+int32_t sys_msg_recv(int32_t port, msg_t* msg);
+
+/* Maps fresh zeroed pages into the caller's IPC window */
+int32_t sys_ipc_alloc(uint32_t npages);
+
+/* Unmaps and frees pages from the caller's IPC window */
+int32_t sys_ipc_free(uint32_t addr, uint32_t npages);
+
+/* Frees a halting process' pages and ports */
+void ipc_release(int32_t pid);
+
+/* Points the IPC window at a process' page table */
+void ipc_load(int32_t pid);
+
+#endif /* _IPC_H */
@@ -15,6 +15,15 @@
 #include "paging.h"
 #include "file_system_driver.h"
 #include "pit.h"
+#include "image_cache.h"
+#include "workqueue.h"
+#include "scheduling.h"
+#include "slab.h"
+#include "pipe.h"
+#include "heap.h"
+#include "zswap.h"
+#include "timer.h"
+#include "clock.h"
 
 #define RUN_TESTS
 
@@ -157,6 +166,16 @@ void entry(unsigned long magic, unsigned long addr) {
     rtc_init();     /* Initializes the RTC */
     file_system_init();  /* Initialize File System*/
     page_init();    /* Initializes paging */
+    kmem_init();    /* Sets up the kernel heap, which page_init mapped */
+    fd_table_init();    /* Caches for descriptor tables and pipes */
+    pipe_init();
+    heap_init();    /* Frames for user heaps */
+    timer_init();   /* Empty timer wheels, before anything adds a timer */
+    zswap_init();   /* Compressed swap behind them */
+    image_cache_init();  /* Snapshots the shell for fast respawns */
+    sched_init();   /* Empty run queues, before any thread exists */
+    workqueue_init();   /* Starts the worker thread for deferred work */
+    clock_init();   /* Times the TSC on PIT channel 2, before channel 0 starts ticking */
     pit_init();
 
     /* Enable interrupts */
@@ -8,6 +8,9 @@
 #include "lib.h"
 #include "syscalls.h"
 #include "scheduling.h"
+#include "workqueue.h"
+#include "poll.h"
+#include "clock.h"
 
 /* Scan code when neither shift or caps lock pressed */
 unsigned char scan_code[SCAN_CODE_SIZE] = {'\0', '\0', '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '-', '=', 
@@ -40,13 +43,17 @@ unsigned int ctrl_flag = 0; /* Flag indicating when control is pressed */
 unsigned int end_y_flag = 0; /* Flag indicating we are at row 24 (last row of video memory, for scrolling purposes) */
 unsigned int alt_flag = 0;   /* Flag indicating when alt is pressed */
 unsigned int displayed_term = 0;
-terminal_t terminals[3];
+terminal_t terminals[NUM_TERMINALS];
 char buffer[128]; /* Keyboard buffer */
 int cur_index = 0; /* Current index of the keyboard buffer */
-volatile unsigned int buf_flag = 0; /* Flag indicating we have a '\n' character as input (stop reading) */
 int read_flag = 1;
-int first_use_term_one = 0;
-int first_use_term_two = 0;
+int term_started[NUM_TERMINALS] = {1, 0, 0};  /* terminal 0's shell is started at boot */
+uint32_t kb_max_ns = 0;     /* Longest time spent in keyboard_handler, in nanoseconds */
+static wait_queue_t line_queues[NUM_TERMINALS];  /* readers waiting for a line on each terminal */
+static uint64_t line_stamp = 0;     /* clock_ns when the last line was finished */
+static uint32_t line_max_ns = 0;    /* longest wait from Enter to a sleeping reader running */
+static uint64_t line_total_ns = 0;
+static uint32_t line_count = 0;     /* lines the averages cover */
 
 /* 
  * keyboard_init()
@@ -62,12 +69,13 @@ void keyboard_init() {
     /* Disable cursor */
     outb(0x0A, 0x3D4);
     outb(0x20, 0x3D5);
-    for (i = 0; i<3; i++) {
+    for (i = 0; i < NUM_TERMINALS; i++) {
         char term_buffer[128];
         terminals[i].cur_x = 0;
         terminals[i].cur_y = 0;
         terminals[i].cur_index = 0;
         memcpy((void*)terminals[i].buffer, (const void*)term_buffer, 128);
+        terminals[i].line_ready = 0;
         terminals[i].processes = 0;
         // if (i == 0) {
         //     terminals[i].address = 0;//0xB9000 + (i*0x1000);
@@ -89,9 +97,12 @@ void keyboard_init() {
  *   RETURN VALUE: none
  *   SIDE EFFECTS: Prints keyboard input onto screen
  *                 Sends End-of-Interrupt signal to IRQ 1 on PIC
+ *                 May switch to the reader woken by Enter
  */
 void keyboard_handler() {
     cli();
+    uint64_t start = clock_ns();
+    uint32_t took;
     int input = inb(KEYBOARD_DATA_PORT);      /* Get input from keyboard */
     // 3A is the scan code for caps lock
     if (input == 0x3A) {
@@ -145,94 +156,10 @@ void keyboard_handler() {
             }
         }
     } else if (alt_flag == 1) {
-        /* Checks if a F# key is pressed */
-        if (input == 0x3B) {
-            /* Checks if terminal needs to be switched*/
-            if(displayed_term != 0) {
-                int orig_term = displayed_term;
-                displayed_term = 0; // Change terminal number
-
-                /* Updates current screen position and index */
-                terminals[orig_term].cur_x = get_screen_x();
-                terminals[orig_term].cur_y = get_screen_y();
-                terminals[orig_term].cur_index = cur_index;
-
-                /* Saves buffer */
-                memcpy((void*)terminals[orig_term].buffer, (const void*)buffer, MAX_BUFFER_SIZE);
-
-                /* Sets screen position and index for new terminal */
-                set_screen_x(terminals[0].cur_x);
-                set_screen_y(terminals[0].cur_y);
-                cur_index = terminals[0].cur_index;
-
-                /* Copies buffer */
-                memcpy((void*)buffer, (const void*)terminals[0].buffer, MAX_BUFFER_SIZE);
-
-
-                copy_to_vidmem(orig_term, 0);  /* Copies and saves terminal video information */
-                send_eoi(KEYBOARD_IRQ);
-                switch_term_tasks(terminals[orig_term].address, terminals[0].address); /* Switch processes */
-            }
-        }
-        else if (input == 0x3C) {
-            if(displayed_term != 1) {
-                int orig_term = displayed_term;
-                displayed_term = 1;
-                terminals[orig_term].cur_x = get_screen_x();
-                terminals[orig_term].cur_y = get_screen_y();
-                terminals[orig_term].cur_index = cur_index;
-                memcpy((void*)terminals[orig_term].buffer, (const void*)buffer, MAX_BUFFER_SIZE);
-                set_screen_x(terminals[1].cur_x);
-                set_screen_y(terminals[1].cur_y);
-                cur_index = terminals[1].cur_index;
-                memcpy((void*)buffer, (const void*)terminals[1].buffer, MAX_BUFFER_SIZE);
-                copy_to_vidmem(orig_term, 1);
-                //send_eoi(KEYBOARD_IRQ);
-
-                /* Checks if shell needs to be initializes (first time entering terminal) */
-                if (first_use_term_one == 0) {
-                    send_eoi(KEYBOARD_IRQ);
-                    first_use_term_one = 1;
-                    int ret = sys_exec((const uint8_t*)"shell");
-
-                    /* Checks if shell can be executed */
-                    if (ret == -1) {
-                        first_use_term_one = 0;
-                    }
-                }
-                else {
-                    send_eoi(KEYBOARD_IRQ);
-                    switch_term_tasks(terminals[orig_term].address, terminals[1].address);
-                }
-            }
-        }
-        else if (input == 0x3D) {
-            if(displayed_term != 2) {
-                int orig_term = displayed_term;
-                displayed_term = 2;
-                terminals[orig_term].cur_x = get_screen_x();
-                terminals[orig_term].cur_y = get_screen_y();
-                terminals[orig_term].cur_index = cur_index;
-                memcpy((void*)terminals[orig_term].buffer, (const void*)buffer, MAX_BUFFER_SIZE);
-                set_screen_x(terminals[2].cur_x);
-                set_screen_y(terminals[2].cur_y);
-                cur_index = terminals[2].cur_index;
-                memcpy((void*)buffer, (const void*)terminals[2].buffer, MAX_BUFFER_SIZE);
-                copy_to_vidmem(orig_term, 2);
-                //send_eoi(KEYBOARD_IRQ);
-                if (first_use_term_two == 0) {
-                    send_eoi(KEYBOARD_IRQ);
-                    first_use_term_two = 1;
-                    int ret = sys_exec((const uint8_t*)"shell");
-                    if (ret == -1) {
-                        first_use_term_two = 0;
-                    }
-                }
-                else {
-                    send_eoi(KEYBOARD_IRQ);
-                    switch_term_tasks(terminals[orig_term].address, terminals[2].address);
-                }
-            }
+        /* Checks if a F# key is pressed (F1 to F3 are 0x3B to 0x3D), the
+         * switch itself runs on the worker thread so we return right away */
+        if (input >= 0x3B && input <= 0x3D) {
+            queue_work(switch_terminal, (void*)(input - 0x3B));
         }
     } else if (input <= SCAN_CODE_SIZE) { // case for printing characters
         // clear the screen
@@ -284,11 +211,37 @@ void keyboard_handler() {
     send_eoi(KEYBOARD_IRQ);
     /* Ends read if a newline character was pressed */
     if (input == 0x1C) {
-        buf_flag = 1;
+        terminal_submit_line();
     }
     if (cur_index == 127) {
         read_flag = 0;
     }
+    /* Track worst case latency */
+    took = (uint32_t)(clock_ns() - start);
+    if (took > kb_max_ns) {
+        kb_max_ns = took;
+    }
+    /* the reader woken by Enter outranks a CPU hog, don't wait for the tick */
+    sched_preempt();
+}
+
+/*
+ * terminal_submit_line()
+ *   DESCRIPTION: Hands the typed line to the reader of the displayed
+ *                terminal, what pressing Enter does
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: wakes the terminal's readers and pollers
+ */
+void terminal_submit_line() {
+    uint32_t flags;
+    cli_and_save(flags);
+    terminals[displayed_term].line_ready = 1;
+    line_stamp = clock_ns();
+    wake_up(&line_queues[displayed_term]);  /* only readers on the terminal typed on */
+    poll_notify();  /* stdin is readable now */
+    restore_flags(flags);
 }
 
 /*
@@ -302,34 +255,91 @@ void keyboard_handler() {
  *                 newline character)
  */
 int32_t terminal_read(uint32_t fd, void* buf, uint32_t nbytes) {
-    buf_flag = 0;
-    while (buf_flag == 0);  /* Wait until a newline character is pressed */
+    pcb_t* cur_pcb = (pcb_t*)get_pcb_from_pid(get_cur_pid());
+    int term = ((int32_t)cur_pcb != -1) ? cur_pcb->term : displayed_term;
+    if (fd_nonblocking(fd) && terminals[term].line_ready == 0) {
+        return WOULD_BLOCK; /* no line yet, don't wait for one */
+    }
+    /* Sleep until a newline character is pressed on this process's terminal,
+     * a line finished before the call is returned right away so poll can
+     * report stdin as readable */
+    uint32_t flags, slept = 0;
+    char* line;
+    int* line_index;
+    cli_and_save(flags);
+    while (terminals[term].line_ready == 0) {
+        if ((int32_t)cur_pcb == -1) {
+            asm volatile ("sti; hlt; cli" : : : "memory");  /* kernel tests have no PCB to sleep in */
+        }
+        else {
+            sleep_on(&line_queues[cur_pcb->term]);
+            slept = 1;
+        }
+    }
+    /* Time from Enter to the reader running again, how long a shell takes to answer */
+    if (slept == 1) {
+        uint32_t wait = (uint32_t)(clock_ns() - line_stamp);
+        if (wait > line_max_ns) {
+            line_max_ns = wait;
+        }
+        line_total_ns += wait;
+        line_count++;
+    }
     int i = 0;
     int buf_length;
     int ret;
     char* buff = (char*)buf;
+    /* the line is in the live buffer while its terminal is displayed, and
+     * was saved with the terminal when it was switched away from */
+    if (term == displayed_term) {
+        line = buffer;
+        line_index = &cur_index;
+    }
+    else {
+        line = terminals[term].buffer;
+        line_index = &terminals[term].cur_index;
+    }
     /* Check if the keyboard buffer is greater than 127 characters */
-    if (cur_index == MAX_CHARS_TYPED) {
+    if (*line_index == MAX_CHARS_TYPED) {
         buf_length = MAX_CHARS_TYPED;   /* If it was, only copy the first 127 characters */
         ret = buf_length+1;
         buff[MAX_CHARS_TYPED] = '\n';    /* Set the last character to a newline character */
         buff[MAX_BUFFER_SIZE] = '\0';    /* Make the buffer null terminated */
     } else {
-        buf_length = cur_index; /* If not, length of buf is length of the keyboard buffer */
+        buf_length = *line_index;   /* If not, length of buf is length of the keyboard buffer */
         ret = buf_length;
         buff[buf_length] = '\0'; /* Make buffer null terminated */
     }
     /* Copy contents of buffer to buf */
     for (i = 0; i < buf_length; i++) {
-        buff[i] = buffer[i];
+        buff[i] = line[i];
     }
     buf = (void*)buff;
-    cur_index = 0;  /* Clear keyboard buffer for next read */
-    buf_flag = 0;   /* Clear buffer flag for next read */
-    read_flag = 1;
+    *line_index = 0;    /* Clear keyboard buffer for next read */
+    terminals[term].line_ready = 0; /* Clear buffer flag for next read */
+    if (term == displayed_term) {
+        read_flag = 1;
+    }
+    restore_flags(flags);
     return ret; /* Return number of bytes read */
 }
 
+/*
+ * terminal_poll()
+ *   DESCRIPTION: Readiness hook for stdin
+ *   INPUTS: fd -- the stdin descriptor
+ *   OUTPUTS: none
+ *   RETURN VALUE: POLLIN if a line is waiting on this process's terminal, 0 otherwise
+ *   SIDE EFFECTS: none
+ */
+int32_t terminal_poll(uint32_t fd) {
+    pcb_t* cur_pcb = (pcb_t*)get_pcb_from_pid(get_cur_pid());
+    if (terminals[cur_pcb->term].line_ready == 1) {
+        return POLLIN;
+    }
+    return 0;
+}
+
 /*
  * terminal_write()
  *   DESCRIPTION: Writes the contents of buf to the screen
@@ -352,11 +362,23 @@ int32_t terminal_write(uint32_t fd, const void* buf, uint32_t nbytes) {
     //     return -1;
     // }
     int i = 0;
-    /* Print out all characters in buf, scroll if necessary */
+    uint32_t flags;
+    pcb_t* cur_pcb = (pcb_t*)get_pcb_from_pid(get_cur_pid());
+    int term = ((int32_t)cur_pcb != -1 && cur_pcb->kthread == 0) ? cur_pcb->term : displayed_term;
+    /* the terminal may not be switched halfway through */
+    cli_and_save(flags);
+    /* Print out all characters in buf, scroll if necessary. A terminal in the
+     * background keeps running, its output goes to its saved screen */
     while(i < nbytes) {
-        putc(buff[i]);
+        if (term == displayed_term) {
+            putc(buff[i]);
+        }
+        else {
+            putc_at(buff[i], (char*)(TERMINAL_START + term * VIDMEM_SIZE), &terminals[term].cur_x, &terminals[term].cur_y);
+        }
         i++;
     }
+    restore_flags(flags);
     return nbytes;  /* Return the number of bytes written */
 }
 
@@ -444,6 +466,23 @@ void update_term_pid(int new_pid) {
     terminals[displayed_term].address = new_pid;
 }
 
+/*
+ * set_term_pid()
+ *   DESCRIPTION: Updates the foreground process of a given terminal
+ *   INPUTS: term -- terminal to update
+ *           new_pid -- pid of the process that now owns the terminal
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Updates terminal struct
+ */
+void set_term_pid(int term, int new_pid) {
+    terminals[term].address = new_pid;
+    /* a program started there directly owns it, switching to it starts no shell */
+    if (new_pid != -1) {
+        term_started[term] = 1;
+    }
+}
+
 /*
  * get_cur_term()
  *   DESCRIPTION: Returns current number of current terminal open
@@ -468,13 +507,38 @@ void update_term(int term) {
     terminals[displayed_term].cur_x = get_screen_x();
     terminals[displayed_term].cur_y = get_screen_y();
     terminals[displayed_term].cur_index = cur_index;
-    memcpy((void*)terminals[term].buffer, (const void*)buffer, MAX_BUFFER_SIZE);
+    memcpy((void*)terminals[displayed_term].buffer, (const void*)buffer, MAX_BUFFER_SIZE);
     set_screen_x(terminals[term].cur_x);
     set_screen_y(terminals[term].cur_y);
     cur_index = terminals[term].cur_index;
     memcpy((void*)buffer, (const void*)terminals[term].buffer, MAX_BUFFER_SIZE);
-    copy_to_vidmem(displayed_term, term);
+    uint32_t flags;
+    int old_term = displayed_term;
+    /* nothing may draw between saving the screen and moving the vidmap pages */
+    cli_and_save(flags);
+    copy_to_vidmem(old_term, term);
     displayed_term = term;
+    retarget_vidmem(old_term, term_video_page(old_term));
+    retarget_vidmem(term, term_video_page(term));
+    tlb_commit();
+    restore_flags(flags);
+    sched_reprioritize();   /* the boost moves with the displayed terminal */
+}
+
+/*
+ * term_video_page()
+ *   DESCRIPTION: Returns where a terminal's screen is: video memory while it
+ *                is displayed, its save page while it is hidden
+ *   INPUTS: term -- the terminal
+ *   OUTPUTS: none
+ *   RETURN VALUE: physical address of the page
+ *   SIDE EFFECTS: none
+ */
+uint32_t term_video_page(int term) {
+    if (term == displayed_term) {
+        return VIDEO_MEM_START;
+    }
+    return TERMINAL_START + term * VIDMEM_SIZE;
 }
 
 /*
@@ -525,3 +589,63 @@ int get_term_proc(int term) {
     return terminals[term].processes;
 }
 
+/*
+ * switch_terminal()
+ *   DESCRIPTION: Switches the displayed terminal, starting its shell the first
+ *                time it is shown. Runs on the worker thread, queued by
+ *                keyboard_handler.
+ *   INPUTS: arg -- terminal number to switch to
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Saves and restores the screen, cursor and keyboard buffer
+ */
+void switch_terminal(void* arg) {
+    uint32_t flags;
+    int term = (int)arg;
+    cli_and_save(flags);
+    if (term < 0 || term >= NUM_TERMINALS || term == displayed_term) {
+        restore_flags(flags);
+        return;
+    }
+    update_term(term);
+    /* Checks if shell needs to be initialized (first time entering terminal) */
+    if (term_started[term] == 0) {
+        term_started[term] = 1;
+        if (spawn_process((const uint8_t*)"shell", -1, term) == -1) {
+            term_started[term] = 0;
+        }
+    }
+    restore_flags(flags);
+}
+
+/*
+ * get_kb_max_ns()
+ *   DESCRIPTION: Returns the longest time keyboard_handler has run
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: worst case keyboard interrupt latency in nanoseconds
+ *   SIDE EFFECTS: none
+ */
+uint32_t get_kb_max_ns() {
+    return kb_max_ns;
+}
+
+/*
+ * get_line_latency()
+ *   DESCRIPTION: Returns how long readers sleeping for a line took to run
+ *                after Enter was pressed, and starts counting again
+ *   INPUTS: none
+ *   OUTPUTS: max_ns -- the longest wait
+ *   RETURN VALUE: the average wait in nanoseconds, 0 if no line was read
+ *   SIDE EFFECTS: clears the counts
+ */
+uint32_t get_line_latency(uint32_t* max_ns) {
+    uint32_t flags, avg;
+    cli_and_save(flags);
+    avg = (line_count == 0) ? 0 : (uint32_t)div64_32(line_total_ns, line_count, NULL);
+    *max_ns = line_max_ns;
+    line_max_ns = line_count = 0;
+    line_total_ns = 0;
+    restore_flags(flags);
+    return avg;
+}
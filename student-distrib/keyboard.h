@@ -13,6 +13,7 @@
 #define MAX_X   79
 #define MAX_CHARS_TYPED 127
 #define MAX_BUFFER_SIZE 128
+#define NUM_TERMINALS   3
 
 /* Strcut to hold each terminals incormation separatly */
 typedef struct terminal{
@@ -20,6 +21,7 @@ typedef struct terminal{
     int cur_y;
     int cur_index;
     char buffer[128];
+    volatile int line_ready;    /* 1 once Enter finished a line its reader has not taken */
     int address;
     int processes;
 } terminal_t;
@@ -48,6 +50,9 @@ void set_flags(int input);
 /* Copies the contents of the keyboard buffer into the parameter buffer buf */
 int32_t terminal_read (uint32_t fd, void* buf, uint32_t nbytes);
 
+/* Returns POLLIN if a line is waiting for the current process */
+int32_t terminal_poll (uint32_t fd);
+
 /* Always returns -1, for stdout purposes */
 int32_t read_fail (uint32_t fd, void* buf, uint32_t nbytes);
 
@@ -72,12 +77,18 @@ int32_t close_fail(uint32_t fd);
 /* Updates information in termianl */
 void update_term_pid(int new_pid);
 
+/* Sets the foreground process of a terminal */
+void set_term_pid(int term, int new_pid);
+
 /* Gets current terminal being displayed */
 int get_cur_term();
 
 /* Updates terminal information upon switch */
 void update_term(int term);
 
+/* Physical page holding a terminal's screen */
+uint32_t term_video_page(int term);
+
 /* Get termianl PID from struct */
 int get_term_pid(int term);
 
@@ -90,4 +101,16 @@ void dec_term_proc(int term);
 /* Get number of processes in terminal */
 int get_term_proc(int term);
 
+/* Switches the displayed terminal, run on the worker thread */
+void switch_terminal(void* arg);
+
+/* Worst case keyboard interrupt latency in nanoseconds */
+uint32_t get_kb_max_ns();
+
+/* Hands the typed line to the displayed terminal's reader, as Enter does */
+void terminal_submit_line();
+
+/* Returns the average wait from Enter to the reader running, and the longest */
+uint32_t get_line_latency(uint32_t* max_ns);
+
 #endif /* _KEYBOARD_H */
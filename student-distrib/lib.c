@@ -63,23 +63,36 @@ int get_screen_y() {
 }
 
 /* 
- * scroll()
- *   DESCRIPTION: scrolls the screen downward when screen is filled up
- *   INPUTS: none
+ * scroll_at()
+ *   DESCRIPTION: scrolls a text page downward when it is filled up
+ *   INPUTS: mem -- the page, the screen or a terminal's saved copy
+ *           x, y -- the cursor of that page
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: scrolls the screen downward
+ *   SIDE EFFECTS: moves the cursor to the bottom left
  */
-void scroll(void) {
+static void scroll_at(char* mem, int* x, int* y) {
     int32_t i;
     for (i = 0; i < (NUM_ROWS - 1) * NUM_COLS; i++) {
-        video_mem[i << 1] = video_mem[(i + 80) << 1]; // use row major order to update video memory to point to new line
+        mem[i << 1] = mem[(i + 80) << 1]; // use row major order to update video memory to point to new line
     }
     for (i = (NUM_ROWS - 1) * NUM_COLS; i < NUM_ROWS * NUM_COLS; i++) {
-        video_mem[i << 1] = '\0'; // update all of the empty spaces to just be null charcters
+        mem[i << 1] = '\0'; // update all of the empty spaces to just be null charcters
     }
-    screen_x = 0; // update on screen x and y positions to point to bottom left
-    screen_y = 24;
+    *x = 0; // update on screen x and y positions to point to bottom left
+    *y = 24;
+}
+
+/* 
+ * scroll()
+ *   DESCRIPTION: scrolls the screen downward when screen is filled up
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: scrolls the screen downward
+ */
+void scroll(void) {
+    scroll_at(video_mem, &screen_x, &screen_y);
 }
 
 /* void clear(void);
@@ -233,46 +246,57 @@ int32_t puts(int8_t* s) {
     return index;
 }
 
-/* void putc(uint8_t c);
+/* void putc_at(uint8_t c, char* mem, int* x, int* y);
  * Inputs: uint_8* c = character to print
+ *         char* mem = text page to print it on
+ *         int* x, y = cursor of that page
  * Return Value: void
- *  Function: Output a character to the console */
-void putc(uint8_t c) {
+ *  Function: Output a character to a text page, the screen or the saved
+ *            copy of a terminal that is not displayed */
+void putc_at(uint8_t c, char* mem, int* x, int* y) {
     int end_x_flag = 0;
-    if (get_screen_y() == 24) {
+    if (*y == 24) {
         end_y_fl = 1;
     } else {
         end_y_fl = 0;
     }
     if(c == '\n' || c == '\r') {
         if (end_y_fl == 1) {
-                scroll();
+                scroll_at(mem, x, y);
         }
         else {
-            screen_y++;
-            screen_x = 0;
+            (*y)++;
+            *x = 0;
         }
     } else {
-        if (get_screen_x() == 79) {
+        if (*x == 79) {
             end_x_flag = 1;
         }
-        *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1)) = c;
-        *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1) + 1) = ATTRIB;
-        screen_x++;
-        screen_x %= NUM_COLS;
-        screen_y = (screen_y + (screen_x / NUM_COLS)) % NUM_ROWS;
-        if (get_screen_x() == 0) {
+        *(uint8_t *)(mem + ((NUM_COLS * *y + *x) << 1)) = c;
+        *(uint8_t *)(mem + ((NUM_COLS * *y + *x) << 1) + 1) = ATTRIB;
+        (*x)++;
+        *x %= NUM_COLS;
+        *y = (*y + (*x / NUM_COLS)) % NUM_ROWS;
+        if (*x == 0) {
             if (end_x_flag == 1) {
                 if (end_y_fl == 1) {
-                    scroll();
+                    scroll_at(mem, x, y);
                 } else {
-                    set_screen_y(get_screen_y() + 1);
+                    (*y)++;
                 }
             }
         }
     }
 }
 
+/* void putc(uint8_t c);
+ * Inputs: uint_8* c = character to print
+ * Return Value: void
+ *  Function: Output a character to the console */
+void putc(uint8_t c) {
+    putc_at(c, video_mem, &screen_x, &screen_y);
+}
+
 /* int8_t* itoa(uint32_t value, int8_t* buf, int32_t radix);
  * Inputs: uint32_t value = number to convert
  *            int8_t* buf = allocated buffer to place string in
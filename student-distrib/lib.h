@@ -9,6 +9,7 @@
 
 int32_t printf(int8_t *format, ...);
 void putc(uint8_t c);
+void putc_at(uint8_t c, char* mem, int* x, int* y);
 int32_t puts(int8_t *s);
 int8_t *itoa(uint32_t value, int8_t* buf, int32_t radix);
 int8_t *strrev(int8_t* s);
@@ -83,6 +84,41 @@ static inline uint32_t inl(port) {
     return val;
 }
 
+/* Reads the 64-bit time-stamp counter and returns its low 32 bits, which
+ * is plenty for timing the short kernel paths we care about */
+static inline uint32_t rdtsc(void) {
+    uint32_t low, high;
+    asm volatile ("rdtsc"
+            : "=a"(low), "=d"(high)
+    );
+    return low;
+}
+
+/* Reads the whole 64-bit time-stamp counter, for the clock */
+static inline uint64_t rdtsc64(void) {
+    uint32_t low, high;
+    asm volatile ("rdtsc"
+            : "=a"(low), "=d"(high)
+    );
+    return ((uint64_t)high << 32) | low;
+}
+
+/* Divides a 64-bit number by a 32-bit one with two divl instructions, there
+ * is no libgcc for the / operator to call. Returns the quotient and puts the
+ * remainder in *rem if rem is not NULL */
+static inline uint64_t div64_32(uint64_t n, uint32_t d, uint32_t* rem) {
+    uint32_t high = (uint32_t)(n >> 32), low = (uint32_t)n;
+    uint32_t q_high = high / d, q_low, r;
+    asm ("divl %4"
+            : "=a"(q_low), "=d"(r)
+            : "a"(low), "d"(high % d), "rm"(d)
+    );
+    if (rem != NULL) {
+        *rem = r;
+    }
+    return ((uint64_t)q_high << 32) | q_low;
+}
+
 /* Writes a byte to a port */
 #define outb(data, port)                \
 do {                                    \
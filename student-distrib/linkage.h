@@ -17,5 +17,8 @@ extern void rtc_linkage();
 
 extern void pit_linkage();
 
+/* Linkage for the page fault handler, which may return to retry the access */
+extern void pf_linkage();
+
 #endif
 #endif /* _LINKAGE_H */
@@ -0,0 +1,214 @@
+/* memstat.c - The meminfo special file, a text snapshot of where physical
+ * memory goes: the kernel heap, the user frame pool, the swap store, the
+ * image cache, the file system image and the resident pages of every process
+ * vim:ts=4 noexpandtab
+ */
+
+#include "memstat.h"
+#include "lib.h"
+#include "paging.h"
+#include "slab.h"
+#include "heap.h"
+#include "image_cache.h"
+#include "zswap.h"
+#include "scheduling.h"
+#include "poll.h"
+#include "keyboard.h"
+
+#define KB(pages)   ((pages) * (PAGE_4K_SIZE / 1024))
+
+static int32_t meminfo_open(const uint8_t* filename);
+
+file_ops_t meminfo_fops = {meminfo_open, meminfo_read, write_fail, meminfo_close, poll_always};
+
+/*
+ * put_str()
+ *   DESCRIPTION: Appends a string to the snapshot, dropping what does not fit
+ *   INPUTS: text -- the snapshot
+ *           pos -- bytes already in it
+ *           s -- the string
+ *   OUTPUTS: none
+ *   RETURN VALUE: the new length
+ *   SIDE EFFECTS: none
+ */
+static uint32_t put_str(int8_t* text, uint32_t pos, const int8_t* s) {
+    while (*s != '\0' && pos < MEMINFO_SIZE) {
+        text[pos++] = *s++;
+    }
+    return pos;
+}
+
+/*
+ * put_num()
+ *   DESCRIPTION: Appends a decimal number and a separator to the snapshot
+ *   INPUTS: text -- the snapshot
+ *           pos -- bytes already in it
+ *           value -- the number
+ *           sep -- what follows it
+ *   OUTPUTS: none
+ *   RETURN VALUE: the new length
+ *   SIDE EFFECTS: none
+ */
+static uint32_t put_num(int8_t* text, uint32_t pos, uint32_t value, const int8_t* sep) {
+    int8_t num[16];
+    pos = put_str(text, pos, itoa(value, num, 10));
+    return put_str(text, pos, sep);
+}
+
+/*
+ * put_field()
+ *   DESCRIPTION: Appends a "name: value" line, the value in KB
+ *   INPUTS: text -- the snapshot
+ *           pos -- bytes already in it
+ *           name -- the field
+ *           kb -- its value
+ *   OUTPUTS: none
+ *   RETURN VALUE: the new length
+ *   SIDE EFFECTS: none
+ */
+static uint32_t put_field(int8_t* text, uint32_t pos, const int8_t* name, uint32_t kb) {
+    pos = put_str(text, pos, name);
+    pos = put_str(text, pos, (const int8_t*)": ");
+    return put_num(text, pos, kb, (const int8_t*)" kB\n");
+}
+
+/*
+ * meminfo_format()
+ *   DESCRIPTION: Writes the statistics out as text. The totals come first, one
+ *                field per line; a table of the resident pages of every
+ *                process follows, one line per thread group.
+ *   INPUTS: text -- MEMINFO_SIZE bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: length of the text
+ *   SIDE EFFECTS: none
+ */
+static uint32_t meminfo_format(int8_t* text) {
+    uint32_t pos = 0, flags, slots = 0;
+    int32_t pid;
+    kmem_totals_t kmem;
+    zswap_stats_t swap;
+    pcb_t* process;
+
+    kmem_get_totals(&kmem);
+    pos = put_field(text, pos, (const int8_t*)"KernelHeapTotal", KB(KHEAP_FRAMES));
+    pos = put_field(text, pos, (const int8_t*)"KernelHeapFree", KB(kmem.free_pages));
+    pos = put_field(text, pos, (const int8_t*)"KernelSlab", KB(kmem.cache_pages));
+    pos = put_field(text, pos, (const int8_t*)"KernelPages", KB(kmem.raw_pages));
+    pos = put_field(text, pos, (const int8_t*)"KernelObjects", kmem.object_bytes / 1024);
+    pos = put_field(text, pos, (const int8_t*)"UserPoolTotal", KB(HEAP_POOL_FRAMES));
+    pos = put_field(text, pos, (const int8_t*)"UserPoolFree", KB(pool_free_frames()));
+    pos = put_field(text, pos, (const int8_t*)"UserPoolCommitted", KB(pool_committed_frames()));
+    zswap_get_stats(&swap);
+    pos = put_field(text, pos, (const int8_t*)"SwapTotal", ZSWAP_SIZE / 1024);
+    pos = put_field(text, pos, (const int8_t*)"SwapStored", KB(swap.stored_pages));
+    pos = put_field(text, pos, (const int8_t*)"SwapCompressed", swap.stored_bytes / 1024);
+    pos = put_field(text, pos, (const int8_t*)"ImageCacheTotal", IMAGE_CACHE_SIZE / 1024);
+    pos = put_field(text, pos, (const int8_t*)"ImageCacheUsed", image_cache_used() / 1024);
+    pos = put_field(text, pos, (const int8_t*)"FileSystem",
+                    (1 + boot_block->inodes_N + boot_block->data_block_D) * FILE_BLOCK_SIZE / 1024);
+
+    pos = put_str(text, pos, (const int8_t*)"pid name image anon heap shared swap (kB)\n");
+    cli_and_save(flags);
+    for (pid = 0; pid < NUM_PROCESS; pid++) {
+        process = (pcb_t*)get_pcb_from_pid(pid);
+        if (process->active == 0 || process->kthread != 0) {
+            continue;
+        }
+        slots++;
+        /* threads share the leader's pages, so they get no line of their own */
+        if (process->group_pid != pid || process->state == PROC_ZOMBIE) {
+            continue;
+        }
+        pos = put_num(text, pos, pid, (const int8_t*)" ");
+        pos = put_str(text, pos, process->name);
+        pos = put_str(text, pos, (const int8_t*)" ");
+        pos = put_num(text, pos, KB(process->rss_image), (const int8_t*)" ");
+        pos = put_num(text, pos, KB(process->rss_anon), (const int8_t*)" ");
+        pos = put_num(text, pos, KB(process->rss_heap), (const int8_t*)" ");
+        pos = put_num(text, pos, KB(process->rss_shared), (const int8_t*)" ");
+        pos = put_num(text, pos, KB(process->rss_swap), (const int8_t*)"\n");
+    }
+    restore_flags(flags);
+    pos = put_num(text, pos, slots, (const int8_t*)" of ");
+    pos = put_num(text, pos, NUM_PROCESS, (const int8_t*)" process slots in use\n");
+    return pos;
+}
+
+/*
+ * is_meminfo()
+ *   DESCRIPTION: Checks whether sys_open was given meminfo's name
+ *   INPUTS: filename -- the name to open
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if it names meminfo, 0 otherwise
+ *   SIDE EFFECTS: none
+ */
+int32_t is_meminfo(const uint8_t* filename) {
+    return strncmp((const int8_t*)filename, (const int8_t*)MEMINFO_NAME, MAX_SIZE_FNAME + 1) == 0;
+}
+
+/*
+ * meminfo_open()
+ *   DESCRIPTION: Nothing to set up, the snapshot is taken on the first read
+ *   INPUTS: filename -- unused
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0
+ *   SIDE EFFECTS: none
+ */
+static int32_t meminfo_open(const uint8_t* filename) {
+    return 0;
+}
+
+/*
+ * meminfo_read()
+ *   DESCRIPTION: Copies the next part of the snapshot. The first read takes
+ *                it, so a reader sees one consistent set of numbers however
+ *                small its reads are; reopen the file for fresh ones.
+ *   INPUTS: fd -- the descriptor
+ *           buf -- where to copy
+ *           nbytes -- bytes wanted
+ *   OUTPUTS: none
+ *   RETURN VALUE: bytes copied, 0 at the end, -1 if the heap has no room
+ *   SIDE EFFECTS: keeps the snapshot in the descriptor's inode field
+ */
+int32_t meminfo_read(uint32_t fd, void* buf, uint32_t nbytes) {
+    file_descriptor_t* file = &((pcb_t*)get_pcb_from_pid(get_cur_pid()))->fd_table[fd];
+    int8_t* text = (int8_t*)file->inode;
+    uint32_t length;
+    if (buf == NULL) {
+        return -1;
+    }
+    if (text == NULL) {
+        text = (int8_t*)kmalloc(MEMINFO_SIZE + sizeof(uint32_t));
+        if (text == NULL) {
+            return -1;
+        }
+        /* the length goes in front of the text */
+        *(uint32_t*)text = meminfo_format(text + sizeof(uint32_t));
+        file->inode = (uint32_t)text;
+    }
+    length = *(uint32_t*)text;
+    if (file->file_position >= length) {
+        return 0;
+    }
+    if (nbytes > length - file->file_position) {
+        nbytes = length - file->file_position;
+    }
+    memcpy(buf, (const void*)(text + sizeof(uint32_t) + file->file_position), nbytes);
+    file->file_position += nbytes;
+    return nbytes;
+}
+
+/*
+ * meminfo_close()
+ *   DESCRIPTION: Frees the snapshot, if one was taken
+ *   INPUTS: fd -- the descriptor
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0
+ *   SIDE EFFECTS: none
+ */
+int32_t meminfo_close(uint32_t fd) {
+    file_descriptor_t* file = &((pcb_t*)get_pcb_from_pid(get_cur_pid()))->fd_table[fd];
+    kfree((void*)file->inode);
+    file->inode = 0;
+    return 0;
+}
@@ -0,0 +1,26 @@
+/* memstat.h - Defines for the meminfo special file
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _MEMSTAT_H
+#define _MEMSTAT_H
+
+#include "types.h"
+#include "syscalls.h"
+
+#define MEMINFO_NAME    "meminfo"   /* opened by name, it has no directory entry */
+#define MEMINFO_SIZE    2048        /* bytes of text a snapshot may take */
+
+/* File operations for meminfo */
+extern file_ops_t meminfo_fops;
+
+/* Checks a file name against meminfo's */
+int32_t is_meminfo(const uint8_t* filename);
+
+/* Reads the memory statistics as text, taken when the first byte is read */
+int32_t meminfo_read(uint32_t fd, void* buf, uint32_t nbytes);
+
+/* Frees the snapshot */
+int32_t meminfo_close(uint32_t fd);
+
+#endif /* _MEMSTAT_H */
@@ -4,6 +4,110 @@
 
 #include "paging.h"
 #include "lib.h"
+#include "image_cache.h"
+#include "shm.h"
+#include "ipc.h"
+#include "slab.h"
+#include "heap.h"
+#include "scheduling.h"
+#include "zswap.h"
+#include "clock.h"
+
+/* Local variables */
+static uint32_t tlb_pending[TLB_FLUSH_THRESHOLD];   /* pages recorded since the last commit */
+static uint32_t tlb_num_pending = 0;
+static uint32_t tlb_overflow = 0;   /* 1 if more pages changed than tlb_pending holds */
+static tlb_stats_t tlb_stats;       /* flush counters, by system call */
+
+/* 
+ * current_syscall
+ *   DESCRIPTION: Returns the system call the running process is in, which
+ *                picks the row of the flush counters
+ *   INPUTS: None
+ *   OUTPUTS: None
+ *   RETURN VALUE: the system call number, 0 outside a system call
+ *   SIDE EFFECTS: None
+ */
+static uint32_t current_syscall(){
+    int32_t pid = get_cur_pid();
+    if (pid == -1) {
+        return 0;
+    }
+    return ((pcb_t*)get_pcb_from_pid(pid))->syscall;
+}
+
+/* 
+ * current_user_table
+ *   DESCRIPTION: Finds the program page table of the loaded directory, which
+ *                also names the process that owns the pages; threads run in
+ *                their leader's directory
+ *   INPUTS: uint32_t* pid -- filled in with the owner
+ *   OUTPUTS: None
+ *   RETURN VALUE: the page table, or NULL if the directory has no program mapped
+ *   SIDE EFFECTS: None
+ */
+static p_table_entry_4k_p* current_user_table(uint32_t* pid){
+    union directory_entry* directory;
+    p_table_entry_4k_p* table;
+    asm volatile ("movl %%cr3, %0" : "=r" (directory));
+    if (directory[VIRTUAL_USER_PROG >> 22]._4k_pt.present == 0) {
+        return NULL;
+    }
+    table = (p_table_entry_4k_p*)(directory[VIRTUAL_USER_PROG >> 22]._4k_pt.pt_base_address << 12);
+    *pid = (table - user_page_tables[0]) / P_TABLE_SIZE;
+    if (table < user_page_tables[0] || *pid >= NUM_USER_TABLES) {
+        return NULL;
+    }
+    return table;
+}
+
+/* 
+ * loaded_group
+ *   DESCRIPTION: Returns the process whose program and heap pages the loaded
+ *                directory maps, the leader when a thread is running
+ *   INPUTS: None
+ *   OUTPUTS: None
+ *   RETURN VALUE: the pid, or -1 if no program is mapped
+ *   SIDE EFFECTS: None
+ */
+int32_t loaded_group(){
+    uint32_t pid;
+    if (current_user_table(&pid) == NULL) {
+        return -1;
+    }
+    return pid;
+}
+
+/* 
+ * user_range_check
+ *   DESCRIPTION: Checks that size bytes from addr are memory a system call may
+ *                read or write for the calling process: its program page, or
+ *                its thread group's heap below the break. Heap and bss pages
+ *                not touched yet fault in as they would for the program. The
+ *                IPC window is left out, its pages can be sent away while the
+ *                call runs.
+ *   INPUTS: const void* addr -- start of the range
+ *           uint32_t size -- bytes in it
+ *   OUTPUTS: None
+ *   RETURN VALUE: 0 if the whole range is usable, -1 otherwise
+ *   SIDE EFFECTS: None
+ */
+int32_t user_range_check(const void* addr, uint32_t size){
+    uint32_t start = (uint32_t)addr;
+    int32_t pid = get_cur_pid();
+    pcb_t* leader;
+    if (pid == -1) {
+        return -1;
+    }
+    leader = (pcb_t*)get_pcb_from_pid(((pcb_t*)get_pcb_from_pid(pid))->group_pid);
+    if (start >= VIRTUAL_USER_PROG && start < USER_PAGE_END && size <= USER_PAGE_END - start) {
+        return 0;
+    }
+    if (start >= HEAP_START && start < leader->brk && size <= leader->brk - start) {
+        return 0;
+    }
+    return -1;
+}
 
 /* 
  * page_init
@@ -76,7 +180,7 @@ void page_init(){
     page_table[video_start_idx].accessed  = 0;
     page_table[video_start_idx].dirty = 0;
     page_table[video_start_idx].page_table_attribute_index = 0;
-    page_table[video_start_idx].global_page = 0;
+    page_table[video_start_idx].global_page = 1;       // same in every address space
     page_table[video_start_idx].avail = 0;
     
     /* Starting index of Video Memory*/
@@ -89,7 +193,7 @@ void page_init(){
     page_table[video_start_idx].accessed  = 0;
     page_table[video_start_idx].dirty = 0;
     page_table[video_start_idx].page_table_attribute_index = 0;
-    page_table[video_start_idx].global_page = 0;
+    page_table[video_start_idx].global_page = 1;       // same in every address space
     page_table[video_start_idx].avail = 0;
 
     /* Starting index of Video Memory*/
@@ -102,7 +206,7 @@ void page_init(){
     page_table[video_start_idx].accessed  = 0;
     page_table[video_start_idx].dirty = 0;
     page_table[video_start_idx].page_table_attribute_index = 0;
-    page_table[video_start_idx].global_page = 0;
+    page_table[video_start_idx].global_page = 1;       // same in every address space
     page_table[video_start_idx].avail = 0;
 
     /* Starting index of Video Memory*/
@@ -115,7 +219,7 @@ void page_init(){
     page_table[video_start_idx].accessed  = 0;
     page_table[video_start_idx].dirty = 0;
     page_table[video_start_idx].page_table_attribute_index = 0;
-    page_table[video_start_idx].global_page = 0;
+    page_table[video_start_idx].global_page = 1;       // same in every address space
     page_table[video_start_idx].avail = 0;
 
     /* Attach Page Table to the first index in the Page Directory*/
@@ -132,6 +236,13 @@ void page_init(){
     page_directory[new_video_directory_idx]._4k_pt.present = 1;           // set present bit 
     page_directory[new_video_directory_idx]._4k_pt.read_write = 1;    
 
+    /* The clock page follows it, read-only and the same in every address space */
+    int clock_idx = ((uint32_t)USER_CLOCK_PAGE >> 12) & TEN_LSB_MASK;
+    page_table_new[clock_idx].present = 1;              // set present bit
+    page_table_new[clock_idx].user_supervisor = 1;      // user privilege level, read_write stays 0
+    page_table_new[clock_idx].global_page = 1;
+    page_table_new[clock_idx].page_base_address = (uint32_t)&clock_page >> 12;
+
     /* Attach 4MB Kernel Page to the second index in the Page Directory */
     int _4m_directory_index = (uint32_t)(KERNEL_MEM_START >> 22);       // examine 10 MSBs within virtual adress to find its index within page directory 
     page_directory[_4m_directory_index]._4m_p.present = 1;              // set present bit
@@ -141,6 +252,58 @@ void page_init(){
     page_directory[_4m_directory_index]._4m_p.page_base_address = (uint32_t)(KERNEL_MEM_START >> 22);       // since virtual memory maps to the same memory in physcical memory
                                                                                                             //  grab the 10 MSB of the Kernel's virtual memory to set as page's base address
 
+    /* Attach 4MB page for the executable image cache, kernel only and mapped 1:1 */
+    int _4m_cache_index = (uint32_t)(IMAGE_CACHE_START >> 22);
+    page_directory[_4m_cache_index]._4m_p.present = 1;             // set present bit
+    page_directory[_4m_cache_index]._4m_p.read_write = 1;          // set read_write bit
+    page_directory[_4m_cache_index]._4m_p.page_size = 1;           // set page_size bit
+    page_directory[_4m_cache_index]._4m_p.global_page = 1;         // set global page bit
+    page_directory[_4m_cache_index]._4m_p.page_base_address = (uint32_t)(IMAGE_CACHE_START >> 22);
+
+    /* Attach the 4MB shared memory segments, kernel only and mapped 1:1 so they can be zeroed */
+    for (i = 0; i < NUM_SHM_SEGMENTS; i++) {
+        int _4m_shm_index = (uint32_t)((SHM_START + i * SHM_SEGMENT_SIZE) >> 22);
+        page_directory[_4m_shm_index]._4m_p.present = 1;           // set present bit
+        page_directory[_4m_shm_index]._4m_p.read_write = 1;        // set read_write bit
+        page_directory[_4m_shm_index]._4m_p.page_size = 1;         // set page_size bit
+        page_directory[_4m_shm_index]._4m_p.global_page = 1;       // set global page bit
+        page_directory[_4m_shm_index]._4m_p.page_base_address = (uint32_t)((SHM_START + i * SHM_SEGMENT_SIZE) >> 22);
+    }
+
+    /* Attach the 4MB pool of IPC payload frames, kernel only and mapped 1:1 */
+    int _4m_ipc_index = (uint32_t)(IPC_POOL_START >> 22);
+    page_directory[_4m_ipc_index]._4m_p.present = 1;           // set present bit
+    page_directory[_4m_ipc_index]._4m_p.read_write = 1;        // set read_write bit
+    page_directory[_4m_ipc_index]._4m_p.page_size = 1;         // set page_size bit
+    page_directory[_4m_ipc_index]._4m_p.global_page = 1;       // set global page bit
+    page_directory[_4m_ipc_index]._4m_p.page_base_address = (uint32_t)(IPC_POOL_START >> 22);
+
+    /* Kernel heap for page_alloc and the slab caches, 1:1 like the kernel */
+    int _4m_heap_index = (uint32_t)(KHEAP_START >> 22);
+    page_directory[_4m_heap_index]._4m_p.present = 1;           // set present bit
+    page_directory[_4m_heap_index]._4m_p.read_write = 1;        // set read_write bit
+    page_directory[_4m_heap_index]._4m_p.page_size = 1;         // set page_size bit
+    page_directory[_4m_heap_index]._4m_p.global_page = 1;       // set global page bit
+    page_directory[_4m_heap_index]._4m_p.page_base_address = (uint32_t)(KHEAP_START >> 22);
+
+    /* Frames behind the user heaps, kernel only and mapped 1:1 so faults can zero them */
+    for (i = 0; i < HEAP_POOL_SIZE / SIZE_4MB; i++) {
+        int _4m_pool_index = (uint32_t)((HEAP_POOL_START + i * SIZE_4MB) >> 22);
+        page_directory[_4m_pool_index]._4m_p.present = 1;           // set present bit
+        page_directory[_4m_pool_index]._4m_p.read_write = 1;        // set read_write bit
+        page_directory[_4m_pool_index]._4m_p.page_size = 1;         // set page_size bit
+        page_directory[_4m_pool_index]._4m_p.global_page = 1;       // set global page bit
+        page_directory[_4m_pool_index]._4m_p.page_base_address = (uint32_t)((HEAP_POOL_START + i * SIZE_4MB) >> 22);
+    }
+
+    /* Compressed swap store, kernel only */
+    int _4m_zswap_index = (uint32_t)(ZSWAP_START >> 22);
+    page_directory[_4m_zswap_index]._4m_p.present = 1;          // set present bit
+    page_directory[_4m_zswap_index]._4m_p.read_write = 1;       // set read_write bit
+    page_directory[_4m_zswap_index]._4m_p.page_size = 1;        // set page_size bit
+    page_directory[_4m_zswap_index]._4m_p.global_page = 1;      // set global page bit
+    page_directory[_4m_zswap_index]._4m_p.page_base_address = (uint32_t)(ZSWAP_START >> 22);
+
     /* Set the Control Registers */
     set_control_registers((unsigned int*)page_directory);
     return;
@@ -149,31 +312,382 @@ void page_init(){
 
 /* 
  * load_user_program
- *   DESCRIPTION: Map virtual memory for the user program, which begins at 128
- *                MB in virtual memory, to physical memory. Frame location within 
- *                physical memory is dependent on the process number argument. 
+ *   DESCRIPTION: Builds the page directory of a new process and switches to it.
+ *                The directory starts as a copy of the kernel's, whose entries are
+ *                global, then points the user program region, which begins at
+ *                128 MB in virtual memory, at the process' own page table of 4KB
+ *                pages. Every page starts out unmapped: map_user_image maps the
+ *                image, user_reserve sets up the demand-zero bss and stack.
  *                 
  *   INPUTS: uint32_t process_number -- acts as an offset indicator of where to place page in physical mem
  *   OUTPUTS: None
  *   RETURN VALUE: None
- *   SIDE EFFECTS: Maps User Program to Physical Memory
+ *   SIDE EFFECTS: Maps User Program to Physical Memory, loads CR3
  */
 void load_user_program(uint32_t process_number){
-    uint32_t user_physical_mem;                                             // address in physical mem to map virtual user program 
-    user_physical_mem = PHYS_USER_PROG_STR + (process_number * SIZE_4MB);   // get starting address of 4 MB page in physcal mem
+    int i;
+    union directory_entry* directory = process_directories[process_number];
+    p_table_entry_4k_p* table = user_page_tables[process_number];
+    pcb_t* process = (pcb_t*)get_pcb_from_pid(process_number);
 
-    /* Attach 4MB User Page to the Page Directory */
+    /* Kernel mappings are the same in every directory */
+    memcpy((void*)directory, (const void*)page_directory, sizeof(page_directory));
+
+    /* Nothing in the program region is mapped until it is loaded or touched */
+    process->rss_image = 0;
+    process->rss_anon = 0;
+    process->rss_heap = 0;
+    process->rss_shared = 0;
+    process->rss_swap = 0;
+    for (i = 0; i < P_TABLE_SIZE; i++) {
+        table[i].present = 0;
+        table[i].read_write = 1;
+        table[i].user_supervisor = 1;
+        table[i].pwt = 0;
+        table[i].pcd = 1;
+        table[i].accessed = 0;      // set by the CPU, sys_resident counts these
+        table[i].dirty = 0;
+        table[i].page_table_attribute_index = 0;
+        table[i].global_page = 0;   // differs between processes, never global
+        table[i].avail = 0;
+        table[i].page_base_address = 0;
+    }
+
+    /* Attach the page table to the Page Directory */
     int _4m_user_index = (uint32_t)(VIRTUAL_USER_PROG >> 22);       // examine 10 MSBs within virtual adress to find its index within page directory 
-    page_directory[_4m_user_index]._4m_p.present = 1;              // set present bit
-    page_directory[_4m_user_index]._4m_p.user_supervisor = 1;
-    page_directory[_4m_user_index]._4m_p.read_write = 1;           // set read_write bit
-    page_directory[_4m_user_index]._4m_p.page_size = 1;            // set page_size bit
-    page_directory[_4m_user_index]._4m_p.global_page = 0;         // set global page bit
-    page_directory[_4m_user_index]._4m_p.pcd = 1;
-    page_directory[_4m_user_index]._4m_p.pwt = 0;
-    page_directory[_4m_user_index]._4m_p.page_base_address = (uint32_t)(user_physical_mem >> 22);    //  grab the 10 MSB of physical address to set plane
-                                                                                                    
+    directory[_4m_user_index]._4k_pt.present = 1;              // set present bit
+    directory[_4m_user_index]._4k_pt.user_supervisor = 1;
+    directory[_4m_user_index]._4k_pt.read_write = 1;           // set read_write bit, the page table entries decide
+    directory[_4m_user_index]._4k_pt.page_size = 0;            // points at a page table
+    directory[_4m_user_index]._4k_pt.pcd = 0;
+    directory[_4m_user_index]._4k_pt.pwt = 0;
+    directory[_4m_user_index]._4k_pt.pt_base_address = ((uint32_t)table >> 12);
+
+    /* The vidmap page is the process' own, the clock page next to it is the
+       same everywhere, so the table starts as a copy of the template */
+    p_table_entry_4k_p* vidmap_table = vidmap_page_tables[process_number];
+    memcpy((void*)vidmap_table, (const void*)page_table_new, sizeof(page_table_new));
+    vidmap_table[((uint32_t)USER_VIDMEM >> 12) & TEN_LSB_MASK].present = 0;    // unmapped until vidmap
+    directory[(uint32_t)USER_VIDMEM >> 22]._4k_pt.pt_base_address = ((uint32_t)vidmap_table >> 12);
+
+    /* Shared memory the process has attached, its IPC window and its heap */
+    shm_load(process_number);
+    ipc_load(process_number);
+    heap_load(process_number);
+
+    switch_directory(process_number);
+}
+
+/* 
+ * map_user_image
+ *   DESCRIPTION: Maps the pages the program image is loaded into, from the
+ *                process' 4MB frame, which is dependent on the process number
+ *   INPUTS: uint32_t process_number -- the process
+ *           uint32_t length -- size of the image at VIRT_USER_LOAD
+ *   OUTPUTS: None
+ *   RETURN VALUE: None
+ *   SIDE EFFECTS: the pages were not present, so nothing is invalidated
+ */
+void map_user_image(uint32_t process_number, uint32_t length){
+    uint32_t i;
+    uint32_t first = (VIRT_USER_LOAD >> 12) & TEN_LSB_MASK;
+    uint32_t npages = (length + PAGE_4K_SIZE - 1) / PAGE_4K_SIZE;
+    uint32_t user_physical_mem = PHYS_USER_PROG_STR + (process_number * SIZE_4MB);   // get starting address of 4 MB page in physcal mem
+    p_table_entry_4k_p* table = user_page_tables[process_number];
+    for (i = first; i < first + npages; i++) {
+        table[i].present = 1;
+        table[i].page_base_address = (user_physical_mem >> 12) + i;
+    }
+    ((pcb_t*)get_pcb_from_pid(process_number))->rss_image += npages;
+}
+
+/* 
+ * user_reserve
+ *   DESCRIPTION: Reserves the bss of a loaded program, the pages between the
+ *                end of its image and the end of its memory, and starts its
+ *                stack empty. Frames for the bss are committed now and
+ *                mapped when touched; the stack commits a page as it grows.
+ *   INPUTS: uint32_t process_number -- the process
+ *           uint32_t image_end -- address just past the image
+ *           uint32_t program_end -- address just past the bss
+ *   OUTPUTS: None
+ *   RETURN VALUE: 0 on success, -1 if the bss runs into the stack or the
+ *                 frame pool cannot back it
+ *   SIDE EFFECTS: None
+ */
+int32_t user_reserve(uint32_t process_number, uint32_t image_end, uint32_t program_end){
+    pcb_t* process = (pcb_t*)get_pcb_from_pid(process_number);
+    uint32_t bss_start = (image_end + PAGE_4K_SIZE - 1) & ~(PAGE_4K_SIZE - 1);
+    uint32_t bss_end = (program_end + PAGE_4K_SIZE - 1) & ~(PAGE_4K_SIZE - 1);
+    if (bss_end < bss_start) {
+        bss_end = bss_start;    /* all of it fits in the image's last page */
+    }
+    /* keep the lowest stack page and its guard page clear of the bss */
+    if (bss_end > USER_PAGE_END - USER_STACK_MAX - PAGE_4K_SIZE) {
+        return -1;
+    }
+    if (pool_commit((bss_end - bss_start) / PAGE_4K_SIZE) == -1) {
+        return -1;
+    }
+    process->bss_start = bss_start;
+    process->bss_end = bss_end;
+    process->stack_low = USER_PAGE_END;
+    return 0;
+}
+
+/* 
+ * user_stack_grow
+ *   DESCRIPTION: Maps zeroed stack pages from the current bottom of a
+ *                process' stack down to the page holding addr
+ *   INPUTS: uint32_t process_number -- the process
+ *           uint32_t addr -- the lowest stack address needed
+ *   OUTPUTS: None
+ *   RETURN VALUE: 0 on success, -1 past USER_STACK_MAX or if the pool is out of frames
+ *   SIDE EFFECTS: moves the guard page down
+ */
+int32_t user_stack_grow(uint32_t process_number, uint32_t addr){
+    uint32_t flags, index;
+    pcb_t* process = (pcb_t*)get_pcb_from_pid(process_number);
+    p_table_entry_4k_p* table = user_page_tables[process_number];
+    if (addr < USER_PAGE_END - USER_STACK_MAX || addr >= USER_PAGE_END) {
+        return -1;
+    }
+    cli_and_save(flags);
+    while (process->stack_low > (addr & ~(PAGE_4K_SIZE - 1))) {
+        if (pool_commit(1) == -1) {
+            restore_flags(flags);
+            return -1;
+        }
+        process->stack_low -= PAGE_4K_SIZE;
+        index = (process->stack_low >> 12) & TEN_LSB_MASK;
+        table[index].page_base_address = pool_take();
+        table[index].present = 1;
+        process->rss_anon++;
+        /* the entry was not present, so the TLB has nothing to drop */
+    }
+    restore_flags(flags);
+    return 0;
 }
+
+/* 
+ * user_demand_fault
+ *   DESCRIPTION: Resolves a fault on a program page that is reserved but not
+ *                mapped yet: a bss page gets a zeroed frame, and a touch of
+ *                the guard page below the stack grows the stack by a page.
+ *                Anything else in the program region is a real fault.
+ *   INPUTS: uint32_t addr -- the faulting address
+ *   OUTPUTS: None
+ *   RETURN VALUE: 0 if the page is mapped now, -1 if the fault is not ours
+ *   SIDE EFFECTS: takes a frame from the pool
+ */
+int32_t user_demand_fault(uint32_t addr){
+    uint32_t flags, pid, index;
+    pcb_t* process;
+    p_table_entry_4k_p* table = current_user_table(&pid);
+    if (table == NULL || addr < VIRTUAL_USER_PROG || addr >= USER_PAGE_END) {
+        return -1;
+    }
+    process = (pcb_t*)get_pcb_from_pid(pid);
+    if (addr >= process->bss_start && addr < process->bss_end) {
+        index = (addr >> 12) & TEN_LSB_MASK;
+        cli_and_save(flags);
+        if (table[index].present == 0 && (table[index].avail & PTE_SWAPPED) != 0) {
+            restore_flags(flags);
+            return -1;  /* zswap_fault could not bring it back */
+        }
+        if (table[index].present == 0) {
+            table[index].page_base_address = pool_take();   /* user_reserve committed it */
+            table[index].present = 1;
+            process->rss_anon++;
+        }
+        restore_flags(flags);
+        return 0;
+    }
+    /* only the guard page grows the stack, a wild access below it is a fault */
+    if (addr < process->stack_low && addr >= process->stack_low - PAGE_4K_SIZE) {
+        return user_stack_grow(pid, addr);
+    }
+    return -1;
+}
+
+/* 
+ * user_release
+ *   DESCRIPTION: Gives the bss and stack frames of a halting process back to
+ *                the pool along with their reservation
+ *   INPUTS: uint32_t process_number -- the process
+ *   OUTPUTS: None
+ *   RETURN VALUE: None
+ *   SIDE EFFECTS: the page directory is switched away from by the caller
+ */
+void user_release(uint32_t process_number){
+    uint32_t flags, addr, index;
+    pcb_t* process = (pcb_t*)get_pcb_from_pid(process_number);
+    p_table_entry_4k_p* table = user_page_tables[process_number];
+    cli_and_save(flags);
+    for (addr = process->bss_start; addr < process->bss_end; addr += PAGE_4K_SIZE) {
+        index = (addr >> 12) & TEN_LSB_MASK;
+        if (table[index].present == 1) {
+            table[index].present = 0;
+            pool_give(table[index].page_base_address);
+        }
+        else if ((table[index].avail & PTE_SWAPPED) != 0) {
+            zswap_drop(&table[index]);
+        }
+    }
+    for (addr = process->stack_low; addr < USER_PAGE_END; addr += PAGE_4K_SIZE) {
+        index = (addr >> 12) & TEN_LSB_MASK;
+        if (table[index].present == 1) {
+            table[index].present = 0;
+            pool_give(table[index].page_base_address);
+        }
+        else if ((table[index].avail & PTE_SWAPPED) != 0) {
+            zswap_drop(&table[index]);
+        }
+    }
+    pool_uncommit((process->bss_end - process->bss_start + USER_PAGE_END - process->stack_low) / PAGE_4K_SIZE);
+    process->bss_start = process->bss_end = 0;
+    process->stack_low = USER_PAGE_END;
+    process->rss_anon = 0;
+    process->rss_swap = 0;
+    restore_flags(flags);
+}
+
+/* 
+ * load_directory
+ *   DESCRIPTION: Switches to the page directory of a process. Kernel TLB entries
+ *                are global, so only the user ones are lost.
+ *   INPUTS: uint32_t process_number -- the process, or the leader of a thread group
+ *           uint32_t call -- row of the flush counters the reload is charged to
+ *   OUTPUTS: None
+ *   RETURN VALUE: None
+ *   SIDE EFFECTS: loads CR3
+ */
+static void load_directory(uint32_t process_number, uint32_t call){
+    uint32_t flags;
+    cli_and_save(flags);
+    load_page_directory(process_directories[process_number]);
+    tlb_stats.full[call]++;
+    /* the reload dropped every user entry, including the ones still pending */
+    tlb_num_pending = 0;
+    tlb_overflow = 0;
+    restore_flags(flags);
+}
+
+/* 
+ * switch_directory
+ *   DESCRIPTION: Switches to the page directory of a process on behalf of
+ *                the system call the running process is in, exec and halt
+ *   INPUTS: uint32_t process_number -- the process, or the leader of a thread group
+ *   OUTPUTS: None
+ *   RETURN VALUE: None
+ *   SIDE EFFECTS: loads CR3
+ */
+void switch_directory(uint32_t process_number){
+    load_directory(process_number, current_syscall());
+}
+
+/* 
+ * switch_directory_sched
+ *   DESCRIPTION: Switches to the page directory of the process the scheduler
+ *                picked. The running process is still the outgoing one, whose
+ *                system call did not cause the flush, so it goes in row 0.
+ *   INPUTS: uint32_t process_number -- the process, or the leader of a thread group
+ *   OUTPUTS: None
+ *   RETURN VALUE: None
+ *   SIDE EFFECTS: loads CR3
+ */
+void switch_directory_sched(uint32_t process_number){
+    load_directory(process_number, 0);
+}
+
+/* 
+ * tlb_invalidate
+ *   DESCRIPTION: Records a virtual page whose mapping was changed or removed.
+ *                Pages going from not present to present need no record, the
+ *                TLB never holds a not present entry.
+ *   INPUTS: uint32_t vaddr -- any address in the page
+ *   OUTPUTS: None
+ *   RETURN VALUE: None
+ *   SIDE EFFECTS: the page stays stale until tlb_commit
+ */
+void tlb_invalidate(uint32_t vaddr){
+    uint32_t flags;
+    cli_and_save(flags);
+    if (tlb_num_pending == TLB_FLUSH_THRESHOLD) {
+        tlb_overflow = 1;
+    } else {
+        tlb_pending[tlb_num_pending++] = vaddr;
+    }
+    restore_flags(flags);
+}
+
+/* 
+ * tlb_invalidate_range
+ *   DESCRIPTION: Records npages consecutive 4KB pages
+ *   INPUTS: uint32_t vaddr -- address of the first page
+ *           uint32_t npages -- number of pages
+ *   OUTPUTS: None
+ *   RETURN VALUE: None
+ *   SIDE EFFECTS: the pages stay stale until tlb_commit
+ */
+void tlb_invalidate_range(uint32_t vaddr, uint32_t npages){
+    uint32_t flags, i;
+    cli_and_save(flags);
+    if (npages > TLB_FLUSH_THRESHOLD) {
+        tlb_overflow = 1;
+    } else {
+        for (i = 0; i < npages; i++) {
+            tlb_invalidate(vaddr + i * PAGE_4K_SIZE);
+        }
+    }
+    restore_flags(flags);
+}
+
+/* 
+ * tlb_commit
+ *   DESCRIPTION: Invalidates the recorded pages one by one with invlpg. Past
+ *                TLB_FLUSH_THRESHOLD pages a CR3 reload is cheaper than the
+ *                invlpgs plus the refills, so the whole TLB goes instead.
+ *   INPUTS: None
+ *   OUTPUTS: None
+ *   RETURN VALUE: None
+ *   SIDE EFFECTS: clears the recorded pages
+ */
+void tlb_commit(){
+    uint32_t flags, i;
+    uint32_t call;
+    cli_and_save(flags);
+    call = current_syscall();
+    if (tlb_overflow == 1) {
+        flush_tlb();
+        tlb_stats.full[call]++;
+    } else {
+        for (i = 0; i < tlb_num_pending; i++) {
+            asm volatile ("invlpg (%0)" : : "r" (tlb_pending[i]) : "memory");
+        }
+        tlb_stats.invlpg[call] += tlb_num_pending;
+    }
+    tlb_num_pending = 0;
+    tlb_overflow = 0;
+    restore_flags(flags);
+}
+
+/* 
+ * sys_tlb_stats
+ *   DESCRIPTION: Copies the TLB flush counters to the caller
+ *   INPUTS: tlb_stats_t* stats -- where to put them
+ *   OUTPUTS: the counters
+ *   RETURN VALUE: 0 on success, -1 if stats is not user memory
+ *   SIDE EFFECTS: None
+ */
+int32_t sys_tlb_stats(tlb_stats_t* stats){
+    if (user_range_check(stats, sizeof(tlb_stats_t)) == -1) {
+        return -1;
+    }
+    memcpy((void*)stats, (const void*)&tlb_stats, sizeof(tlb_stats_t));
+    return 0;
+}
+
 /* 
  * unload_user_program
  *   DESCRIPTION: Unmap frame associated with current process from physical memory.
@@ -184,44 +698,144 @@ void load_user_program(uint32_t process_number){
  *   SIDE EFFECTS: Unmaps process from Physical Memory
  */
  void unload_user_program(uint32_t process_number){
-    uint32_t user_physical_mem;                                 // address in physical mem where to unmap virtual user program 
-    user_physical_mem = PHYS_USER_PROG_STR + (process_number * SIZE_4MB);  // get starting address of 4 MB page in physcal mem
-
     int _4m_user_index = (uint32_t)(VIRTUAL_USER_PROG >> 22);       // examine 10 MSBs within virtual adress to find its index within page directory 
-    page_directory[_4m_user_index]._4m_p.present = 0;              // set present bit to 0, unmap page
-    page_directory[_4m_user_index]._4m_p.page_base_address = (uint32_t)(user_physical_mem >> 22);       //  grab the 10 MSB of physical address to set plane
-                                                                                                           
+    process_directories[process_number][_4m_user_index]._4k_pt.present = 0;              // set present bit to 0, unmap the page table
  }
 
+/* 
+ * user_cow_fault
+ *   DESCRIPTION: Handles a write to a page of the program region that is still
+ *                mapped from a shared image snapshot: the page is pointed back
+ *                at the process' own frame and filled from the snapshot.
+ *                Writes from the kernel fault here too, CR0.WP is set.
+ *   INPUTS: uint32_t addr -- the faulting address
+ *   OUTPUTS: None
+ *   RETURN VALUE: 0 if the page was copied, -1 if the fault is not ours
+ *   SIDE EFFECTS: changes a page table entry and invalidates it
+ */
+int32_t user_cow_fault(uint32_t addr){
+    uint32_t flags, index, page, snapshot, pid;
+    p_table_entry_4k_p* table = current_user_table(&pid);
+    if (table == NULL || addr < VIRTUAL_USER_PROG || addr >= USER_PAGE_END) {
+        return -1;
+    }
+    index = (addr >> 12) & TEN_LSB_MASK;
+    page = addr & ~(PAGE_4K_SIZE - 1);
+
+    cli_and_save(flags);
+    if ((table[index].avail & PTE_COW) == 0) {
+        restore_flags(flags);
+        return -1;  /* a real protection fault */
+    }
+    snapshot = table[index].page_base_address << 12;    /* the cache is mapped 1:1 */
+    table[index].page_base_address = ((PHYS_USER_PROG_STR + (pid * SIZE_4MB)) >> 12) + index;
+    table[index].read_write = 1;
+    table[index].avail = 0;
+    ((pcb_t*)get_pcb_from_pid(pid))->rss_shared--;
+    ((pcb_t*)get_pcb_from_pid(pid))->rss_image++;
+    tlb_invalidate(page);
+    tlb_commit();
+    memcpy((void*)page, (const void*)snapshot, PAGE_4K_SIZE);
+    restore_flags(flags);
+    return 0;
+}
+
+/* 
+ * sys_resident
+ *   DESCRIPTION: Reports the resident pages of a process from the counters
+ *                the paging code keeps. Private pages are the ones in its own
+ *                frames or pool frames; shared pages are still mapped from an
+ *                image snapshot.
+ *   INPUTS: int32_t pid -- the process
+ *           resident_t* info -- where to put the counts
+ *   OUTPUTS: the counts, all zero with an empty name if pid is not running
+ *   RETURN VALUE: 0 on success, -1 on a bad pid or if info is not user memory
+ *   SIDE EFFECTS: None
+ */
+int32_t sys_resident(int32_t pid, resident_t* info){
+    pcb_t* process;
+    if (pid < 0 || pid >= NUM_PROCESS) {
+        return -1;
+    }
+    if (user_range_check(info, sizeof(resident_t)) == -1) {
+        return -1;
+    }
+    memset((void*)info, 0, sizeof(resident_t));
+    process = (pcb_t*)get_pcb_from_pid(pid);
+    /* threads share the leader's pages, report them once */
+    if (process->active == 0 || process->kthread != 0 || process->group_pid != pid || process->state == PROC_ZOMBIE) {
+        return 0;
+    }
+    strncpy(info->name, process->name, PROC_NAME_LEN - 1);
+    info->private_pages = process->rss_image + process->rss_anon + process->rss_heap;
+    info->shared_pages = process->rss_shared;
+    if (process->image != NULL) {
+        info->sharers = process->image->mappers;
+    }
+    return 0;
+}
+
 /* 
  * load_vidmem
- *   DESCRIPTION: Maps virtual memory for video memory to the physical memory for video memory,
- *                with user privilege level.
- *   INPUTS: uint8_t* screen_start -- virtual address of video memory
+ *   DESCRIPTION: Maps virtual memory for video memory to the screen of the
+ *                process' terminal, with user privilege level, in one
+ *                process' vidmap page table.
+ *   INPUTS: uint32_t process_number -- the process, or the leader of a thread group
+ *           uint32_t screen -- physical page of the screen, see term_video_page
  *   OUTPUTS: None
  *   RETURN VALUE: None
  *   SIDE EFFECTS: Maps virtual video memory to physical video memory
  */
- void load_vidmem (uint8_t* screen_start) {     
-    /* Initialize all pages within page table */
-    int video_start_idx = ((uint32_t)screen_start >> 12) & TEN_LSB_MASK;   // get index into page table
-    page_table_new[video_start_idx].present = 1;    // set present bit     
-    page_table_new[video_start_idx].read_write = 1;          
-    page_table_new[video_start_idx].user_supervisor = 1;    // user privilege level 
-    page_table_new[video_start_idx].page_base_address =(uint32_t)(VIDEO_MEM_START >> 12);   // physical address of video memory
+ void load_vidmem (uint32_t process_number, uint32_t screen) {     
+    p_table_entry_4k_p* table = vidmap_page_tables[process_number];
+    int video_start_idx = ((uint32_t)USER_VIDMEM >> 12) & TEN_LSB_MASK;   // get index into page table
+    table[video_start_idx].present = 1;    // set present bit     
+    table[video_start_idx].read_write = 1;          
+    table[video_start_idx].user_supervisor = 1;    // user privilege level 
+    table[video_start_idx].global_page = 0;        // differs between processes, never global
+    table[video_start_idx].page_base_address = screen >> 12;   // physical address of the screen
+ }
+
+/* 
+ * retarget_vidmem
+ *   DESCRIPTION: Points the vidmap page of every thread group on a terminal at
+ *                a new screen page, when the terminal is shown or hidden. Only
+ *                the loaded directory can have the old entry cached, the others
+ *                are non-global and dropped at their next CR3 load.
+ *   INPUTS: int term -- the terminal
+ *           uint32_t screen -- its screen page from now on
+ *   OUTPUTS: None
+ *   RETURN VALUE: None
+ *   SIDE EFFECTS: the caller commits the TLB invalidation
+ */
+ void retarget_vidmem (int term, uint32_t screen) {
+    int32_t pid;
+    int video_start_idx = ((uint32_t)USER_VIDMEM >> 12) & TEN_LSB_MASK;
+    for (pid = 0; pid < NUM_PROCESS; pid++) {
+        pcb_t* process = (pcb_t*)get_pcb_from_pid(pid);
+        if (process->active == 0 || process->kthread != 0 || process->group_pid != pid || process->term != term) {
+            continue;
+        }
+        if (vidmap_page_tables[pid][video_start_idx].present == 1) {
+            vidmap_page_tables[pid][video_start_idx].page_base_address = screen >> 12;
+        }
+    }
+    tlb_invalidate(USER_VIDMEM);
  }
 
 /* 
  * unload_vidmem
- *   DESCRIPTION: Unmaps virtual memory for video memory to the physical memory for video memory.
- *   INPUTS: None 
+ *   DESCRIPTION: Unmaps virtual memory for video memory from one process.
+ *                The caller commits the TLB invalidation.
+ *   INPUTS: uint32_t process_number -- the process, or the leader of a thread group
  *   OUTPUTS: None
  *   RETURN VALUE: None
  *   SIDE EFFECTS: Unmaps virtual video memory
  */
- void unload_vidmem(){
+ void unload_vidmem(uint32_t process_number){
     int video_start_idx = ((uint32_t)USER_VIDMEM >> 12) & TEN_LSB_MASK;  // get index into page table
-    page_table_new[video_start_idx].present = 0;    // set present bit to 0
+    vidmap_page_tables[process_number][video_start_idx].present = 0;    // set present bit to 0
+    tlb_invalidate(USER_VIDMEM);
  }
 
 /*
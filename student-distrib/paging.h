@@ -18,9 +18,31 @@
 #define TEN_LSB_MASK         0x3FF
 #define TERMINAL_START       0xB9000
 #define VIDMEM_SIZE          0x1000
+#define USER_CLOCK_PAGE      (USER_VIDMEM + VIDMEM_SIZE)    /* clock data, read-only for every process */
+#define TLB_FLUSH_THRESHOLD  32      /* pending pages past which one CR3 reload is cheaper */
+#define NUM_SYSCALL_SLOTS    35      /* rows of the TLB flush counters, one per syscall number */
+#define PTE_COW              0x1     /* avail bit: read-only page of a shared image, copied on write */
+#define PF_WRITE             0x2     /* page fault error code bit for a write access */
+#define PROC_NAME_LEN        33      /* file name (MAX_SIZE_FNAME) plus its null */
+#define USER_STACK_MAX       0x100000    /* the user stack grows down to 1MB below USER_PAGE_END */
 
 #include "x86_desc.h"
 
+/* Program pages of a process, see sys_resident */
+typedef struct resident {
+    int8_t name[PROC_NAME_LEN]; /* program name, empty if the PID is free */
+    uint32_t private_pages;     /* pages the process has touched and owns */
+    uint32_t shared_pages;      /* image pages mapped from a snapshot */
+    uint32_t sharers;           /* processes mapping that snapshot, this one included */
+} resident_t;
+
+/* TLB invalidations issued inside each system call, row 0 is outside any
+ * call and the scheduler's context switches */
+typedef struct tlb_stats {
+    uint32_t full[NUM_SYSCALL_SLOTS];   /* CR3 reloads */
+    uint32_t invlpg[NUM_SYSCALL_SLOTS]; /* single pages invalidated */
+} tlb_stats_t;
+
 /* A Page Directory Entry (4KB Page Table)*/
 typedef struct p_directory_entry_4k_pt {
         uint32_t present : 1;
@@ -74,32 +96,102 @@ typedef union directory_entry{
     p_directory_entry_4m_p    _4m_p;              // 4 MB page
 
 }directory_entry;
-/* The page directory (declared in x86_desc.S */
+/* The kernel's page directory, which each process directory starts as (declared in x86_desc.S */
 extern union directory_entry page_directory[P_DIREC_SIZE];
 
+/* Page directory of each process (declared in x86_desc.S) */
+extern union directory_entry process_directories[NUM_PAGE_DIRS][P_DIREC_SIZE];
+
 /* The page table (declared in x86_desc.S) */
 extern struct p_table_entry_4k_p page_table[P_TABLE_SIZE];
 
-/* Second page table, for user video memory page (declared in x86_desc.S) */
+/* Second page table, the template of each process' vidmap page table: it
+   holds the clock page and never the vidmap page (declared in x86_desc.S) */
 extern struct p_table_entry_4k_p page_table_new[P_TABLE_SIZE];
 
+/* Page tables for each process' vidmap and clock pages (declared in x86_desc.S) */
+extern struct p_table_entry_4k_p vidmap_page_tables[NUM_VIDMAP_TABLES][P_TABLE_SIZE];
+
+/* Page tables for each process' IPC window (declared in x86_desc.S) */
+extern struct p_table_entry_4k_p ipc_page_tables[NUM_IPC_TABLES][P_TABLE_SIZE];
+
+/* Page tables for each process' heap (declared in x86_desc.S) */
+extern struct p_table_entry_4k_p heap_page_tables[NUM_HEAP_TABLES][P_TABLE_SIZE];
+
+/* Page tables for each process' program region (declared in x86_desc.S) */
+extern struct p_table_entry_4k_p user_page_tables[NUM_USER_TABLES][P_TABLE_SIZE];
+
 /* Set Up Paging for Transferring Virtual Memory to Physical Memory */
 extern void page_init();
 
 /* Initialize the OS's respective control registers to allow Paging */
 extern void set_control_registers(unsigned int* page_dir);
 
-/* Set up Paging for User Program in Physical Memory */ 
+/* Builds a new process' page directory and switches to it */ 
 extern void load_user_program(uint32_t process_number);
 
+/* Switches to a process' page directory with a single CR3 load */
+extern void switch_directory(uint32_t process_number);
+
+/* Same, for the scheduler, the flush is counted as a context switch */
+extern void switch_directory_sched(uint32_t process_number);
+
+/* Loads CR3 */
+extern void load_page_directory(union directory_entry* page_dir);
+
+/* Records a virtual page whose mapping changed, to invalidate at the next commit */
+extern void tlb_invalidate(uint32_t vaddr);
+
+/* Records npages consecutive pages starting at vaddr */
+extern void tlb_invalidate_range(uint32_t vaddr, uint32_t npages);
+
+/* Invalidates the recorded pages with invlpg, or the whole TLB if there are many */
+extern void tlb_commit();
+
+/* Maps the pages a program image is loaded into */
+extern void map_user_image(uint32_t process_number, uint32_t length);
+
+/* Reserves the bss and the stack of a loaded program */
+extern int32_t user_reserve(uint32_t process_number, uint32_t image_end, uint32_t program_end);
+
+/* Maps stack pages down to an address */
+extern int32_t user_stack_grow(uint32_t process_number, uint32_t addr);
+
+/* Maps a zeroed bss or stack page on its first touch */
+extern int32_t user_demand_fault(uint32_t addr);
+
+/* Frees the bss and stack pages of a halting process */
+extern void user_release(uint32_t process_number);
+
+/* Gives the current process its own copy of a shared image page it wrote */
+extern int32_t user_cow_fault(uint32_t addr);
+
+/* Returns the process whose pages the loaded directory maps */
+extern int32_t loaded_group();
+
+/* Checks a user buffer handed to a system call, 0 if it is usable */
+extern int32_t user_range_check(const void* addr, uint32_t size);
+
+/* Reports the program pages of a process */
+extern int32_t sys_resident(int32_t pid, resident_t* info);
+
+/* Copies the TLB flush counters to user space */
+extern int32_t sys_tlb_stats(tlb_stats_t* stats);
+
+/* Turns CR4.PGE on or off */
+extern void set_global_pages(uint32_t enable);
+
 /* Unmap Current proccess from physical memory */
 extern void unload_user_program(uint32_t process_number);
 
-/* Map virtual video memory to physical video memory */
-extern void load_vidmem (uint8_t* screen_start);
+/* Map virtual video memory to a terminal's screen in a process' address space */
+extern void load_vidmem (uint32_t process_number, uint32_t screen);
+
+/* Moves the vidmap pages of a terminal's processes to a new screen page */
+extern void retarget_vidmem (int term, uint32_t screen);
 
-/* Unmap virtual video memory from physical video memory */
-extern void unload_vidmem();
+/* Unmap virtual video memory from a process' address space */
+extern void unload_vidmem(uint32_t process_number);
 
 /* Copies and saves video memory from one terminal's spot in memory to another */
 extern void copy_to_vidmem(unsigned int old_terminal, unsigned int new_terminal);
@@ -0,0 +1,239 @@
+/* pipe.c - Pipes between processes, each a page-sized ring buffer that
+ * readers and writers sleep on
+ * vim:ts=4 noexpandtab
+ */
+
+#include "pipe.h"
+#include "keyboard.h"
+#include "lib.h"
+#include "poll.h"
+#include "slab.h"
+
+/* Local variables */
+static kmem_cache_t* pipe_cache;    /* where pipe_t objects come from */
+
+file_ops_t pipe_read_fops = {open_fail, pipe_read, write_fail, pipe_close, pipe_poll_read};
+file_ops_t pipe_write_fops = {open_fail, read_fail, pipe_write, pipe_close, pipe_poll_write};
+
+/*
+ * get_pipe()
+ *   DESCRIPTION: Finds the pipe behind a descriptor of the current process
+ *   INPUTS: fd -- the descriptor
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to the pipe
+ *   SIDE EFFECTS: none
+ */
+static pipe_t* get_pipe(uint32_t fd) {
+    pcb_t* cur_pcb = (pcb_t*)get_pcb_from_pid(get_cur_pid());
+    return (pipe_t*)cur_pcb->fd_table[fd].inode;
+}
+
+/*
+ * pipe_init()
+ *   DESCRIPTION: Makes the slab cache for pipes
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call after kmem_init
+ */
+void pipe_init() {
+    pipe_cache = kmem_cache_create((const int8_t*)"pipe", sizeof(pipe_t));
+}
+
+/*
+ * pipe_create()
+ *   DESCRIPTION: Allocates a pipe and a page for its buffer
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the pipe on success, NULL if the kernel heap is full
+ *   SIDE EFFECTS: the pipe starts empty with one reader and one writer
+ */
+pipe_t* pipe_create() {
+    pipe_t* pipe = (pipe_t*)kmem_cache_alloc(pipe_cache);
+    if (pipe == NULL) {
+        return NULL;
+    }
+    pipe->buffer = (uint8_t*)kmalloc(PIPE_SIZE);
+    if (pipe->buffer == NULL) {
+        kmem_cache_free(pipe_cache, pipe);
+        return NULL;
+    }
+    pipe->head = 0;
+    pipe->count = 0;
+    pipe->readers = 1;
+    pipe->writers = 1;
+    pipe->read_wait.waiters = 0;
+    pipe->write_wait.waiters = 0;
+    return pipe;
+}
+
+/*
+ * pipe_dup()
+ *   DESCRIPTION: Counts a copy of a pipe end, so the pipe stays open until
+ *                every copy is closed
+ *   INPUTS: fd -- the copied descriptor
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void pipe_dup(file_descriptor_t* fd) {
+    if (fd->fotp.read == pipe_read) {
+        ((pipe_t*)fd->inode)->readers++;
+    }
+    else if (fd->fotp.write == pipe_write) {
+        ((pipe_t*)fd->inode)->writers++;
+    }
+}
+
+/*
+ * pipe_read()
+ *   DESCRIPTION: Copies bytes out of the pipe, sleeping while it is empty
+ *   INPUTS: fd -- read end of the pipe
+ *           buf -- where to copy to
+ *           nbytes -- the most bytes to read
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of bytes read, 0 once every writer has closed and
+ *                 the pipe is empty
+ *   SIDE EFFECTS: wakes writers waiting for room
+ */
+int32_t pipe_read(uint32_t fd, void* buf, uint32_t nbytes) {
+    uint32_t flags;
+    uint32_t n, first;
+    pipe_t* pipe = get_pipe(fd);
+    cli_and_save(flags);
+    while (pipe->count == 0) {
+        if (pipe->writers == 0) {
+            restore_flags(flags);
+            return 0;   /* end of file */
+        }
+        if (fd_nonblocking(fd)) {
+            restore_flags(flags);
+            return WOULD_BLOCK;
+        }
+        sleep_on(&pipe->read_wait);
+    }
+    n = (nbytes < pipe->count) ? nbytes : pipe->count;
+    /* the bytes may wrap around the end of the buffer */
+    first = (n < PIPE_SIZE - pipe->head) ? n : PIPE_SIZE - pipe->head;
+    memcpy(buf, (const void*)&pipe->buffer[pipe->head], first);
+    memcpy((uint8_t*)buf + first, (const void*)pipe->buffer, n - first);
+    pipe->head = (pipe->head + n) % PIPE_SIZE;
+    pipe->count -= n;
+    wake_up(&pipe->write_wait);
+    poll_notify();
+    restore_flags(flags);
+    return n;
+}
+
+/*
+ * pipe_write()
+ *   DESCRIPTION: Copies bytes into the pipe, sleeping whenever it is full
+ *   INPUTS: fd -- write end of the pipe
+ *           buf -- bytes to write
+ *           nbytes -- number of bytes to write
+ *   OUTPUTS: none
+ *   RETURN VALUE: nbytes, or -1 if every reader has closed
+ *   SIDE EFFECTS: wakes readers waiting for data
+ */
+int32_t pipe_write(uint32_t fd, const void* buf, uint32_t nbytes) {
+    uint32_t flags;
+    uint32_t done = 0, n, tail, first;
+    pipe_t* pipe = get_pipe(fd);
+    cli_and_save(flags);
+    while (done < nbytes) {
+        if (pipe->readers == 0) {
+            restore_flags(flags);
+            return -1;  /* nobody will ever read it */
+        }
+        if (pipe->count == PIPE_SIZE) {
+            if (fd_nonblocking(fd)) {
+                restore_flags(flags);
+                return (done != 0) ? (int32_t)done : WOULD_BLOCK;   /* short write */
+            }
+            sleep_on(&pipe->write_wait);
+            continue;
+        }
+        n = PIPE_SIZE - pipe->count;
+        if (n > nbytes - done) {
+            n = nbytes - done;
+        }
+        tail = (pipe->head + pipe->count) % PIPE_SIZE;
+        first = (n < PIPE_SIZE - tail) ? n : PIPE_SIZE - tail;
+        memcpy((void*)&pipe->buffer[tail], (const uint8_t*)buf + done, first);
+        memcpy((void*)pipe->buffer, (const uint8_t*)buf + done + first, n - first);
+        pipe->count += n;
+        done += n;
+        wake_up(&pipe->read_wait);
+        poll_notify();
+    }
+    restore_flags(flags);
+    return nbytes;
+}
+
+/*
+ * pipe_close()
+ *   DESCRIPTION: Drops one reference to a pipe end. Readers see end of file
+ *                once every write end is closed, writers fail once every
+ *                read end is closed.
+ *   INPUTS: fd -- the descriptor being closed
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0
+ *   SIDE EFFECTS: wakes the other side of the pipe, frees the pipe when both
+ *                 sides are closed
+ */
+int32_t pipe_close(uint32_t fd) {
+    uint32_t flags;
+    pcb_t* cur_pcb = (pcb_t*)get_pcb_from_pid(get_cur_pid());
+    pipe_t* pipe = (pipe_t*)cur_pcb->fd_table[fd].inode;
+    cli_and_save(flags);
+    if (cur_pcb->fd_table[fd].fotp.read == pipe_read) {
+        pipe->readers--;
+        wake_up(&pipe->write_wait);
+    }
+    else {
+        pipe->writers--;
+        wake_up(&pipe->read_wait);
+    }
+    /* nobody can reach the pipe once both sides are gone */
+    if (pipe->readers == 0 && pipe->writers == 0) {
+        kfree(pipe->buffer);
+        kmem_cache_free(pipe_cache, pipe);
+    }
+    poll_notify();
+    restore_flags(flags);
+    return 0;
+}
+
+/*
+ * pipe_poll_read()
+ *   DESCRIPTION: Readiness hook for the read end
+ *   INPUTS: fd -- read end of the pipe
+ *   OUTPUTS: none
+ *   RETURN VALUE: POLLIN if there are bytes, POLLIN | POLLHUP once every
+ *                 writer has closed, 0 otherwise
+ *   SIDE EFFECTS: none
+ */
+int32_t pipe_poll_read(uint32_t fd) {
+    pipe_t* pipe = get_pipe(fd);
+    if (pipe->writers == 0) {
+        return POLLIN | POLLHUP;    /* a read returns end of file right away */
+    }
+    return (pipe->count != 0) ? POLLIN : 0;
+}
+
+/*
+ * pipe_poll_write()
+ *   DESCRIPTION: Readiness hook for the write end
+ *   INPUTS: fd -- write end of the pipe
+ *   OUTPUTS: none
+ *   RETURN VALUE: POLLOUT if there is room, POLLOUT | POLLHUP once every
+ *                 reader has closed, 0 otherwise
+ *   SIDE EFFECTS: none
+ */
+int32_t pipe_poll_write(uint32_t fd) {
+    pipe_t* pipe = get_pipe(fd);
+    if (pipe->readers == 0) {
+        return POLLOUT | POLLHUP;   /* a write fails right away */
+    }
+    return (pipe->count != PIPE_SIZE) ? POLLOUT : 0;
+}
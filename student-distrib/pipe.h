@@ -0,0 +1,51 @@
+/* pipe.h - Defines for pipes between processes
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _PIPE_H
+#define _PIPE_H
+
+#include "types.h"
+#include "syscalls.h"
+#include "scheduling.h"
+
+#define PIPE_SIZE       4096    /* one page of buffered bytes per pipe */
+
+/* Struct for one pipe, a ring buffer with a reader and a writer side */
+typedef struct pipe {
+    uint8_t* buffer;    /* PIPE_SIZE bytes from the kernel heap */
+    uint32_t head;      /* index of the next byte to read */
+    uint32_t count;     /* number of bytes in the buffer */
+    uint32_t readers;   /* open read ends */
+    uint32_t writers;   /* open write ends */
+    wait_queue_t read_wait;     /* readers waiting for data */
+    wait_queue_t write_wait;    /* writers waiting for room */
+} pipe_t;
+
+/* Makes the slab cache pipes come from */
+void pipe_init();
+
+/* File operations for the two ends */
+extern file_ops_t pipe_read_fops;
+extern file_ops_t pipe_write_fops;
+
+/* Allocates a pipe with one reader and one writer */
+pipe_t* pipe_create();
+
+/* Counts another reference to a pipe end that was copied */
+void pipe_dup(file_descriptor_t* fd);
+
+/* Reads from the read end, blocks while the pipe is empty */
+int32_t pipe_read(uint32_t fd, void* buf, uint32_t nbytes);
+
+/* Writes to the write end, blocks while the pipe is full */
+int32_t pipe_write(uint32_t fd, const void* buf, uint32_t nbytes);
+
+/* Closes either end */
+int32_t pipe_close(uint32_t fd);
+
+/* Readiness hooks for poll */
+int32_t pipe_poll_read(uint32_t fd);
+int32_t pipe_poll_write(uint32_t fd);
+
+#endif /* _PIPE_H */
@@ -4,9 +4,77 @@
 #include "scheduling.h"
 #include "keyboard.h"
 #include "paging.h"
+#include "timer.h"
 
 /* Locat variables */
 int displayed = 0;
+volatile uint32_t pit_ticks = 0;   /* ticks since boot, counted in time even while the PIT sleeps */
+volatile uint32_t pit_irqs = 0;    /* timer interrupts actually taken */
+static uint32_t tickless = 1;      /* 1 to stop the periodic tick while idle */
+static uint32_t oneshot_ticks = 0; /* ticks the pending one-shot count covers, 0 if periodic */
+static uint32_t oneshot_count = 0; /* counts it was programmed with */
+
+/*
+ * pit_program()
+ *   DESCRIPTION: Sets the mode and starting count of channel 0
+ *   INPUTS: command -- PIT_PERIODIC or PIT_ONESHOT
+ *           count -- input clock counts to the interrupt
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: restarts the counter
+ */
+static void pit_program(uint8_t command, uint32_t count) {
+    outb(command, PIT_COMMAND);
+    outb((uint8_t)(count & 0xFF), PIT_CHANNEL0);   /* Set low byte of divisor */
+    outb((uint8_t)((count >> 8) & 0xFF), PIT_CHANNEL0);    /* Set high byte of divisor */
+}
+
+/*
+ * pit_read_count()
+ *   DESCRIPTION: Reads the counts left on channel 0
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the count
+ *   SIDE EFFECTS: call with interrupts disabled
+ */
+static uint32_t pit_read_count() {
+    uint32_t low;
+    outb(PIT_LATCH, PIT_COMMAND);
+    low = inb(PIT_CHANNEL0);
+    return low | (inb(PIT_CHANNEL0) << 8);
+}
+
+/*
+ * oneshot_catch_up()
+ *   DESCRIPTION: While a one-shot count runs, adds the tick boundaries it has
+ *                already passed to the tick count and reprograms it to end at
+ *                the next boundary instead
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the count was still running, 0 if it ran out and its
+ *                 interrupt is due
+ *   SIDE EFFECTS: call with interrupts disabled while oneshot_ticks is set
+ */
+static int32_t oneshot_catch_up() {
+    uint32_t left = pit_read_count(), passed;
+    if (left == 0 || left > oneshot_count) {
+        return 0;   /* the count ran out and wrapped */
+    }
+    /* boundaries fall where (oneshot_ticks - 1 - k) whole ticks are left */
+    passed = oneshot_ticks - 1 - left / PIT_TICK_COUNTS;
+    if (left % PIT_TICK_COUNTS == 0) {
+        passed++;
+        left = PIT_TICK_COUNTS;
+    }
+    else {
+        left %= PIT_TICK_COUNTS;
+    }
+    pit_ticks += passed;
+    oneshot_count = left;
+    oneshot_ticks = 1;
+    pit_program(PIT_ONESHOT, oneshot_count);
+    return 1;
+}
 
 /* 
  * pit_init()
@@ -14,48 +82,123 @@ int displayed = 0;
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: Initializes the PIT to a square wave generator with a frequency of 60 Hz
+ *   SIDE EFFECTS: Starts the periodic tick at PIT_HZ
  */
 void pit_init() {
     // Init function is mainly sourced from http://www.osdever.net/bkerndev/Docs/pit.htm 
     //                                  and https://wiki.osdev.org/Programmable_Interval_Timer
 
-    uint32_t Hz = 100; // wanted freq between 20 Hz and 100 Hz so 60 Hz works
-    uint32_t divisor = 1193180 / Hz;       /* Calculate our divisor */
-
-    // Disable interrupts
-    //cli();
-
-    // 0x43 is Mode/Command register (write only, a read is ignored)
-    // 0x36 is the resultant byte that we should set in the Command register
-    outb(0x36, 0x43);             /* Set our command byte 0x36 */
-
-    // 0x40 is Channel 0 data port (read/write)
-    outb((uint8_t) (divisor & 0xFF), 0x40);   /* Set low byte of divisor */
-    outb((uint8_t) ((divisor >> 8) & 0xFF), 0x40);     /* Set high byte of divisor, mask with 0xFF since we only want the low 8 bits */
+    // A rate generator rather than a square wave, its count can be read back
+    // to tell how far into the tick we are when the tick is stopped
+    pit_program(PIT_PERIODIC, PIT_TICK_COUNTS);
 
     // Enables IRQ slot 0 on the PIC
     enable_irq(0);
-
-    // Enable interrupts
-    //sti();
-
 }
 
 /* 
  * pit_handler()
- *   DESCRIPTION: handles which task to switch to based on the pit
+ *   DESCRIPTION: handles which task to switch to based on the pit. The
+ *                interrupt that ends an idle stretch accounts for every tick
+ *                in it and restarts the periodic tick.
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: switches the current task to the next task of the round robin
  */
 void pit_handler(){
-    // putc('a');
-    // update_term((displayed++) % 3);
     send_eoi(0);
+    pit_irqs++;
+    /* a periodic interrupt still pending when the one-shot was programmed
+       arrives early and is just one tick */
+    if (oneshot_ticks != 0 && oneshot_catch_up() == 0) {
+        pit_ticks += oneshot_ticks;
+        oneshot_ticks = 0;
+        pit_program(PIT_PERIODIC, PIT_TICK_COUNTS);
+    }
+    else {
+        pit_ticks++;
+    }
+    timer_tick(pit_ticks);
     switch_tasks();
+}
+
+/*
+ * pit_idle_enter()
+ *   DESCRIPTION: Called when nothing can run: replaces the periodic tick with
+ *                one interrupt at the tick boundary of the next timer, at
+ *                most PIT_MAX_IDLE_TICKS away
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call with interrupts disabled, right before hlt
+ */
+void pit_idle_enter() {
+    uint32_t ticks;
+    if (tickless == 0 || oneshot_ticks != 0) {
+        return;
+    }
+    ticks = timer_idle_ticks(PIT_MAX_IDLE_TICKS);
+    if (ticks <= 1) {
+        return;     /* the periodic tick is due first anyway */
+    }
+    /* the rest of the current tick, then whole ticks */
+    oneshot_count = (ticks - 1) * PIT_TICK_COUNTS + pit_read_count();
+    oneshot_ticks = ticks;
+    pit_program(PIT_ONESHOT, oneshot_count);
+}
+
+/*
+ * pit_idle_exit()
+ *   DESCRIPTION: Called when an idle stretch ends. If another interrupt ended
+ *                it, counts the tick boundaries already passed and programs a
+ *                one-shot for the rest of the current tick, whose interrupt
+ *                goes back to the periodic tick.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call with interrupts disabled, right after hlt
+ */
+void pit_idle_exit() {
+    if (oneshot_ticks != 0) {
+        oneshot_catch_up();
+    }
+}
 
+/*
+ * pit_set_tickless()
+ *   DESCRIPTION: Turns stopping the periodic tick while idle on or off
+ *   INPUTS: on -- 1 for a tickless idle, 0 for a tick every 1/PIT_HZ s
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void pit_set_tickless(uint32_t on) {
+    tickless = on;
+}
 
+/*
+ * get_pit_ticks()
+ *   DESCRIPTION: Returns the number of ticks since boot, which keeps time
+ *                across idle stretches the PIT slept through
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the tick count, which wraps after about 497 days
+ *   SIDE EFFECTS: none
+ */
+uint32_t get_pit_ticks() {
+    return pit_ticks;
 }
 
+/*
+ * get_pit_irqs()
+ *   DESCRIPTION: Returns the number of timer interrupts taken, fewer than
+ *                the ticks when the tick was stopped while idle
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the interrupt count
+ *   SIDE EFFECTS: none
+ */
+uint32_t get_pit_irqs() {
+    return pit_irqs;
+}
@@ -1,6 +1,31 @@
 #ifndef PIT_H
 #define PIT_H
 
+#include "types.h"
+
+#define PIT_HZ  100     /* timer interrupts per second */
+
+/* Ports and command bytes */
+#define PIT_CHANNEL0    0x40
+#define PIT_COMMAND     0x43
+#define PIT_PERIODIC    0x34    /* channel 0, low then high byte, mode 2 rate generator */
+#define PIT_ONESHOT     0x30    /* channel 0, low then high byte, mode 0 interrupt on terminal count */
+#define PIT_LATCH       0x00    /* latch channel 0's count for reading */
+
+/* Channel 2 is gated through port 0x61 and never interrupts, the clock
+   times the TSC against it at boot */
+#define PIT_CHANNEL2    0x42
+#define PIT_CH2_ONESHOT 0xB0    /* channel 2, low then high byte, mode 0 */
+#define PIT_GATE_PORT   0x61
+#define PIT_GATE2       0x01    /* channel 2 counts while set */
+#define PIT_SPEAKER     0x02    /* channel 2 drives the speaker while set */
+#define PIT_OUT2        0x20    /* channel 2's output, set once the count ran out */
+
+#define PIT_INPUT_HZ    1193182     /* frequency the counter runs at */
+#define PIT_TICK_COUNTS (PIT_INPUT_HZ / PIT_HZ)
+/* the counter is 16 bits, so an idle PIT still wakes every 5 ticks */
+#define PIT_MAX_IDLE_TICKS  (0xFFFF / PIT_TICK_COUNTS)
+
 // Function prototypes for the PIT
 
 /* Initializes the PIT controller */
@@ -9,4 +34,19 @@ void pit_init();
 /* Handler for the PIT*/
 void pit_handler();
 
+/* Returns the number of ticks since boot */
+uint32_t get_pit_ticks();
+
+/* Returns the number of timer interrupts actually taken */
+uint32_t get_pit_irqs();
+
+/* Stops the periodic tick until the next deadline, called before idling */
+void pit_idle_enter();
+
+/* Catches the tick count up after an idle stretch another interrupt ended */
+void pit_idle_exit();
+
+/* Turns stopping the tick while idle on or off */
+void pit_set_tickless(uint32_t on);
+
 #endif
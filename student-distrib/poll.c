@@ -0,0 +1,116 @@
+/* poll.c - Waiting on several file descriptors at once. Each file_ops_t has a
+ * readiness hook, and the drivers wake poll_wait whenever one may change.
+ * vim:ts=4 noexpandtab
+ */
+
+#include "poll.h"
+#include "syscalls.h"
+#include "paging.h"
+#include "pit.h"
+#include "timer.h"
+#include "lib.h"
+
+/* Local variables */
+wait_queue_t poll_wait;
+
+/*
+ * poll_always()
+ *   DESCRIPTION: Readiness hook for the screen, files and directories, which
+ *                never make a caller wait
+ *   INPUTS: fd -- the descriptor
+ *   OUTPUTS: none
+ *   RETURN VALUE: POLLIN | POLLOUT
+ *   SIDE EFFECTS: none
+ */
+int32_t poll_always(uint32_t fd) {
+    return POLLIN | POLLOUT;
+}
+
+/*
+ * poll_notify()
+ *   DESCRIPTION: Wakes every poller so it checks its descriptors again
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: safe to call from interrupt handlers
+ */
+void poll_notify() {
+    wake_up(&poll_wait);
+}
+
+/*
+ * check_fds()
+ *   DESCRIPTION: Fills in revents for every entry
+ *   INPUTS: fds -- the entries
+ *           nfds -- number of entries
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of entries with a nonzero revents
+ *   SIDE EFFECTS: none
+ */
+static int32_t check_fds(pollfd_t* fds, uint32_t nfds) {
+    uint32_t i;
+    int32_t ready = 0;
+    pcb_t* cur_pcb = (pcb_t*)get_pcb_from_pid(get_cur_pid());
+    file_descriptor_t* fd;
+    for (i = 0; i < nfds; i++) {
+        fds[i].revents = 0;
+        if (fds[i].fd < 0) {
+            continue;   /* ignored, like Linux */
+        }
+        if (fds[i].fd >= NUM_FILES) {
+            fds[i].revents = POLLERR;
+            ready++;
+            continue;
+        }
+        fd = &cur_pcb->fd_table[fds[i].fd];
+        if (fd->flags == 0) {
+            fds[i].revents = POLLERR;
+        }
+        else {
+            /* POLLERR and POLLHUP are reported even if not asked for */
+            fds[i].revents = fd->fotp.poll(fds[i].fd) & (fds[i].events | POLLERR | POLLHUP);
+        }
+        if (fds[i].revents != 0) {
+            ready++;
+        }
+    }
+    return ready;
+}
+
+/*
+ * sys_poll()
+ *   DESCRIPTION: Sleeps until one of the descriptors is ready or the timeout
+ *                runs out
+ *   INPUTS: fds -- descriptors to watch and events wanted for each
+ *           nfds -- number of entries in fds
+ *           timeout -- most ms to wait, 0 to just check, -1 to wait forever
+ *   OUTPUTS: revents of each entry
+ *   RETURN VALUE: number of ready entries, 0 on timeout, -1 on bad arguments
+ *   SIDE EFFECTS: uses no CPU while sleeping
+ */
+int32_t sys_poll(pollfd_t* fds, uint32_t nfds, int32_t timeout) {
+    uint32_t flags;
+    int32_t ready;
+    pcb_t* cur_pcb = (pcb_t*)get_pcb_from_pid(get_cur_pid());
+    if (nfds == 0 || nfds > MAX_POLL_FDS) {
+        return -1;
+    }
+    if (user_range_check(fds, nfds * sizeof(pollfd_t)) == -1) {
+        return -1;
+    }
+    cli_and_save(flags);
+    if (timeout > 0) {
+        /* the process' sleep timer wakes the pollers when the time is up */
+        timer_setup(&cur_pcb->sleep_timer, timer_wake, &poll_wait);
+        timer_add(&cur_pcb->sleep_timer, get_pit_ticks() + ms_to_ticks(timeout));
+    }
+    while ((ready = check_fds(fds, nfds)) == 0) {
+        if (timeout == 0 || (timeout > 0 && timer_pending(&cur_pcb->sleep_timer) == 0)) {
+            break;
+        }
+        sleep_on(&poll_wait);
+    }
+    timer_cancel(&cur_pcb->sleep_timer);
+    restore_flags(flags);
+    return ready;
+}
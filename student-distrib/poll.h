@@ -0,0 +1,38 @@
+/* poll.h - Defines for waiting on several file descriptors at once
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _POLL_H
+#define _POLL_H
+
+#include "types.h"
+#include "scheduling.h"
+
+/* Events, same bits as Linux */
+#define POLLIN      0x0001  /* a read will not block */
+#define POLLOUT     0x0004  /* a write will not block */
+#define POLLERR     0x0008  /* the descriptor is not open */
+#define POLLHUP     0x0010  /* the other end of a pipe is gone */
+
+#define MAX_POLL_FDS    8   /* one entry per file descriptor */
+
+/* One descriptor to watch, revents is filled in by poll */
+typedef struct pollfd {
+    int32_t fd;
+    int16_t events;     /* events the caller cares about */
+    int16_t revents;    /* events that are ready, plus POLLERR and POLLHUP */
+} pollfd_t;
+
+/* Pollers sleep here, anything that can make a descriptor ready wakes it */
+extern wait_queue_t poll_wait;
+
+/* Waits until one of the descriptors is ready or timeout ms have passed */
+int32_t sys_poll(pollfd_t* fds, uint32_t nfds, int32_t timeout);
+
+/* Wakes pollers so they check their descriptors again */
+void poll_notify();
+
+/* Readiness hook for descriptors that never block */
+int32_t poll_always(uint32_t fd);
+
+#endif /* _POLL_H */
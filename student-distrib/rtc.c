@@ -5,9 +5,31 @@
 #include "i8259.h"
 #include "rtc.h"
 #include "lib.h"
+#include "poll.h"
+#include "syscalls.h"
+#include "scheduling.h"
 
 /* Local variables */
-volatile int flag = 1;
+volatile uint32_t rtc_count = 1;    /* interrupts since boot, plus one so 0 means never read */
+static uint32_t boot_seen = 0;      /* rtc_count at the last read by a kernel test */
+static wait_queue_t rtc_queue;      /* readers waiting for the next interrupt */
+static uint32_t rtc_opens = 0;      /* open descriptors, the interrupt is masked while there are none */
+
+/*
+ * rtc_seen()
+ *   DESCRIPTION: Finds where a descriptor remembers the interrupt its last
+ *                read returned for, its otherwise unused file position
+ *   INPUTS: fd -- an RTC descriptor of the current process
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to the count
+ *   SIDE EFFECTS: none
+ */
+static uint32_t* rtc_seen(uint32_t fd) {
+    if (get_cur_pid() == -1 || fd >= NUM_FILES) {
+        return &boot_seen;  /* kernel tests call the driver directly */
+    }
+    return &((pcb_t*)get_pcb_from_pid(get_cur_pid()))->fd_table[fd].file_position;
+}
 
 /* 
  * rtc_init()
@@ -16,7 +38,7 @@ volatile int flag = 1;
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: Turns on and sets RTC registers
- *                 Enables IRQ 8 on PIC
+ *                 IRQ 8 stays masked on the PIC until the RTC is opened
  */
 void rtc_init() {
     uint8_t prev;
@@ -43,8 +65,8 @@ void rtc_init() {
     // buffer[0] = 2;
     // rtc_write(0, buffer, 4); /****TEST RTC_WRITE****/
 
-    /* Enables interrupts for the RTC */
-    enable_irq(RTC_IRQ);
+    /* Interrupts for the RTC are enabled by the first rtc_open, nothing
+       needs its 1024Hz ticks until then */
 
     // while(1){
     //     test_interrupts();
@@ -59,28 +81,60 @@ void rtc_init() {
  *   RETURN VALUE: none
  *   SIDE EFFECTS: Clears Status Register C on the Real-Time Clock
  *                 Sends End-of-Interrupt signal to IRQ 8 on PIC
+ *                 May switch to a woken reader
  */
 void rtc_handler() {
-    flag = 0;   /* Interrups has occurred, so set flag to 0 */
+    rtc_count++;    /* Interrupt has occurred, every reader may return */
+    wake_up(&rtc_queue);
+    poll_notify();  /* pollers waiting on the RTC can read now */
     outb(STATUS_REG_C, RTC_PORT);   /* Set register to status register c */
     inb(CMOS_PORT);     /* Clear status register c */
     // printf("...");   /* Make sure this function is being called */
     send_eoi(RTC_IRQ);      /* Send end-of-interrupt signal */
+    sched_preempt();    /* a woken reader may outrank whatever was running */
 }
 
 /* 
  * rtc_read()
- *   DESCRIPTION: Waits until an interrupt has occurred, then returns 0
- *   INPUTS: none
+ *   DESCRIPTION: Sleeps until an interrupt has occurred since this descriptor's
+ *                last read, then returns 0. Every descriptor sees every
+ *                interrupt, so readers do not take ticks from each other.
+ *   INPUTS: fd -- the RTC descriptor
  *   OUTPUTS: none
- *   RETURN VALUE: always returns 0
- *   SIDE EFFECTS: none
+ *   RETURN VALUE: 0, or WOULD_BLOCK for a non-blocking descriptor with no interrupt
+ *   SIDE EFFECTS: blocks the caller
  */
 int32_t rtc_read (uint32_t fd, void* buf, uint32_t nbytes) {
-    while(flag != 0);   /* Wait until an interrupt has occurred (and RTC is not updating) */
-    flag = 1;   /* Set flag back to 1 now that we have finished waiting */
-    // printf("o");
-    return 0;   /* Return 0 after escaping while loop */
+    uint32_t flags;
+    uint32_t* seen = rtc_seen(fd);
+    cli_and_save(flags);
+    if (*seen == rtc_count && fd_nonblocking(fd)) {
+        restore_flags(flags);
+        return WOULD_BLOCK; /* no interrupt since the last read */
+    }
+    while (*seen == rtc_count) {
+        if (get_cur_pid() == -1) {
+            asm volatile ("sti; hlt; cli" : : : "memory");  /* no PCB to sleep in */
+        }
+        else {
+            sleep_on(&rtc_queue);
+        }
+    }
+    *seen = rtc_count;
+    restore_flags(flags);
+    return 0;
+}
+
+/*
+ * rtc_poll()
+ *   DESCRIPTION: Readiness hook for the RTC
+ *   INPUTS: fd -- the RTC descriptor
+ *   OUTPUTS: none
+ *   RETURN VALUE: POLLIN if an interrupt came since the descriptor's last read, 0 otherwise
+ *   SIDE EFFECTS: none
+ */
+int32_t rtc_poll (uint32_t fd) {
+    return (*rtc_seen(fd) != rtc_count) ? POLLIN : 0;
 }
 
 /* 
@@ -135,7 +189,8 @@ int32_t rtc_write (uint32_t fd, const void* buf, uint32_t nbytes){
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: returns 0 on success
- *   SIDE EFFECTS: resets the RTC frequency to 2Hz
+ *   SIDE EFFECTS: resets the RTC frequency to 2Hz, unmasks IRQ 8 for
+ *                 the first open descriptor
  */
 int32_t rtc_open (const uint8_t* filename){
     /* Make sure the input filename is not NULL */
@@ -150,18 +205,31 @@ int32_t rtc_open (const uint8_t* filename){
     char prev = inb(CMOS_PORT);
     outb(STATUS_REG_A, RTC_PORT);
     outb((prev & 0xF0) | rate, CMOS_PORT);
+    if (rtc_opens++ == 0) {
+        /* drop an interrupt left pending while masked, or none would follow */
+        outb(STATUS_REG_C, RTC_PORT);
+        inb(CMOS_PORT);
+        enable_irq(RTC_IRQ);
+    }
     sti();  /* Enable interrupts */
     return 0;
 }
 
 /* 
  * rtc_close()
- *   DESCRIPTION: Does nothing
+ *   DESCRIPTION: Masks IRQ 8 once the last descriptor is closed, so an idle
+ *                system is not woken 1024 times a second
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: returns 0 on success
- *   SIDE EFFECTS: none
+ *   SIDE EFFECTS: may mask IRQ 8
  */
 int32_t rtc_close (uint32_t fd){
-    return 0;   /* Does nothing, just return 0 */
+    uint32_t flags;
+    cli_and_save(flags);
+    if (rtc_opens > 0 && --rtc_opens == 0) {
+        disable_irq(RTC_IRQ);
+    }
+    restore_flags(flags);
+    return 0;
 }
@@ -42,5 +42,7 @@ int32_t rtc_write (uint32_t fd, const void* buf, uint32_t nbytes);
 int32_t rtc_open (const uint8_t* filename);
 /* Closes File Descriptor */
 int32_t rtc_close (uint32_t fd);
+/* Checks whether a read would wait */
+int32_t rtc_poll (uint32_t fd);
 
 #endif  /* _RTC_H */
@@ -4,98 +4,546 @@
 #include "paging.h"
 #include "i8259.h"
 #include "lib.h"
+#include "pit.h"
 
 
 /* Local Variables */
 int cur_term = 0;
+static int32_t rq_head[NUM_PRIO_LEVELS][NUM_RUN_QUEUES];    /* first pid of each queue, -1 if empty */
+static int32_t rq_tail[NUM_PRIO_LEVELS][NUM_RUN_QUEUES];
+static int32_t rq_turn[NUM_PRIO_LEVELS];    /* queue the last pick at each level came from */
+static uint32_t boot_esp;                   /* where the boot context is left when it calls schedule */
+static uint32_t mlfq = 1;                   /* 0 to give every process the same level and a one tick slice */
+static uint32_t need_resched = 0;           /* 1 if a wakeup outranks the current process */
+static uint32_t last_boost = 0;             /* tick of the last reset of every level */
 
 /*
- * switch_tasks()
- *   DESCRIPTION: Switches process being run upon terminal switch
- *   INPUTS: none
+ * rq_index()
+ *   DESCRIPTION: Returns the run queue a process belongs on: one per
+ *                terminal, so every terminal gets its turn however many jobs
+ *                it runs, and one for kernel threads
+ *   INPUTS: pcb -- the process
+ *   OUTPUTS: none
+ *   RETURN VALUE: the queue
+ *   SIDE EFFECTS: none
+ */
+static int32_t rq_index(pcb_t* pcb) {
+    if (pcb->kthread != 0 || pcb->term < 0 || pcb->term >= NUM_TERMINALS) {
+        return NUM_TERMINALS;
+    }
+    return pcb->term;
+}
+
+/*
+ * rq_level()
+ *   DESCRIPTION: Returns the level a process is scheduled at: its feedback
+ *                level, raised by FG_PRIO_BOOST for the processes of the
+ *                displayed terminal so the one being typed at stays responsive
+ *   INPUTS: pcb -- the process
+ *   OUTPUTS: none
+ *   RETURN VALUE: the level, 0 is served first
+ *   SIDE EFFECTS: none
+ */
+static int32_t rq_level(pcb_t* pcb) {
+    if (mlfq == 0) {
+        return 0;
+    }
+    if (pcb->kthread == 0 && pcb->term == get_cur_term()) {
+        return (pcb->prio > FG_PRIO_BOOST) ? pcb->prio - FG_PRIO_BOOST : 0;
+    }
+    return pcb->prio;
+}
+
+/*
+ * rq_push()
+ *   DESCRIPTION: Appends a process to the tail of its run queue
+ *   INPUTS: pcb -- the process, not on any queue
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: Chances the process to current process on new terminal
+ *   SIDE EFFECTS: call with interrupts disabled
  */
-void switch_tasks(){
-    // //uint32_t saved_esp, saved_ebp;
-    // int cur_pid = get_term_pid(cur_term);
-    // int original = cur_term;
-    // int next_pid = -1;
-    // while (next_pid == -1) {
-    //     cur_term++;
-    //     cur_term %= 3;
-    //     if (cur_term == original) {
-    //         return;
-    //     }
-    //     next_pid = get_term_pid(cur_term);
-    // }
-    // pcb_t* pcb = (pcb_t*)get_pcb_from_pid(cur_pid);
-    // //int32_t cur_pid = pcb->pid;
+static void rq_push(pcb_t* pcb) {
+    int32_t level = rq_level(pcb);
+    int32_t q = rq_index(pcb);
+    pcb->run_next = -1;
+    pcb->on_rq = 1;
+    if (rq_head[level][q] == -1) {
+        rq_head[level][q] = pcb->pid;
+    }
+    else {
+        ((pcb_t*)get_pcb_from_pid(rq_tail[level][q]))->run_next = pcb->pid;
+    }
+    rq_tail[level][q] = pcb->pid;
+}
 
-    // //int32_t next_pid = (cur_scheduled + 1) % 6;
-    // pcb_t* new_pcb = (pcb_t*)get_pcb_from_pid(next_pid);
+/*
+ * rq_waiting_above()
+ *   DESCRIPTION: Checks for a queued process at a better level
+ *   INPUTS: level -- the level to compare with
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if a queue above the level has a runnable process, 0 otherwise
+ *   SIDE EFFECTS: call with interrupts disabled
+ */
+static int32_t rq_waiting_above(int32_t level) {
+    int32_t l, q;
+    pcb_t* pcb;
+    for (l = 0; l < level; l++) {
+        for (q = 0; q < NUM_RUN_QUEUES; q++) {
+            while (rq_head[l][q] != -1) {
+                pcb = (pcb_t*)get_pcb_from_pid(rq_head[l][q]);
+                if (pcb->active != 0 && pcb->state == PROC_RUNNING) {
+                    return 1;
+                }
+                rq_head[l][q] = pcb->run_next;  /* drop a process that blocked since it was queued */
+                pcb->on_rq = 0;
+            }
+        }
+    }
+    return 0;
+}
 
-    // // Save esp/ebp
-    // uint32_t saved_esp = save_esp();
-    // pcb->esp = saved_esp;
-    // uint32_t saved_ebp = save_ebp();
-    // pcb->ebp = saved_ebp;
+/*
+ * sched_init()
+ *   DESCRIPTION: Empties the run queues
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call before any process or kernel thread is created
+ */
+void sched_init() {
+    int i, level;
+    for (level = 0; level < NUM_PRIO_LEVELS; level++) {
+        for (i = 0; i < NUM_RUN_QUEUES; i++) {
+            rq_head[level][i] = rq_tail[level][i] = -1;
+        }
+        rq_turn[level] = 0;
+    }
+    for (i = 0; i < NUM_PROCESS; i++) {
+        ((pcb_t*)get_pcb_from_pid(i))->on_rq = 0;
+    }
+}
+
+/*
+ * sched_reprioritize()
+ *   DESCRIPTION: Moves every queued process to the queue of the level it is
+ *                at now, after the levels were reset or the displayed
+ *                terminal changed
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: keeps the order of the processes within a level
+ */
+void sched_reprioritize() {
+    uint32_t flags;
+    int32_t queued[NUM_PROCESS];
+    int32_t level, q, n = 0, i;
+    pcb_t* pcb;
+    cli_and_save(flags);
+    for (level = 0; level < NUM_PRIO_LEVELS; level++) {
+        for (q = 0; q < NUM_RUN_QUEUES; q++) {
+            while (rq_head[level][q] != -1) {
+                pcb = (pcb_t*)get_pcb_from_pid(rq_head[level][q]);
+                rq_head[level][q] = pcb->run_next;
+                pcb->on_rq = 0;
+                queued[n++] = pcb->pid;
+            }
+            rq_tail[level][q] = -1;
+        }
+    }
+    for (i = 0; i < n; i++) {
+        pcb = (pcb_t*)get_pcb_from_pid(queued[i]);
+        if (pcb->active != 0 && pcb->state == PROC_RUNNING) {
+            rq_push(pcb);
+        }
+    }
+    restore_flags(flags);
+}
 
-    // // Switch process paging
-    // unload_user_program(cur_pid);
-    // load_user_program(next_pid);
+/*
+ * prio_boost()
+ *   DESCRIPTION: Puts every process back at the top level with a fresh
+ *                slice, so the ones that sank still run while processes
+ *                above them keep the CPU busy
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call with interrupts disabled
+ */
+static void prio_boost() {
+    int i;
+    pcb_t* pcb;
+    for (i = 0; i < NUM_PROCESS; i++) {
+        pcb = (pcb_t*)get_pcb_from_pid(i);
+        pcb->prio = 0;
+        pcb->slice_ticks = 0;
+    }
+    sched_reprioritize();
+}
 
-    // // Set TSS
-    // tss.esp0 =  EIGHT_MB - (next_pid * EIGHT_KB) - PADDING; // kernel stack pointer
-    // tss.ss0 = KERNEL_DS;    // kernel data segment (stack segment)
+/*
+ * sched_set_mlfq()
+ *   DESCRIPTION: Turns the feedback levels on or off; off, every process
+ *                gets a one tick slice in turn
+ *   INPUTS: on -- 1 for the feedback levels, 0 for plain round robin
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: requeues every queued process
+ */
+void sched_set_mlfq(uint32_t on) {
+    mlfq = on;
+    sched_reprioritize();
+}
 
-    // // Update running video coordinates
+/*
+ * leave_wait_queue()
+ *   DESCRIPTION: Takes a process off the wait queue it sleeps on, so a later
+ *                wake_up of that queue cannot resume it somewhere else
+ *   INPUTS: pcb -- the process
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call with interrupts disabled
+ */
+void leave_wait_queue(pcb_t* pcb) {
+    if (pcb->wait_channel != NULL) {
+        ((wait_queue_t*)pcb->wait_channel)->waiters--;
+        pcb->wait_channel = NULL;
+    }
+}
 
+/*
+ * make_runnable()
+ *   DESCRIPTION: Marks a process runnable and queues it behind the others of
+ *                its terminal and level. Blocking takes nothing off the
+ *                queues: a process found there not runnable is dropped when
+ *                it comes up. A process woken above the current one's level
+ *                preempts it at the end of the waking interrupt. Every
+ *                wakeup comes through here, so it leaves the wait queue.
+ *   INPUTS: pcb -- the process
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: safe to call from interrupt handlers
+ */
+void make_runnable(pcb_t* pcb) {
+    uint32_t flags;
+    pcb_t* cur;
+    cli_and_save(flags);
+    leave_wait_queue(pcb);
+    pcb->state = PROC_RUNNING;
+    if (pcb->on_rq == 0) {
+        rq_push(pcb);
+    }
+    cur = (pcb_t*)get_pcb_from_pid(get_cur_pid());
+    if (mlfq != 0 && (int32_t)cur != -1 && cur != pcb && rq_level(pcb) < rq_level(cur)) {
+        need_resched = 1;
+    }
+    restore_flags(flags);
+}
 
-    // // Restore next process' esp/ebp
-    // restore_esp_ebp(new_pcb->esp, new_pcb->ebp);
+/*
+ * pick_next()
+ *   DESCRIPTION: Takes the next process to run off the run queues. The
+ *                best level with a runnable process wins; its queues are
+ *                served in turn starting after the one its last pick came
+ *                from, and each is first in, first out.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: PID of the process to run, or -1 if nothing can run
+ *   SIDE EFFECTS: call with interrupts disabled
+ */
+static int32_t pick_next() {
+    int i;
+    int32_t level, q, pid;
+    pcb_t* pcb;
+    for (level = 0; level < NUM_PRIO_LEVELS; level++) {
+        for (i = 1; i <= NUM_RUN_QUEUES; i++) {
+            q = (rq_turn[level] + i) % NUM_RUN_QUEUES;
+            while (rq_head[level][q] != -1) {
+                pid = rq_head[level][q];
+                pcb = (pcb_t*)get_pcb_from_pid(pid);
+                rq_head[level][q] = pcb->run_next;
+                pcb->on_rq = 0;
+                if (pcb->active == 0 || pcb->state != PROC_RUNNING) {
+                    continue;   /* blocked or gone since it was queued */
+                }
+                if (rq_level(pcb) > level) {
+                    rq_push(pcb);   /* its terminal stopped being displayed since it was queued */
+                    continue;
+                }
+                rq_turn[level] = q;
+                return pid;
+            }
+        }
+    }
+    return -1;
+}
 
+/*
+ * requeue_current()
+ *   DESCRIPTION: Puts the current process back on its queue if it can still
+ *                run, before the scheduler picks
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call with interrupts disabled
+ */
+static void requeue_current() {
+    pcb_t* pcb = (pcb_t*)get_pcb_from_pid(get_cur_pid());
+    if ((int32_t)pcb != -1 && pcb->active != 0 && pcb->state == PROC_RUNNING && pcb->on_rq == 0) {
+        rq_push(pcb);
+    }
 }
 
 /*
- * switch_term_tasks()
- *   DESCRIPTION: Switches tasks to new terminal upon switch
- *   INPUTS: start_pid -- Current terminal's PID number
- *           end_pid -- New switched terminal's PID number
+ * switch_to()
+ *   DESCRIPTION: Switches the address space, TSS and kernel stack to another process
+ *   INPUTS: next_pid -- process to switch to
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: Loads the switched terminals process, replacing the old one's
+ *   SIDE EFFECTS: returns only when the current process is picked again,
+ *                 must be called with interrupts disabled
  */
-void switch_term_tasks(int start_pid, int end_pid) {
-    // cli();
-    // pcb_t* pcb = (pcb_t*)get_pcb_from_pid(start_pid);
-    // if((int)pcb == -1) {return;}
-    // pcb_t* new_pcb = (pcb_t*)get_pcb_from_pid(end_pid);
-    // if((int)new_pcb == -1) {return;}
-    // // Save esp/ebp
-    // register uint32_t saved_esp asm("esp");
-    // pcb->esp = saved_esp;
-    // register uint32_t saved_ebp asm("ebp");
-    // pcb->ebp = saved_ebp;
+static void switch_to(int32_t next_pid) {
+    pcb_t* pcb = (pcb_t*)get_pcb_from_pid(get_cur_pid());
+    pcb_t* new_pcb = (pcb_t*)get_pcb_from_pid(next_pid);
 
-    // // Switch process paging
-    // unload_user_program(start_pid);
-    // load_user_program(end_pid);
+    // Switch page directories, kernel threads only touch kernel memory so they
+    // keep whatever directory is loaded, and threads of one process share one
+    if (new_pcb->kthread == 0 && ((int32_t)pcb == -1 || pcb->kthread != 0 || pcb->group_pid != new_pcb->group_pid)) {
+        switch_directory_sched(new_pcb->group_pid);
+    }
+
+    // Set TSS
+    tss.esp0 =  EIGHT_MB - (next_pid * EIGHT_KB) - PADDING; // kernel stack pointer
+    tss.ss0 = KERNEL_DS;    // kernel data segment (stack segment)
+
+    // Save our stack and resume the next process' stack, the boot context
+    // has no PCB and is never resumed
+    set_cur_pid(next_pid);
+    context_switch(((int32_t)pcb == -1) ? &boot_esp : &pcb->sched_esp, new_pcb->sched_esp);
+}
 
-    // // Set TSS
-    // tss.esp0 =  EIGHT_MB - (end_pid * EIGHT_KB) - PADDING; // kernel stack pointer
-    // tss.ss0 = KERNEL_DS;    // kernel data segment (stack segment)
+/*
+ * switch_tasks()
+ *   DESCRIPTION: Called on every PIT tick to charge the tick to the process
+ *                that had it. A process that used up its slice sinks a level
+ *                and the CPU goes to the next runnable process; otherwise it
+ *                keeps the CPU unless a better level has something queued.
+ *                A tick that lands while schedule idles after a process
+ *                blocked is charged to nobody.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: May switch to another process, runs with interrupts disabled
+ */
+void switch_tasks(){
+    int32_t next_pid;
+    uint32_t expired = 1;
+    /* nothing to preempt until the first program starts */
+    if (get_cur_pid() == -1) {
+        return;
+    }
+    pcb_t* pcb = (pcb_t*)get_pcb_from_pid(get_cur_pid());
+    if (pcb->active != 0 && pcb->state == PROC_RUNNING) {
+        pcb->cpu_ticks++;
+        if (mlfq != 0 && ++pcb->slice_ticks < PRIO_SLICE(pcb->prio)) {
+            expired = 0;
+        }
+        else if (mlfq != 0) {
+            if (pcb->prio < NUM_PRIO_LEVELS - 1) {
+                pcb->prio++;
+            }
+            pcb->slice_ticks = 0;
+        }
+    }
+    if (mlfq != 0 && get_pit_ticks() - last_boost >= PRIO_BOOST_TICKS) {
+        last_boost = get_pit_ticks();
+        prio_boost();
+    }
+    if (expired == 0 && rq_waiting_above(rq_level(pcb)) == 0) {
+        return;     /* the rest of its slice */
+    }
+    need_resched = 0;
+    requeue_current();
+    next_pid = pick_next();
+    if (next_pid == -1 || next_pid == get_cur_pid()) {
+        return;
+    }
+    switch_to(next_pid);
+}
 
-    // // Update running video coordinates
+/*
+ * schedule()
+ *   DESCRIPTION: Gives up the CPU after the current process blocked or halted,
+ *                or lets the others run first if it is still runnable. Idles
+ *                with hlt until something can run. The boot context calls it
+ *                once to hand the CPU to the processes it spawned.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: returns once the current process is runnable and picked again
+ */
+void schedule() {
+    uint32_t flags;
+    int32_t next_pid;
+    cli_and_save(flags);
+    requeue_current();
+    next_pid = pick_next();
+    while (next_pid == -1) {
+        /* nothing is runnable, wait for an interrupt to wake someone up with
+           the periodic tick stopped until the next timer deadline */
+        pit_idle_enter();
+        asm volatile ("sti; hlt; cli" : : : "memory");
+        pit_idle_exit();
+        /* a nested tick may have woken and resumed us here after our own
+           queue entry was already taken */
+        requeue_current();
+        next_pid = pick_next();
+    }
+    if (next_pid != get_cur_pid()) {
+        switch_to(next_pid);
+    }
+    restore_flags(flags);
+}
 
-    // flush_tlb();
-    // // Restore next process' esp/ebp
-    // sti();
-    // restore_esp_ebp(new_pcb->esp, new_pcb->ebp);
+/*
+ * sched_preempt()
+ *   DESCRIPTION: Called at the end of an interrupt handler that may have woken
+ *                a process: switches to it right away if it outranks the
+ *                current process, rather than at the next tick
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: May switch to another process
+ */
+void sched_preempt() {
+    uint32_t flags;
+    int32_t next_pid;
+    pcb_t* pcb;
+    cli_and_save(flags);
+    pcb = (pcb_t*)get_pcb_from_pid(get_cur_pid());
+    /* a blocked process idling in schedule picks for itself */
+    if (need_resched == 0 || (int32_t)pcb == -1 || pcb->active == 0 || pcb->state != PROC_RUNNING) {
+        restore_flags(flags);
+        return;
+    }
+    need_resched = 0;
+    requeue_current();
+    next_pid = pick_next();
+    if (next_pid != -1 && next_pid != get_cur_pid()) {
+        switch_to(next_pid);
+    }
+    restore_flags(flags);
 }
 
+/*
+ * kthread_create()
+ *   DESCRIPTION: Starts a kernel thread. It gets a PCB and kernel stack like a
+ *                process but never enters user mode.
+ *   INPUTS: func -- function the thread runs
+ *           arg -- argument passed to func
+ *   OUTPUTS: none
+ *   RETURN VALUE: PID of the thread on success, -1 if no PCB is free
+ *   SIDE EFFECTS: the thread runs the next time the scheduler picks it
+ */
+int32_t kthread_create(void (*func)(void* arg), void* arg) {
+    uint32_t flags;
+    uint32_t* stack;
+    cli_and_save(flags);
+    int32_t ret = find_available_pcb();
+    if (ret == -1) {
+        restore_flags(flags);
+        return -1;
+    }
+    pcb_t* thread = (pcb_t*)ret;
+    thread->pid = (EIGHT_MB - ret) / EIGHT_KB - 1;
+    thread->parent_id = -1;
+    thread->argc = 0;
+    thread->argv = NULL;
+    thread->active = 1;
+    thread->term = -1;
+    thread->detached = 0;
+    thread->exit_status = 0;
+    thread->kthread = 1;
+    thread->syscall = 0;
+    thread->group_pid = thread->pid;
+    thread->fd_table = NULL;    /* no files */
+    thread->image = NULL;       /* no program pages */
+    thread->name[0] = '\0';
+    thread->wait_channel = NULL;
+    thread->child_wait.waiters = 0;
+    memset((void*)thread->shm_map, -1, NUM_SHM_SLOTS);
+    thread->cpu_ticks = 0;
+    thread->prio = 0;
+    thread->slice_ticks = 0;
+    timer_pcb_init(thread);
 
+    /* make the first switch to the thread return into kthread_entry */
+    stack = (uint32_t*)(EIGHT_MB - (thread->pid * EIGHT_KB) - PADDING);
+    *(--stack) = (uint32_t)kthread_entry;   /* return address */
+    *(--stack) = 0;             /* EBP */
+    *(--stack) = (uint32_t)func;    /* EBX */
+    *(--stack) = (uint32_t)arg; /* ESI */
+    *(--stack) = 0;             /* EDI */
+    thread->sched_esp = (uint32_t)stack;
+    make_runnable(thread);
+    restore_flags(flags);
+    return thread->pid;
+}
 
+/*
+ * kthread_exit()
+ *   DESCRIPTION: Ends the current kernel thread, called when its function returns
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: frees the thread's PCB, never returns
+ */
+void kthread_exit() {
+    cli();
+    timer_pcb_release((pcb_t*)get_pcb_from_pid(get_cur_pid()));
+    ((pcb_t*)get_pcb_from_pid(get_cur_pid()))->active = 0;
+    schedule();
+}
 
+/*
+ * sleep_on()
+ *   DESCRIPTION: Blocks the current process until wake_up is called on the queue.
+ *                Callers check their condition again after waking up.
+ *   INPUTS: queue -- the wait queue to sleep on
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: must be called with interrupts disabled, they stay disabled
+ */
+void sleep_on(wait_queue_t* queue) {
+    pcb_t* pcb = (pcb_t*)get_pcb_from_pid(get_cur_pid());
+    pcb->wait_channel = queue;
+    pcb->state = PROC_WAITING;
+    pcb->slice_ticks = 0;   /* blocking before the slice is used keeps the level */
+    queue->waiters++;
+    schedule();     /* make_runnable took us off the queue */
+}
 
+/*
+ * wake_up()
+ *   DESCRIPTION: Makes every process sleeping on a wait queue runnable
+ *   INPUTS: queue -- the wait queue to wake
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: safe to call from interrupt handlers
+ */
+void wake_up(wait_queue_t* queue) {
+    uint32_t flags;
+    int i;
+    pcb_t* pcb;
+    if (queue->waiters == 0) {
+        return;
+    }
+    cli_and_save(flags);
+    for (i = 0; i < NUM_PROCESS; i++) {
+        pcb = (pcb_t*)get_pcb_from_pid(i);
+        if (pcb->active != 0 && pcb->state == PROC_WAITING && pcb->wait_channel == queue) {
+            make_runnable(pcb);
+        }
+    }
+    restore_flags(flags);
+}
@@ -2,12 +2,78 @@
 #define SCHEDULING_H
 
 #include "types.h"
+#include "keyboard.h"
+
+/* Process states */
+#define PROC_RUNNING    0   /* runnable, the scheduler may pick it */
+#define PROC_WAITING    1   /* blocked in exec, waitpid or a driver */
+#define PROC_ZOMBIE     2   /* halted spawned process waiting to be collected */
+
+/* One run queue per terminal and one for kernel threads */
+#define NUM_RUN_QUEUES  (NUM_TERMINALS + 1)
+
+/* Feedback levels, 0 is served first. A process that runs for its whole
+ * slice sinks a level, one that blocks first keeps it. */
+#define NUM_PRIO_LEVELS     3
+#define PRIO_SLICE(level)   (1 << (level))  /* ticks */
+#define PRIO_BOOST_TICKS    100     /* every process goes back to level 0 this often */
+#define FG_PRIO_BOOST       1       /* levels the displayed terminal's processes are raised */
+
+/* Something processes can sleep on until another process or an interrupt
+ * wakes them, sleepers are found through pcb_t.wait_channel */
+typedef struct wait_queue {
+    uint32_t waiters;   /* number of processes sleeping, lets wake_up skip the scan */
+} wait_queue_t;
 
 // Function prototypes
 
+struct pcb;
+
+/* Empties the run queues */
+void sched_init();
+
+/* Marks a process runnable and queues it */
+void make_runnable(struct pcb* pcb);
+
+/* Takes a process off the wait queue it sleeps on, if any */
+void leave_wait_queue(struct pcb* pcb);
+
+/* Requeues every queued process at its current level */
+void sched_reprioritize();
+
+/* Turns the feedback levels on or off */
+void sched_set_mlfq(uint32_t on);
+
+/* Switches to a process an interrupt woke if it outranks the current one */
+void sched_preempt();
+
 /* Switch tasks from one process to another */
 void switch_tasks();
 
+/* Gives up the CPU, used when the current process blocks or halts */
+void schedule();
+
+/* Saves callee-saved registers and ESP, then resumes the other stack */
+extern void context_switch(uint32_t* save_esp, uint32_t new_esp);
+
+/* First code run by a spawned process or thread, irets to EBX with the user stack in ESI */
+extern void process_entry();
+
+/* First code run by a kernel thread, calls the function in EBX with ESI */
+extern void kthread_entry();
+
+/* Starts a kernel thread running func(arg) on its own kernel stack */
+int32_t kthread_create(void (*func)(void* arg), void* arg);
+
+/* Ends the current kernel thread */
+void kthread_exit();
+
+/* Sleeps on a wait queue until woken, call with interrupts disabled */
+void sleep_on(wait_queue_t* queue);
+
+/* Wakes every process sleeping on a wait queue */
+void wake_up(wait_queue_t* queue);
+
 /* Saves ESP value*/
 extern uint32_t save_esp();
 
@@ -17,9 +83,6 @@ extern uint32_t save_ebp();
 /* Restores ESP and EBP values */
 extern void restore_esp_ebp(uint32_t esp, uint32_t ebp);
 
-/* Switch tasks from one process to another on termianl switch */
-void switch_term_tasks(int start_pid, int end_pid);
-
 /* Restores EBP value */
 //extern void restore_ebp(uint32_t ebp);
 
@@ -0,0 +1,269 @@
+/* shm.c - Shared memory segments, 4MB pages that several processes map at
+ * addresses of their choosing
+ * vim:ts=4 noexpandtab
+ */
+
+#include "shm.h"
+#include "syscalls.h"
+#include "lib.h"
+
+/* Local variables */
+shm_segment_t segments[NUM_SHM_SEGMENTS];
+static wait_queue_t zero_wait;  /* creates waiting for a segment to be zeroed */
+
+/*
+ * get_shm_map()
+ *   DESCRIPTION: Finds the attachment table of the current process, which
+ *                belongs to the whole thread group
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the table
+ *   SIDE EFFECTS: none
+ */
+static int8_t* get_shm_map() {
+    pcb_t* cur_pcb = (pcb_t*)get_pcb_from_pid(get_cur_pid());
+    return ((pcb_t*)get_pcb_from_pid(cur_pcb->group_pid))->shm_map;
+}
+
+/*
+ * get_slot()
+ *   DESCRIPTION: Converts a user address to a slot of the shared memory window
+ *   INPUTS: addr -- the address
+ *   OUTPUTS: none
+ *   RETURN VALUE: the slot, or -1 if addr is not a 4MB aligned address in the window
+ *   SIDE EFFECTS: none
+ */
+static int32_t get_slot(uint32_t addr) {
+    if (addr < SHM_VIRT_START || (addr & (SIZE_4MB - 1)) != 0) {
+        return -1;
+    }
+    if ((addr - SHM_VIRT_START) / SIZE_4MB >= NUM_SHM_SLOTS) {
+        return -1;
+    }
+    return (addr - SHM_VIRT_START) / SIZE_4MB;
+}
+
+/*
+ * put_segment()
+ *   DESCRIPTION: Drops one reference to a segment, freeing it on the last one
+ *   INPUTS: id -- the segment
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call with interrupts disabled
+ */
+static void put_segment(int32_t id) {
+    if (--segments[id].refcount == 0) {
+        segments[id].in_use = 0;
+        wake_up(&zero_wait);    /* a create waiting on it looks again */
+    }
+}
+
+/*
+ * find_segment()
+ *   DESCRIPTION: Looks up the segment created with a key
+ *   INPUTS: key -- the key
+ *   OUTPUTS: none
+ *   RETURN VALUE: segment ID, or -1 if no segment has the key
+ *   SIDE EFFECTS: call with interrupts disabled
+ */
+static int32_t find_segment(uint32_t key) {
+    int i;
+    for (i = 0; i < NUM_SHM_SEGMENTS; i++) {
+        if (segments[i].in_use == 1 && segments[i].key == key) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * release_creator()
+ *   DESCRIPTION: Drops the reference a thread group holds on a segment it
+ *                created, so a segment nobody attaches is still freed
+ *   INPUTS: id -- the segment
+ *           group -- leader of the thread group
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call with interrupts disabled
+ */
+static void release_creator(int32_t id, int32_t group) {
+    if (segments[id].in_use == 1 && segments[id].creator == group) {
+        segments[id].creator = -1;
+        put_segment(id);
+    }
+}
+
+/*
+ * shm_load()
+ *   DESCRIPTION: Maps the segments a process has attached in its page
+ *                directory and unmaps the rest, the caller flushes the TLB
+ *   INPUTS: pid -- the process, or the leader of a thread group
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes page directory entries
+ */
+void shm_load(int32_t pid) {
+    int i;
+    int32_t id;
+    int _4m_index = (uint32_t)(SHM_VIRT_START >> 22);
+    union directory_entry* directory = process_directories[pid];
+    pcb_t* pcb = (pcb_t*)get_pcb_from_pid(pid);
+    for (i = 0; i < NUM_SHM_SLOTS; i++) {
+        id = pcb->shm_map[i];
+        if (id == -1) {
+            directory[_4m_index + i]._4m_p.present = 0;
+            continue;
+        }
+        directory[_4m_index + i]._4m_p.present = 1;
+        directory[_4m_index + i]._4m_p.user_supervisor = 1;
+        directory[_4m_index + i]._4m_p.read_write = 1;
+        directory[_4m_index + i]._4m_p.page_size = 1;
+        directory[_4m_index + i]._4m_p.global_page = 0;
+        directory[_4m_index + i]._4m_p.page_base_address = (uint32_t)((SHM_START + id * SHM_SEGMENT_SIZE) >> 22);
+    }
+}
+
+/*
+ * sys_shm_create()
+ *   DESCRIPTION: Returns the segment created with a key, or creates a zeroed
+ *                one. Processes that agree on a key share the segment.
+ *   INPUTS: key -- the key
+ *   OUTPUTS: none
+ *   RETURN VALUE: segment ID on success, -1 if every segment is in use
+ *   SIDE EFFECTS: a new segment is held by the caller's thread group until it
+ *                 detaches the segment or halts. Sleeps while another create
+ *                 is still zeroing the segment with the key.
+ */
+int32_t sys_shm_create(uint32_t key) {
+    uint32_t flags;
+    int i;
+    cli_and_save(flags);
+    /* writes made before the zeroing finished would be erased */
+    while ((i = find_segment(key)) != -1 && segments[i].zeroing == 1) {
+        sleep_on(&zero_wait);
+    }
+    if (i != -1) {
+        restore_flags(flags);
+        return i;
+    }
+    for (i = 0; i < NUM_SHM_SEGMENTS; i++) {
+        if (segments[i].in_use == 0) {
+            segments[i].in_use = 1;
+            segments[i].key = key;
+            segments[i].refcount = 1;
+            segments[i].creator = ((pcb_t*)get_pcb_from_pid(get_cur_pid()))->group_pid;
+            segments[i].zeroing = 1;
+            restore_flags(flags);
+            /* the slot is claimed, so clear the 4MB with interrupts on */
+            memset((void*)(SHM_START + i * SHM_SEGMENT_SIZE), 0, SHM_SEGMENT_SIZE);
+            cli_and_save(flags);
+            segments[i].zeroing = 0;
+            wake_up(&zero_wait);
+            restore_flags(flags);
+            return i;
+        }
+    }
+    restore_flags(flags);
+    return -1;
+}
+
+/*
+ * sys_shm_attach()
+ *   DESCRIPTION: Maps a segment into the caller's address space
+ *   INPUTS: id -- the segment returned by shm_create
+ *           addr -- 4MB aligned address between 192MB and 256MB
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: every thread of the caller sees the segment
+ */
+int32_t sys_shm_attach(int32_t id, uint32_t addr) {
+    uint32_t flags;
+    int8_t* shm_map = get_shm_map();
+    int32_t slot = get_slot(addr);
+    if (slot == -1 || id < 0 || id >= NUM_SHM_SEGMENTS) {
+        return -1;
+    }
+    cli_and_save(flags);
+    if (segments[id].in_use == 0 || segments[id].zeroing == 1 || shm_map[slot] != -1) {
+        restore_flags(flags);
+        return -1;
+    }
+    shm_map[slot] = id;
+    segments[id].refcount++;
+    shm_load(((pcb_t*)get_pcb_from_pid(get_cur_pid()))->group_pid);
+    /* the slot was not present, so the TLB has nothing to drop */
+    restore_flags(flags);
+    return 0;
+}
+
+/*
+ * detach_slot()
+ *   DESCRIPTION: Drops one attachment, freeing the segment on the last one
+ *   INPUTS: shm_map -- attachment table of the process
+ *           slot -- the slot to clear
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call with interrupts disabled
+ */
+static void detach_slot(int8_t* shm_map, int32_t slot) {
+    int32_t id = shm_map[slot];
+    shm_map[slot] = -1;
+    put_segment(id);
+}
+
+/*
+ * sys_shm_detach()
+ *   DESCRIPTION: Unmaps the segment attached at an address
+ *   INPUTS: addr -- the address given to shm_attach
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if nothing is attached there
+ *   SIDE EFFECTS: the caller lets go of a segment it created, and the segment
+ *                 is freed when this was its last reference
+ */
+int32_t sys_shm_detach(uint32_t addr) {
+    uint32_t flags;
+    int8_t* shm_map = get_shm_map();
+    int32_t slot = get_slot(addr);
+    int32_t id;
+    if (slot == -1) {
+        return -1;
+    }
+    cli_and_save(flags);
+    if (shm_map[slot] == -1) {
+        restore_flags(flags);
+        return -1;
+    }
+    id = shm_map[slot];
+    detach_slot(shm_map, slot);
+    release_creator(id, ((pcb_t*)get_pcb_from_pid(get_cur_pid()))->group_pid);
+    shm_load(((pcb_t*)get_pcb_from_pid(get_cur_pid()))->group_pid);
+    tlb_invalidate(addr);   /* one invlpg drops the whole 4MB page */
+    tlb_commit();
+    restore_flags(flags);
+    return 0;
+}
+
+/*
+ * shm_detach_all()
+ *   DESCRIPTION: Drops every attachment of a process that is halting, and the
+ *                reference on segments it created but never detached
+ *   INPUTS: pid -- the process, the leader of its thread group
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the window is unmapped when the page directory is rebuilt
+ */
+void shm_detach_all(int32_t pid) {
+    uint32_t flags;
+    int i;
+    int8_t* shm_map = ((pcb_t*)get_pcb_from_pid(pid))->shm_map;
+    cli_and_save(flags);
+    for (i = 0; i < NUM_SHM_SLOTS; i++) {
+        if (shm_map[i] != -1) {
+            detach_slot(shm_map, i);
+        }
+    }
+    for (i = 0; i < NUM_SHM_SEGMENTS; i++) {
+        release_creator(i, pid);
+    }
+    restore_flags(flags);
+}
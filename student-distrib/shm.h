@@ -0,0 +1,44 @@
+/* shm.h - Defines for shared memory segments
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _SHM_H
+#define _SHM_H
+
+#include "types.h"
+#include "paging.h"
+#include "image_cache.h"
+
+/* Segments are 4MB pages right after the image cache, mapped 1:1 for the kernel */
+#define SHM_START           (IMAGE_CACHE_START + IMAGE_CACHE_SIZE)
+#define NUM_SHM_SEGMENTS    4
+#define SHM_SEGMENT_SIZE    SIZE_4MB
+
+/* Processes attach segments at 4MB aligned addresses in 192MB to 256MB */
+#define SHM_VIRT_START      0x0C000000
+
+/* Struct for one shared memory segment */
+typedef struct shm_segment {
+    uint32_t key;       /* key the segment was created with */
+    uint32_t refcount;  /* number of attachments, plus one while creator is set */
+    uint32_t in_use;    /* 1 if the segment is allocated, 0 otherwise */
+    int32_t creator;    /* thread group that created it, -1 once it let go */
+    uint32_t zeroing;   /* 1 while shm_create clears it, nobody may use it yet */
+} shm_segment_t;
+
+/* Returns the segment with a key, creating it if needed */
+int32_t sys_shm_create(uint32_t key);
+
+/* Maps a segment into the caller at a chosen address */
+int32_t sys_shm_attach(int32_t id, uint32_t addr);
+
+/* Unmaps the segment at an address from the caller */
+int32_t sys_shm_detach(uint32_t addr);
+
+/* Drops every attachment and creator reference of a halting process */
+void shm_detach_all(int32_t pid);
+
+/* Installs the attachments of a process in the page directory */
+void shm_load(int32_t pid);
+
+#endif /* _SHM_H */
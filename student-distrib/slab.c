@@ -0,0 +1,332 @@
+/* slab.c - Kernel page allocator and slab caches, so kernel objects can be
+ * allocated at run time instead of living in fixed-size static tables
+ * vim:ts=4 noexpandtab
+ */
+
+#include "slab.h"
+#include "lib.h"
+
+/* Owner of a heap page that is not part of any cache */
+#define PAGE_FREE       (-1)
+#define PAGE_RAW        NUM_KMEM_CACHES     /* page_alloc or a page-sized kmalloc */
+
+/* Local variables */
+static uint16_t free_frames[KHEAP_FRAMES];  /* stack of free frame numbers */
+static uint32_t num_free_frames = 0;
+static int8_t page_owner[KHEAP_FRAMES];     /* cache each page belongs to */
+static kmem_cache_t caches[NUM_KMEM_CACHES];
+static kmem_cache_t* kmalloc_caches[NUM_KMEM_CACHES];   /* size classes, smallest first */
+static uint32_t num_kmalloc_caches = 0;
+
+/*
+ * page_index()
+ *   DESCRIPTION: Returns the heap frame an address is in
+ *   INPUTS: ptr -- address in the heap
+ *   OUTPUTS: none
+ *   RETURN VALUE: frame number, or -1 if ptr is outside the heap
+ *   SIDE EFFECTS: none
+ */
+static int32_t page_index(void* ptr) {
+    if ((uint32_t)ptr < KHEAP_START || (uint32_t)ptr >= KHEAP_START + KHEAP_SIZE) {
+        return -1;
+    }
+    return ((uint32_t)ptr - KHEAP_START) / PAGE_4K_SIZE;
+}
+
+/*
+ * kmem_init()
+ *   DESCRIPTION: Puts every heap frame on the free stack and makes the kmalloc
+ *                size classes, powers of two from KMALLOC_MIN_SIZE
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call after page_init has mapped the heap
+ */
+void kmem_init() {
+    int i;
+    uint32_t size;
+    int8_t name[KMEM_NAME_LEN];
+    /* lowest frame on top, so the heap fills from the bottom */
+    for (i = 0; i < KHEAP_FRAMES; i++) {
+        free_frames[i] = KHEAP_FRAMES - 1 - i;
+        page_owner[i] = PAGE_FREE;
+    }
+    num_free_frames = KHEAP_FRAMES;
+    for (i = 0; i < NUM_KMEM_CACHES; i++) {
+        caches[i].active = 0;
+    }
+    num_kmalloc_caches = 0;
+    for (size = KMALLOC_MIN_SIZE; size <= KMALLOC_MAX_SLAB; size *= 2) {
+        strcpy(name, (const int8_t*)"kmalloc-");
+        itoa(size, name + strlen(name), 10);
+        kmalloc_caches[num_kmalloc_caches++] = kmem_cache_create(name, size);
+    }
+}
+
+/*
+ * page_alloc()
+ *   DESCRIPTION: Pops a frame off the free stack
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: kernel address of the page, NULL if the heap is full
+ *   SIDE EFFECTS: the page is not zeroed
+ */
+void* page_alloc() {
+    uint32_t flags;
+    uint32_t frame;
+    cli_and_save(flags);
+    if (num_free_frames == 0) {
+        restore_flags(flags);
+        return NULL;
+    }
+    frame = free_frames[--num_free_frames];
+    page_owner[frame] = PAGE_RAW;
+    restore_flags(flags);
+    return (void*)(KHEAP_START + frame * PAGE_4K_SIZE);
+}
+
+/*
+ * page_free()
+ *   DESCRIPTION: Pushes a frame back on the free stack
+ *   INPUTS: page -- address returned by page_alloc
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: pages that are free already or not from the heap are ignored
+ */
+void page_free(void* page) {
+    uint32_t flags;
+    int32_t frame = page_index(page);
+    if (frame == -1) {
+        return;
+    }
+    cli_and_save(flags);
+    if (page_owner[frame] != PAGE_FREE) {
+        page_owner[frame] = PAGE_FREE;
+        free_frames[num_free_frames++] = frame;
+    }
+    restore_flags(flags);
+}
+
+/*
+ * kmem_cache_create()
+ *   DESCRIPTION: Makes an empty cache, pages are added on the first allocation
+ *   INPUTS: name -- shown by kmem_print_stats
+ *           size -- bytes per object, at most KMALLOC_MAX_SIZE
+ *   OUTPUTS: none
+ *   RETURN VALUE: the cache, or NULL if every entry is taken or size is too big
+ *   SIDE EFFECTS: none
+ */
+kmem_cache_t* kmem_cache_create(const int8_t* name, uint32_t size) {
+    uint32_t flags;
+    int i;
+    if (size == 0 || size > KMALLOC_MAX_SIZE) {
+        return NULL;
+    }
+    cli_and_save(flags);
+    for (i = 0; i < NUM_KMEM_CACHES; i++) {
+        if (caches[i].active == 0) {
+            strncpy(caches[i].name, name, KMEM_NAME_LEN - 1);
+            caches[i].name[KMEM_NAME_LEN - 1] = '\0';
+            caches[i].obj_size = (size + PADDING - 1) & ~(PADDING - 1);   /* room for the free list link */
+            caches[i].free_list = NULL;
+            caches[i].pages = 0;
+            caches[i].free_objs = 0;
+            caches[i].in_use = 0;
+            caches[i].allocs = 0;
+            caches[i].frees = 0;
+            caches[i].grows = 0;
+            caches[i].failed = 0;
+            caches[i].active = 1;
+            restore_flags(flags);
+            return &caches[i];
+        }
+    }
+    restore_flags(flags);
+    return NULL;
+}
+
+/*
+ * cache_grow()
+ *   DESCRIPTION: Carves a new page into objects and puts them on the free list,
+ *                lowest address first
+ *   INPUTS: cache -- the cache
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the heap is full
+ *   SIDE EFFECTS: call with interrupts disabled
+ */
+static int32_t cache_grow(kmem_cache_t* cache) {
+    uint32_t n, i;
+    uint8_t* page = (uint8_t*)page_alloc();
+    if (page == NULL) {
+        return -1;
+    }
+    page_owner[page_index(page)] = cache - caches;
+    n = PAGE_4K_SIZE / cache->obj_size;
+    for (i = n; i-- > 0;) {
+        *(void**)(page + i * cache->obj_size) = cache->free_list;
+        cache->free_list = page + i * cache->obj_size;
+    }
+    cache->free_objs += n;
+    cache->pages++;
+    cache->grows++;
+    return 0;
+}
+
+/*
+ * kmem_cache_alloc()
+ *   DESCRIPTION: Pops the most recently freed object, adding a page to the
+ *                cache when it has none
+ *   INPUTS: cache -- the cache
+ *   OUTPUTS: none
+ *   RETURN VALUE: the object, or NULL if the heap is full
+ *   SIDE EFFECTS: the object is not zeroed
+ */
+void* kmem_cache_alloc(kmem_cache_t* cache) {
+    uint32_t flags;
+    void* obj;
+    cli_and_save(flags);
+    if (cache->free_list == NULL && cache_grow(cache) == -1) {
+        cache->failed++;
+        restore_flags(flags);
+        return NULL;
+    }
+    obj = cache->free_list;
+    cache->free_list = *(void**)obj;
+    cache->free_objs--;
+    cache->in_use++;
+    cache->allocs++;
+    restore_flags(flags);
+    return obj;
+}
+
+/*
+ * kmem_cache_free()
+ *   DESCRIPTION: Pushes an object back on its cache's free list. Pages stay
+ *                with the cache, which is what keeps the next allocation O(1).
+ *   INPUTS: cache -- the cache the object came from
+ *           obj -- the object
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the first word of the object is overwritten
+ */
+void kmem_cache_free(kmem_cache_t* cache, void* obj) {
+    uint32_t flags;
+    if (obj == NULL) {
+        return;
+    }
+    cli_and_save(flags);
+    *(void**)obj = cache->free_list;
+    cache->free_list = obj;
+    cache->free_objs++;
+    cache->in_use--;
+    cache->frees++;
+    restore_flags(flags);
+}
+
+/*
+ * kmalloc()
+ *   DESCRIPTION: Allocates from the smallest size class that fits, or a whole
+ *                page for anything above KMALLOC_MAX_SLAB
+ *   INPUTS: size -- bytes wanted, at most KMALLOC_MAX_SIZE
+ *   OUTPUTS: none
+ *   RETURN VALUE: the memory, or NULL on failure
+ *   SIDE EFFECTS: the memory is not zeroed
+ */
+void* kmalloc(uint32_t size) {
+    uint32_t i;
+    if (size == 0 || size > KMALLOC_MAX_SIZE) {
+        return NULL;
+    }
+    if (size > KMALLOC_MAX_SLAB) {
+        return page_alloc();
+    }
+    for (i = 0; i < num_kmalloc_caches; i++) {
+        if (size <= kmalloc_caches[i]->obj_size) {
+            return kmem_cache_alloc(kmalloc_caches[i]);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * kfree()
+ *   DESCRIPTION: Frees memory from kmalloc or any cache, finding the owner
+ *                from the page the memory is in
+ *   INPUTS: ptr -- the memory
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: NULL and addresses outside the heap are ignored
+ */
+void kfree(void* ptr) {
+    int32_t frame = page_index(ptr);
+    if (frame == -1 || page_owner[frame] == PAGE_FREE) {
+        return;
+    }
+    if (page_owner[frame] == PAGE_RAW) {
+        page_free(ptr);
+    }
+    else {
+        kmem_cache_free(&caches[(int32_t)page_owner[frame]], ptr);
+    }
+}
+
+/*
+ * kmem_free_pages()
+ *   DESCRIPTION: Returns the number of heap pages nobody owns
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: free page count
+ *   SIDE EFFECTS: none
+ */
+uint32_t kmem_free_pages() {
+    return num_free_frames;
+}
+
+/*
+ * kmem_get_totals()
+ *   DESCRIPTION: Adds up how the heap's pages are used, for meminfo
+ *   INPUTS: totals -- filled in
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void kmem_get_totals(kmem_totals_t* totals) {
+    uint32_t flags;
+    int i;
+    cli_and_save(flags);
+    totals->free_pages = num_free_frames;
+    totals->cache_pages = 0;
+    totals->object_bytes = 0;
+    for (i = 0; i < NUM_KMEM_CACHES; i++) {
+        if (caches[i].active == 1) {
+            totals->cache_pages += caches[i].pages;
+            totals->object_bytes += caches[i].in_use * caches[i].obj_size;
+        }
+    }
+    totals->raw_pages = KHEAP_FRAMES - totals->free_pages - totals->cache_pages;
+    totals->object_bytes += totals->raw_pages * PAGE_4K_SIZE;
+    restore_flags(flags);
+}
+
+/*
+ * kmem_print_stats()
+ *   DESCRIPTION: Prints the heap's free pages and a line for every cache that
+ *                has been used
+ *   INPUTS: none
+ *   OUTPUTS: the statistics on the screen
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void kmem_print_stats() {
+    int i;
+    printf("kheap: %d of %d pages free\n", num_free_frames, KHEAP_FRAMES);
+    printf("cache size pages inuse free allocs frees grows fail\n");
+    for (i = 0; i < NUM_KMEM_CACHES; i++) {
+        if (caches[i].active == 0 || caches[i].allocs == 0) {
+            continue;
+        }
+        printf("%s %d %d %d %d %d %d %d %d\n", caches[i].name, caches[i].obj_size, caches[i].pages,
+               caches[i].in_use, caches[i].free_objs, caches[i].allocs, caches[i].frees,
+               caches[i].grows, caches[i].failed);
+    }
+}
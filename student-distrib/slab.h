@@ -0,0 +1,80 @@
+/* slab.h - Defines for the kernel page allocator and slab caches
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _SLAB_H
+#define _SLAB_H
+
+#include "types.h"
+#include "ipc.h"
+
+/* Physical 4KB frames for kernel objects, a 4MB heap after the IPC pool */
+#define KHEAP_START         (IPC_POOL_START + SIZE_4MB)
+#define KHEAP_SIZE          SIZE_4MB
+#define KHEAP_FRAMES        (KHEAP_SIZE / PAGE_4K_SIZE)
+
+#define NUM_KMEM_CACHES     16
+#define KMEM_NAME_LEN       16
+#define KMALLOC_MIN_SIZE    16      /* smallest kmalloc size class */
+#define KMALLOC_MAX_SLAB    2048    /* larger requests get a whole page */
+#define KMALLOC_MAX_SIZE    PAGE_4K_SIZE
+
+/* A cache of equally sized objects carved out of whole pages. Free objects
+ * are kept on a list threaded through the objects themselves, most recently
+ * freed first, so allocation and free are O(1) and hand back warm memory. */
+typedef struct kmem_cache {
+    int8_t name[KMEM_NAME_LEN];
+    uint32_t obj_size;      /* bytes per object, a multiple of 4 */
+    void* free_list;        /* first free object, which holds the next */
+    uint32_t pages;         /* pages carved into objects */
+    uint32_t free_objs;     /* objects on the free list */
+    uint32_t in_use;        /* objects handed out */
+    uint32_t allocs;        /* lifetime allocations */
+    uint32_t frees;         /* lifetime frees */
+    uint32_t grows;         /* times the free list ran dry and a page was added */
+    uint32_t failed;        /* allocations that found no page */
+    uint32_t active;        /* 1 if this entry is a cache */
+} kmem_cache_t;
+
+/* Totals over the whole heap, for meminfo */
+typedef struct kmem_totals {
+    uint32_t free_pages;    /* pages nobody owns */
+    uint32_t cache_pages;   /* pages carved into objects */
+    uint32_t raw_pages;     /* page_alloc and page-sized kmalloc */
+    uint32_t object_bytes;  /* bytes in the objects handed out */
+} kmem_totals_t;
+
+/* Sets up the page allocator and the kmalloc size classes */
+void kmem_init();
+
+/* Takes a free page, NULL if there is none */
+void* page_alloc();
+
+/* Gives a page back */
+void page_free(void* page);
+
+/* Makes a cache of objects of one size, NULL if there is no room for it */
+kmem_cache_t* kmem_cache_create(const int8_t* name, uint32_t size);
+
+/* Takes an object from a cache, NULL if the heap is out of pages */
+void* kmem_cache_alloc(kmem_cache_t* cache);
+
+/* Gives an object back to its cache */
+void kmem_cache_free(kmem_cache_t* cache, void* obj);
+
+/* Allocates size bytes from the smallest size class that fits */
+void* kmalloc(uint32_t size);
+
+/* Frees memory from kmalloc or a cache, NULL is ignored */
+void kfree(void* ptr);
+
+/* Number of pages left in the heap */
+uint32_t kmem_free_pages();
+
+/* Adds up the pages and objects of every cache */
+void kmem_get_totals(kmem_totals_t* totals);
+
+/* Prints the page count and the counters of every cache */
+void kmem_print_stats();
+
+#endif /* _SLAB_H */
@@ -3,6 +3,19 @@
 #include "lib.h"
 #include "x86_desc.h"
 #include "paging.h"
+#include "image_cache.h"
+#include "memstat.h"
+#include "scheduling.h"
+#include "pipe.h"
+#include "shm.h"
+#include "ipc.h"
+#include "poll.h"
+#include "slab.h"
+#include "heap.h"
+
+/* Words of the command being loaded. load_process runs with interrupts off
+ * and never sleeps, so one staging buffer is enough. */
+static uint8_t exec_args[ARG_MAX];
 
 /* 
  * index 0: stdin file operations table pointer (read-only)
@@ -11,11 +24,338 @@
  * index 3: file file operations table pointer
  * index 4: directory file operations table pointer
  */
-file_ops_t fops_table[NUM_FOPS] = {{open_fail, terminal_read, write_fail, close_fail}, {open_fail, read_fail, terminal_write, close_fail},
-    {rtc_open, rtc_read, rtc_write, rtc_close}, {file_open, file_read, file_write, file_close},
-    {directory_open, directory_read, directory_write, directory_close}}; /* array of possible file operations table pointers */
+file_ops_t fops_table[NUM_FOPS] = {{open_fail, terminal_read, write_fail, close_fail, terminal_poll},
+    {open_fail, read_fail, terminal_write, close_fail, poll_always},
+    {rtc_open, rtc_read, rtc_write, rtc_close, rtc_poll}, {file_open, file_read, file_write, file_close, poll_always},
+    {directory_open, directory_read, directory_write, directory_close, poll_always}}; /* array of possible file operations table pointers */
 
 int32_t cur_pid = -1; /* parent ID for the initial process is -1 */
+static kmem_cache_t* fd_table_cache;    /* where each process' descriptor table comes from */
+
+/*
+ * parse_command()
+ *  Description: Splits a command into space separated words in one pass,
+ *               copying each word followed by a null byte into args
+ *  Inputs: command -- the command, null terminated
+ *          args -- buffer of ARG_MAX bytes for the words
+ *          argc -- filled in with the number of words
+ *  Outputs: none
+ *  Return value: number of bytes used in args, -1 if the command is empty or
+ *                its words do not fit in ARG_MAX bytes
+ *  Side effects: none
+ */
+static int32_t parse_command(const uint8_t* command, uint8_t* args, uint32_t* argc) {
+    uint32_t length = 0;
+    uint32_t in_word = 0;
+    *argc = 0;
+    for (; *command != '\0'; command++) {
+        if (*command == ' ') {
+            if (in_word == 1) {
+                args[length++] = '\0';
+                in_word = 0;
+            }
+            continue;
+        }
+        /* leave room for this byte and the null ending its word */
+        if (length + 2 > ARG_MAX) {
+            return -1;
+        }
+        if (in_word == 0) {
+            (*argc)++;
+            in_word = 1;
+        }
+        args[length++] = *command;
+    }
+    if (in_word == 1) {
+        args[length++] = '\0';
+    }
+    return (*argc == 0) ? -1 : (int32_t)length;
+}
+
+/*
+ * build_user_stack()
+ *  Description: Copies the words of a command to the top of the new process's
+ *               user stack and builds argc, argv and an empty envp below them,
+ *               the layout the i386 System V ABI gives _start
+ *  Inputs: process -- PCB of the new process
+ *          args -- words from parse_command
+ *          length -- bytes used in args
+ *          argc -- number of words
+ *  Outputs: none
+ *  Return value: user stack pointer, pointing at argc
+ *  Side effects: the new process's user page must be mapped
+ */
+static uint32_t build_user_stack(pcb_t* process, const uint8_t* args, uint32_t length, uint32_t argc) {
+    uint8_t* strings = (uint8_t*)(USER_PAGE_END - length);
+    uint32_t* sp = (uint32_t*)((uint32_t)strings & ~(PADDING - 1));
+    uint32_t i;
+    memcpy((void*)strings, (const void*)args, length);
+    sp -= argc + 3;     /* argc, argv[argc], argv's null, envp's null */
+    sp[0] = argc;
+    for (i = 0; i < argc; i++) {
+        sp[1 + i] = (uint32_t)strings;
+        while (*strings++ != '\0');    /* skip to the next word */
+    }
+    sp[1 + argc] = 0;   /* end of argv */
+    sp[2 + argc] = 0;   /* no environment variables */
+    process->argc = argc;
+    process->argv = (uint8_t**)&sp[1];
+    return (uint32_t)sp;
+}
+
+/*
+ * program_end()
+ *  Description: Finds where a loaded program's memory ends, its bss included,
+ *               from the ELF program headers, which elfconvert leaves at the
+ *               start of the image
+ *  Inputs: length -- size of the image at VIRT_USER_LOAD
+ *  Outputs: none
+ *  Return value: the address just past the program, at least the end of the image
+ *  Side effects: none
+ */
+static uint32_t program_end(uint32_t length) {
+    uint8_t* image = (uint8_t*)VIRT_USER_LOAD;
+    uint32_t end = VIRT_USER_LOAD + length;
+    uint32_t phoff, phnum, i;
+    elf_phdr_t* phdr;
+    if (length < ELF_HEADER_SIZE) {
+        return end;
+    }
+    phoff = *(uint32_t*)(image + ELF_PHOFF);
+    phnum = *(uint16_t*)(image + ELF_PHNUM);
+    /* a header table that is not in the image is ignored, the image is all there is */
+    if (phoff > length || phnum > (length - phoff) / sizeof(elf_phdr_t)) {
+        return end;
+    }
+    phdr = (elf_phdr_t*)(image + phoff);
+    for (i = 0; i < phnum; i++) {
+        if (phdr[i].type == ELF_PT_LOAD && phdr[i].vaddr >= VIRT_USER_LOAD && phdr[i].vaddr < USER_PAGE_END &&
+            phdr[i].memsz <= USER_PAGE_END - phdr[i].vaddr && phdr[i].vaddr + phdr[i].memsz > end) {
+            end = phdr[i].vaddr + phdr[i].memsz;
+        }
+    }
+    return end;
+}
+
+/*
+ * abandon_process()
+ *  Description: Undoes the parts of load_process done before a late failure
+ *  Inputs: process -- the PCB being set up
+ *  Outputs: none
+ *  Return value: none
+ *  Side effects: frees the PCB and its descriptor table
+ */
+static void abandon_process(pcb_t* process) {
+    if (process->image != NULL) {
+        image_cache_unmap(process->image);
+        process->image = NULL;
+    }
+    process->active = 0;
+    kmem_cache_free(fd_table_cache, process->fd_table);
+}
+
+/*
+ * load_process()
+ *  Description: Parses a command, creates a PCB for the program it names, and
+ *               loads the program into the new process's user page.
+ *  Inputs: command -- the executable file to execute, followed by its arguments
+ *          parent_id -- PID of the parent process, -1 for a terminal's base shell
+ *          term -- terminal the new process runs on
+ *          program_eip -- filled in with the program's entry point
+ *          user_esp -- filled in with the user stack pointer, at argc
+ *  Outputs: none
+ *  Return value: PID of the new process on success, -1 on failure
+ *  Side effects: leaves the new process's user page mapped, must be called with
+ *                interrupts disabled
+ */
+static int32_t load_process(const uint8_t* command, int32_t parent_id, int32_t term, uint32_t* program_eip, uint32_t* user_esp) {
+    int retval;
+    uint32_t program_length;        // size of the executable in bytes
+    uint32_t argc;
+    int32_t args_length;
+    uint32_t image_end, stack_bottom;
+    dentry_t exec_dentry;
+    exec_image_t* image;
+    /* Split the command into words, the first is the program name */
+    if (command == NULL || (args_length = parse_command(command, exec_args, &argc)) == -1) {
+        return -1;
+    }
+    const uint8_t* exec_name = exec_args;
+
+    /* Use the snapshot of the program if we have one, it was checked when it was taken */
+    image = image_cache_lookup(exec_name);
+    if (image != NULL) {
+        *program_eip = image->eip;
+        program_length = image->length;
+    }
+    else {
+        /* Check if file is an executable */
+        if (check_executable(exec_name, &exec_dentry, program_eip) == -1) {
+            return -1;
+        }
+        program_length = ((inode_t *)(in_memory_FS + ( (exec_dentry.inode_number + 1) * FILE_BLOCK_SIZE) ))->length;
+    }
+
+    // CREATE PCB
+
+    /* find the first available PCB in memory and obtain its address */
+    int32_t ret = find_available_pcb();
+    /* if none are available, return -1 */
+    pcb_t* process;
+    if (ret == -1) {
+        return -1;
+    }
+    else {
+        /* if one is available, create a new PCB at that address */
+        process = (pcb_t*)ret;
+    }
+    int32_t pcb_pid = 0;
+    /* obtain the PID for this PCB based on its address */
+    while (ret + ((pcb_pid+1) * EIGHT_KB) < EIGHT_MB) {
+        pcb_pid++;
+    }
+    /* shared with the threads the process clones, halt frees it */
+    process->fd_table = (file_descriptor_t*)kmem_cache_alloc(fd_table_cache);
+    if (process->fd_table == NULL) {
+        return -1;
+    }
+    process->pid = pcb_pid;  /* set the PCB's PID to the calculated value */
+    process->parent_id = parent_id;    /* set the PCB's parent ID */
+    process->term = term;   /* remember which terminal the process belongs to */
+    /* open a file for stdin in index 0 of the file descriptor array */
+    process->fd_table[STDIN].fotp = fops_table[STDIN];  /* set fops field for stdin file operations table */
+    process->fd_table[STDIN].inode = 0;
+    process->fd_table[STDIN].file_position = 0;
+    process->fd_table[STDIN].flags = 1; /* set to active */
+    process->fd_table[STDIN].status_flags = 0;
+    /* open a file for stdout in index 1 of the file descriptor array */
+    process->fd_table[STDOUT].fotp = fops_table[STDOUT];  /* set fops field for stdout file operations table */
+    process->fd_table[STDOUT].inode = 0;
+    process->fd_table[STDOUT].file_position = 0;
+    process->fd_table[STDOUT].flags = 1; /* set to active */
+    process->fd_table[STDOUT].status_flags = 0;
+    /* set all other files to inactive */
+    process->fd_table[2].flags = 0;
+    process->fd_table[3].flags = 0;
+    process->fd_table[4].flags = 0;
+    process->fd_table[5].flags = 0;
+    process->fd_table[6].flags = 0;
+    process->fd_table[7].flags = 0;
+    process->active = 1; /* set the PCB to active */
+    process->detached = 0;
+    process->exit_status = 0;
+    process->kthread = 0;
+    process->syscall = 0;
+    process->cpu_ticks = 0;
+    process->prio = 0;
+    process->slice_ticks = 0;
+    timer_pcb_init(process);
+    process->wait_channel = NULL;
+    process->child_wait.waiters = 0;
+    make_runnable(process);     /* the scheduler may pick it */
+    process->brk = HEAP_START;  /* empty heap */
+    process->group_pid = process->pid;  /* a process is its own thread group */
+    memset((void*)process->shm_map, -1, NUM_SHM_SLOTS);    /* nothing shared yet */
+    process->image = image;
+    strncpy(process->name, (const int8_t*)exec_name, PROC_NAME_LEN - 1);
+    process->name[PROC_NAME_LEN - 1] = '\0';
+
+    /* Set up paging */
+    load_user_program(process->pid); // build the new page directory and switch to it
+    map_user_image(process->pid, program_length);
+    
+    /* Read exec data */
+
+    if (image != NULL) {
+        image_cache_map(image, process->pid);    // share the pristine snapshot, no copy
+    }
+    else {
+        /* Copy the contents of the exec file to the Virtual Memmory address stored by program_eip */
+        retval = read_data(exec_dentry.inode_number, 0, (uint8_t *)VIRT_USER_LOAD, program_length); // **** copy file contents into correct offset in virtual space ****
+        if(retval == -1){
+            process->active = 0;
+            kmem_cache_free(fd_table_cache, process->fd_table);
+            return -1; // failed, contents of the file couldn't copy
+        }
+        /* the rest of the last page is the start of the bss */
+        image_end = VIRT_USER_LOAD + program_length;
+        memset((void*)image_end, 0, ((image_end + PAGE_4K_SIZE - 1) & ~(PAGE_4K_SIZE - 1)) - image_end);
+        image_cache_note_launch(exec_name, exec_dentry.inode_number, program_length, *program_eip);
+    }
+
+    /* The bss and the stack are only reserved, their pages are mapped when touched */
+    if (user_reserve(process->pid, VIRT_USER_LOAD + program_length, program_end(program_length)) == -1) {
+        abandon_process(process);
+        return -1;
+    }
+    /* map the pages build_user_stack writes, down to argc */
+    stack_bottom = ((USER_PAGE_END - args_length) & ~(PADDING - 1)) - (argc + 3) * sizeof(uint32_t);
+    if (user_stack_grow(process->pid, stack_bottom) == -1) {
+        user_release(process->pid);
+        abandon_process(process);
+        return -1;
+    }
+    *user_esp = build_user_stack(process, exec_args, args_length, argc);
+    return process->pid;
+}
+
+/*
+ * exec_process()
+ *  Description: Loads a program and switches to it. The caller does not run
+ *               again until the program halts.
+ *  Inputs: command -- the executable file to execute, followed by its arguments
+ *          parent_id -- PID of the parent process, -1 for a terminal's base shell
+ *          term -- terminal the new process runs on
+ *  Outputs: none
+ *  Return value: the program's halt status on success, -1 on failure
+ *  Side effects: executes a user program
+ */
+static int32_t exec_process(const uint8_t* command, int32_t parent_id, int32_t term) {
+    uint32_t program_eip;           // program start instructions
+    uint32_t user_esp;              // points at argc on the new user stack
+    cli();
+    int32_t pid = load_process(command, parent_id, term, &program_eip, &user_esp);
+    if (pid == -1) {
+        /* put the caller's page back in case the load got that far */
+        if (parent_id != -1) {
+            switch_directory(((pcb_t*)get_pcb_from_pid(parent_id))->group_pid);
+        }
+        sti();
+        return -1;
+    }
+    pcb_t* process = (pcb_t*)get_pcb_from_pid(pid);
+    /* set PCB fields to the values of ESP and EBP */
+    register uint32_t saved_esp asm("esp");
+    process->esp = saved_esp;
+    process->term_esp = saved_esp;
+    register uint32_t saved_ebp asm("ebp");
+    process->ebp = saved_ebp;
+    process->term_ebp = saved_ebp;
+
+    /* the parent sleeps in here until the child halts */
+    if (parent_id != -1) {
+        ((pcb_t*)get_pcb_from_pid(parent_id))->state = PROC_WAITING;
+    }
+    /* the program takes over the terminal if its parent had it */
+    if (parent_id == -1 || get_term_pid(term) == parent_id) {
+        set_term_pid(term, pid); // Updates terminals struct with correct process number
+    }
+    cur_pid = pid;
+    //inc_term_proc(get_cur_term());
+
+    // 8 MB 
+    // prepare for context switching
+    tss.esp0 =  EIGHT_MB - (cur_pid * EIGHT_KB) - PADDING; // kernel stack pointer
+    tss.ss0 = KERNEL_DS;    // kernel data segment (stack segment)
+
+    // push iret context to stack
+
+    iret_call(program_eip, user_esp);
+
+    sti();
+
+    return 0;
+}
 
 /*
  * sys_execute()
@@ -27,150 +367,389 @@ int32_t cur_pid = -1; /* parent ID for the initial process is -1 */
  */
 int32_t sys_exec(const uint8_t* command){
     // puts("exec");
-    int retval;
-    int i;
-    uint8_t * exec_data_block;
-    inode_t * exec_inode;
-    uint32_t program_eip;           // program start instructions
-    /* Check if command is empty */ 
-    if(strlen((const int8_t*)command) == 0){
-        return -1;
-        }
-    int flag = 0;
-    // int length = 0;
-
-    // parsing arguments begins
-    for(i = 0; i < strlen((const int8_t*)command); i++){
-        if(command[i] == ' '){
-            flag = 1;
-            break;
-            }
+    int32_t term;
+    if (cur_pid == -1) {
+        term = get_cur_term();  /* first program on the displayed terminal */
+    }
+    else {
+        term = ((pcb_t*)get_pcb_from_pid(cur_pid))->term;
     }
-    int8_t exec_name[i + 1]; // intialize string to hold exec file's name, add one to account for null character
-    strncpy( (int8_t*)exec_name, (int8_t*)command, i);      // copy exec file's name from command to local string
-    exec_name[i] = '\0';   
+    return exec_process(command, cur_pid, term);
+}
+
+/*
+ * build_entry_frame()
+ *  Description: Makes the first switch to a new process or thread return into
+ *               process_entry, which irets to user mode at the given entry point
+ *  Inputs: process -- PCB of the new process or thread
+ *          eip -- user entry point
+ *          esp -- user stack pointer
+ *  Outputs: none
+ *  Return value: none
+ *  Side effects: writes the top of the new kernel stack and sets sched_esp
+ */
+static void build_entry_frame(pcb_t* process, uint32_t eip, uint32_t esp) {
+    uint32_t* stack = (uint32_t*)(EIGHT_MB - (process->pid * EIGHT_KB) - PADDING);
+    *(--stack) = (uint32_t)process_entry;   /* return address */
+    *(--stack) = 0;     /* EBP */
+    *(--stack) = eip;   /* EBX */
+    *(--stack) = esp;   /* ESI */
+    *(--stack) = 0;     /* EDI */
+    process->sched_esp = (uint32_t)stack;
+}
 
-    /* GET ARGS */
-    int j = 0;
-    /* ignore leading spaces */
-    while(command[i] == ' '){
-        i++;
+/*
+ * spawn_process()
+ *  Description: Loads a program as a new runnable process without switching to
+ *               it. The scheduler starts it at its entry point later.
+ *  Inputs: command -- the executable file to execute, followed by its arguments
+ *          parent_id -- PID of the parent process, -1 for a terminal's base shell
+ *          term -- terminal the new process runs on
+ *  Outputs: none
+ *  Return value: PID of the new process on success, -1 on failure
+ *  Side effects: builds the first kernel stack frame of the new process
+ */
+int32_t spawn_process(const uint8_t* command, int32_t parent_id, int32_t term) {
+    uint32_t flags;
+    uint32_t program_eip;
+    uint32_t user_esp;
+    cli_and_save(flags);
+    int32_t pid = load_process(command, parent_id, term, &program_eip, &user_esp);
+    /* the caller keeps running, so map its page back */
+    if (cur_pid != -1 && ((pcb_t*)get_pcb_from_pid(cur_pid))->kthread == 0) {
+        switch_directory(((pcb_t*)get_pcb_from_pid(cur_pid))->group_pid);
     }
-    int args_size = strlen((const int8_t*)command) - i+1;
-    int8_t args[args_size];
-    /* set args to the arguments from command, after leading spaces */
-    for(i = i; i < strlen((const int8_t*)command); i++){
-         args[j] = command[i];
-         j++;
+    if (pid == -1) {
+        restore_flags(flags);
+        return -1;
     }
-    args[args_size-1] = '\0';   // null terminate
-
-    /* Check if file is an executable */
-    dentry_t exec_dentry;
-    retval = read_dentry_by_name((const uint8_t*)exec_name, &exec_dentry);
-    if(retval == -1){
-        return -1;          // the exec file does not exist or its name is larger than 32 characters
+    pcb_t* process = (pcb_t*)get_pcb_from_pid(pid);
+    /* base shells own their terminal, everything else runs in the background */
+    if (parent_id == -1) {
+        set_term_pid(term, pid);
+    }
+    else {
+        process->detached = 1;
     }
+    build_entry_frame(process, program_eip, user_esp);
+    restore_flags(flags);
+    return pid;
+}
 
-    if(exec_dentry.file_type == EXEC_FILE_TYPE){
-        exec_inode = (inode_t *)(in_memory_FS + ( (exec_dentry.inode_number + 1) * FILE_BLOCK_SIZE) );
-        exec_data_block = (uint8_t *)(in_memory_FS + ((boot_block->inodes_N + 1 + exec_inode->data_block[0]) * FILE_BLOCK_SIZE) );
-        /* Check for MAGIC NUMBER, IDENTIFIER " ELF" */
-        if( exec_data_block[0] == EXEC_IDENT_0 && exec_data_block[1] == EXEC_IDENT_1 && exec_data_block[2] == EXEC_IDENT_2 && exec_data_block[3] == EXEC_IDENT_3){
-                /* FILE IS A CORRECT EXEC */
-                /* GET PROGAM EIP */
-                program_eip = (uint32_t)exec_data_block[EIP_1] << 24 | (uint32_t)exec_data_block[EIP_2] << 16 | (uint32_t)exec_data_block[EIP_3] << 8 | (uint32_t)exec_data_block[EIP_4]; // cocatenate four 1 B values into one 32 bit value 
-                // uint8_t* virtual_user_program = (uint8_t *)program_eip;
-    
+/*
+ * sys_spawn()
+ *  Description: Starts a program in the background and returns right away.
+ *  Inputs: command -- the executable file to execute, followed by its arguments
+ *  Outputs: none
+ *  Return value: PID of the child on success, -1 on failure
+ *  Side effects: the child runs concurrently with the caller
+ */
+int32_t sys_spawn(const uint8_t* command) {
+    if (command == NULL || cur_pid == -1) {
+        return -1;
+    }
+    return spawn_process(command, cur_pid, ((pcb_t*)get_pcb_from_pid(cur_pid))->term);
+}
 
-                // CREATE PCB
+/*
+ * sys_clone()
+ *  Description: Starts a thread that runs func(arg) in the caller's address
+ *               space on the given user stack. The thread shares the caller's
+ *               open files and is collected with waitpid like a spawned child.
+ *  Inputs: func -- user function the thread runs
+ *          arg -- argument passed to func
+ *          stack -- top of the thread's user stack
+ *  Outputs: none
+ *  Return value: PID of the thread on success, -1 on failure
+ *  Side effects: writes arg and a null return address below stack
+ */
+int32_t sys_clone(void (*func)(void* arg), void* arg, uint8_t* stack) {
+    uint32_t flags;
+    uint32_t* user_stack = (uint32_t*)stack;
+    pcb_t* cur_pcb = (pcb_t*)get_pcb_from_pid(cur_pid);
+    pcb_t* thread;
+    /* the function and both stack words must be in the user page */
+    if (cur_pid == -1 || (uint32_t)func < VIRTUAL_USER_PROG || (uint32_t)func >= USER_PAGE_END) {
+        return -1;
+    }
+    if ((uint32_t)stack < VIRTUAL_USER_PROG + 2 * sizeof(uint32_t) || (uint32_t)stack > USER_PAGE_END) {
+        return -1;
+    }
+    cli_and_save(flags);
+    int32_t ret = find_available_pcb();
+    if (ret == -1) {
+        restore_flags(flags);
+        return -1;
+    }
+    thread = (pcb_t*)ret;
+    thread->pid = (EIGHT_MB - ret) / EIGHT_KB - 1;
+    thread->parent_id = cur_pid;
+    thread->group_pid = cur_pcb->group_pid;
+    thread->fd_table = cur_pcb->fd_table;
+    thread->term = cur_pcb->term;
+    thread->argc = cur_pcb->argc;  /* the leader's argv is in the shared page */
+    thread->argv = cur_pcb->argv;
+    thread->active = 1;
+    thread->detached = 1;   /* joined with waitpid */
+    thread->exit_status = 0;
+    thread->kthread = 0;
+    thread->syscall = 0;
+    thread->cpu_ticks = 0;
+    thread->prio = 0;
+    thread->slice_ticks = 0;
+    timer_pcb_init(thread);
+    thread->wait_channel = NULL;
+    thread->child_wait.waiters = 0;
+    thread->image = NULL;   /* the leader holds the image reference */
+    memcpy((void*)thread->name, (const void*)cur_pcb->name, PROC_NAME_LEN);
 
-                cli();
+    /* func sees arg as its only parameter, returning from it faults */
+    *(--user_stack) = (uint32_t)arg;
+    *(--user_stack) = 0;
+    build_entry_frame(thread, (uint32_t)func, (uint32_t)user_stack);
+    make_runnable(thread);
+    restore_flags(flags);
+    return thread->pid;
+}
 
-                /* find the first available PCB in memory and obtain its address */
-                int32_t ret = find_available_pcb();
-                /* if none are available, return -1 */
-                pcb_t* process;
-                if (ret == -1) {
-                    return -1;
-                }
-                else {
-                    /* if one is available, create a new PCB at that address */
-                    process = (pcb_t*)ret;
-                }
-                int32_t pcb_pid = 0;
-                /* obtain the PID for this PCB based on its address */
-                while (ret + ((pcb_pid+1) * EIGHT_KB) < EIGHT_MB) {
-                    pcb_pid++;
-                }
-                process->pid = pcb_pid;  /* set the PCB's PID to the calculated value */
-                process->parent_id = get_term_pid(get_cur_term());    /* set the PCB's parent ID to the previous PCB's PID */
-                cur_pid = process->pid;  /* update cur_pid to be the parent for the next created PCB */
-                /* open a file for stdin in index 0 of the file descriptor array */
-                process->file_descriptor[STDIN].fotp = fops_table[STDIN];  /* set fops field for stdin file operations table */
-                process->file_descriptor[STDIN].inode = 0;
-                process->file_descriptor[STDIN].file_position = 0;
-                process->file_descriptor[STDIN].flags = 1; /* set to active */
-                /* open a file for stdout in index 1 of the file descriptor array */
-                process->file_descriptor[STDOUT].fotp = fops_table[STDOUT];  /* set fops field for stdout file operations table */
-                process->file_descriptor[STDOUT].inode = 0;
-                process->file_descriptor[STDOUT].file_position = 0;
-                process->file_descriptor[STDOUT].flags = 1; /* set to active */
-                /* set all other files to inactive */
-                process->file_descriptor[2].flags = 0;
-                process->file_descriptor[3].flags = 0;
-                process->file_descriptor[4].flags = 0;
-                process->file_descriptor[5].flags = 0;
-                process->file_descriptor[6].flags = 0;
-                process->file_descriptor[7].flags = 0;
-                /* set PCB fields to the values of ESP and EBP */
-                register uint32_t saved_esp asm("esp");
-                process->esp = saved_esp;
-                process->term_esp = saved_esp;
-                register uint32_t saved_ebp asm("ebp");
-                process->ebp = saved_ebp;
-                process->term_ebp = saved_ebp;
-                process->active = 1; /* set the PCB to active */
-
-                update_term_pid(cur_pid); // Updates terminals struct with correct process number
-                //inc_term_proc(get_cur_term());
-
-                /* Copy parsed arguments to the PCB */
-                strncpy((int8_t*)process->arguments, (int8_t*)args, strlen((const int8_t*)args)+1);
-
-                /* Set up paging */
-                load_user_program(cur_pid); // set map from virtual space for user program to physical space
-                flush_tlb(); // flush tlb, (clear cr3)
-    
-                /* Read exec data */
+/*
+ * sys_pipe()
+ *  Description: Creates a pipe and opens a descriptor for each end
+ *  Inputs: fds -- filled in with the read end and the write end
+ *  Outputs: none
+ *  Return value: 0 on success, -1 on failure
+ *  Side effects: takes two file descriptors and a pipe
+ */
+int32_t sys_pipe(int32_t* fds) {
+    int32_t fd, read_fd = -1, write_fd = -1;
+    pipe_t* pipe;
+    pcb_t* cur_pcb = (pcb_t*)get_pcb_from_pid(cur_pid);
+    /* fds must be in the user page or the heap */
+    if (user_range_check(fds, 2 * sizeof(int32_t)) == -1) {
+        return -1;
+    }
+    /* find two free file descriptors */
+    for (fd = FIRST_NON_STD; fd < NUM_FILES; fd++) {
+        if (cur_pcb->fd_table[fd].flags == 0) {
+            if (read_fd == -1) {
+                read_fd = fd;
+            }
+            else {
+                write_fd = fd;
+                break;
+            }
+        }
+    }
+    if (write_fd == -1) {
+        return -1;
+    }
+    pipe = pipe_create();
+    if (pipe == NULL) {
+        return -1;
+    }
+    cur_pcb->fd_table[read_fd].fotp = pipe_read_fops;
+    cur_pcb->fd_table[read_fd].inode = (uint32_t)pipe;  /* inode field holds the pipe */
+    cur_pcb->fd_table[read_fd].file_position = 0;
+    cur_pcb->fd_table[read_fd].flags = 1;
+    cur_pcb->fd_table[read_fd].status_flags = 0;
+    cur_pcb->fd_table[write_fd].fotp = pipe_write_fops;
+    cur_pcb->fd_table[write_fd].inode = (uint32_t)pipe;
+    cur_pcb->fd_table[write_fd].file_position = 0;
+    cur_pcb->fd_table[write_fd].flags = 1;
+    cur_pcb->fd_table[write_fd].status_flags = 0;
+    fds[0] = read_fd;
+    fds[1] = write_fd;
+    return 0;
+}
 
-                /* Copy the contents of the exec file to the Virtual Memmory address stored by program_eip */
-                retval = read_data(exec_dentry.inode_number, 0, (uint8_t *)VIRT_USER_LOAD, exec_inode->length); // **** copy file contents into correct offset in virtual space ****
-                if(retval == -1){
-                    return -1; // failed, contents of the file couldn't copy
-                }
-                // 8 MB 
-                // prepare for context switching
-                tss.esp0 =  EIGHT_MB - (cur_pid * EIGHT_KB) - PADDING; // kernel stack pointer
-                tss.ss0 = KERNEL_DS;    // kernel data segment (stack segment)
+/*
+ * sys_spawnio()
+ *  Description: Starts a program in the background like sys_spawn, with its
+ *               stdin and/or stdout replaced by a pipe end of the caller
+ *  Inputs: command -- the executable file to execute, followed by its arguments
+ *          in_fd -- read end to use as stdin, -1 to keep the terminal
+ *          out_fd -- write end to use as stdout, -1 to keep the terminal
+ *  Outputs: none
+ *  Return value: PID of the child on success, -1 on failure
+ *  Side effects: the child holds its own reference to the pipe ends
+ */
+int32_t sys_spawnio(const uint8_t* command, int32_t in_fd, int32_t out_fd) {
+    uint32_t flags;
+    int32_t pid;
+    pcb_t* cur_pcb = (pcb_t*)get_pcb_from_pid(cur_pid);
+    pcb_t* child;
+    if (command == NULL || cur_pid == -1) {
+        return -1;
+    }
+    if (in_fd != -1 && (in_fd < 0 || in_fd >= NUM_FILES || cur_pcb->fd_table[in_fd].flags == 0 || cur_pcb->fd_table[in_fd].fotp.read != pipe_read)) {
+        return -1;
+    }
+    if (out_fd != -1 && (out_fd < 0 || out_fd >= NUM_FILES || cur_pcb->fd_table[out_fd].flags == 0 || cur_pcb->fd_table[out_fd].fotp.write != pipe_write)) {
+        return -1;
+    }
+    /* the child must not run before its descriptors are in place */
+    cli_and_save(flags);
+    pid = spawn_process(command, cur_pid, cur_pcb->term);
+    if (pid != -1) {
+        child = (pcb_t*)get_pcb_from_pid(pid);
+        if (in_fd != -1) {
+            child->fd_table[STDIN] = cur_pcb->fd_table[in_fd];
+            child->fd_table[STDIN].status_flags = 0;
+            pipe_dup(&child->fd_table[STDIN]);
+        }
+        if (out_fd != -1) {
+            child->fd_table[STDOUT] = cur_pcb->fd_table[out_fd];
+            child->fd_table[STDOUT].status_flags = 0;
+            pipe_dup(&child->fd_table[STDOUT]);
+        }
+    }
+    restore_flags(flags);
+    return pid;
+}
 
-                // push iret context to stack
+/*
+ * sys_isatty()
+ *  Description: Tells whether a descriptor is the terminal, so programs can
+ *               read stdin only when it was redirected
+ *  Inputs: fd -- the descriptor to check
+ *  Outputs: none
+ *  Return value: 1 if fd is the keyboard or the screen, 0 otherwise, -1 if fd is not open
+ *  Side effects: none
+ */
+int32_t sys_isatty(int32_t fd) {
+    pcb_t* cur_pcb = (pcb_t*)get_pcb_from_pid(cur_pid);
+    if (fd < 0 || fd >= NUM_FILES || cur_pcb->fd_table[fd].flags == 0) {
+        return -1;
+    }
+    return (cur_pcb->fd_table[fd].fotp.read == terminal_read || cur_pcb->fd_table[fd].fotp.write == terminal_write);
+}
 
-                iret_call(program_eip);
+/*
+ * sys_fcntl()
+ *  Description: Gets or sets the status flags of a descriptor. O_NONBLOCK
+ *               is the only flag.
+ *  Inputs: fd -- the descriptor
+ *          cmd -- F_GETFL or F_SETFL
+ *          arg -- the new flags for F_SETFL
+ *  Outputs: none
+ *  Return value: the flags for F_GETFL, 0 for F_SETFL, -1 on failure
+ *  Side effects: threads share the change since they share descriptors
+ */
+int32_t sys_fcntl(int32_t fd, int32_t cmd, uint32_t arg) {
+    pcb_t* cur_pcb = (pcb_t*)get_pcb_from_pid(cur_pid);
+    if (fd < 0 || fd >= NUM_FILES || cur_pcb->fd_table[fd].flags == 0) {
+        return -1;
+    }
+    if (cmd == F_GETFL) {
+        return cur_pcb->fd_table[fd].status_flags;
+    }
+    if (cmd == F_SETFL && (arg & ~O_NONBLOCK) == 0) {
+        cur_pcb->fd_table[fd].status_flags = arg;
+        return 0;
+    }
+    return -1;
+}
 
-                sti();
+/*
+ * fd_nonblocking()
+ *  Description: Lets drivers check a descriptor's mode before they wait
+ *  Inputs: fd -- a descriptor of the current process
+ *  Outputs: none
+ *  Return value: 1 if O_NONBLOCK is set, 0 otherwise or if no process runs
+ *  Side effects: none
+ */
+int32_t fd_nonblocking(uint32_t fd) {
+    if (cur_pid == -1 || fd >= NUM_FILES) {
+        return 0;   /* kernel tests call the drivers directly */
+    }
+    return (((pcb_t*)get_pcb_from_pid(cur_pid))->fd_table[fd].status_flags & O_NONBLOCK) != 0;
+}
 
-                return 0;
+/*
+ * sys_waitpid()
+ *  Description: Collects the exit status of a spawned child.
+ *  Inputs: pid -- PID of the child to wait for, -1 for any child
+ *          status -- filled in with the child's halt status, may be NULL
+ *          options -- WAIT_NOHANG to return right away if no child has halted
+ *  Outputs: none
+ *  Return value: PID of the collected child, 0 if WAIT_NOHANG was given and no
+ *                child has halted yet, -1 if there is no such child
+ *  Side effects: blocks the caller until a child halts unless WAIT_NOHANG is given
+ */
+int32_t sys_waitpid(int32_t pid, int32_t* status, int32_t options) {
+    int i;
+    uint32_t flags;
+    int32_t found;
+    pcb_t* child;
+    pcb_t* cur_pcb = (pcb_t*)get_pcb_from_pid(cur_pid);
+    /* status must point into the user page or the heap if it is given */
+    if (status != NULL && user_range_check(status, sizeof(int32_t)) == -1) {
+        return -1;
+    }
+    cli_and_save(flags);
+    while (1) {
+        found = 0;
+        for (i = 0; i < NUM_PROCESS; i++) {
+            child = (pcb_t*)get_pcb_from_pid(i);
+            if (child->active == 0 || child->detached == 0 || child->parent_id != cur_pid) {
+                continue;
+            }
+            if (pid != -1 && child->pid != pid) {
+                continue;
+            }
+            found = 1;
+            if (child->state == PROC_ZOMBIE) {
+                /* reap it and hand back its status */
+                if (status != NULL) {
+                    *status = child->exit_status;
+                }
+                child->active = 0;
+                restore_flags(flags);
+                return child->pid;
+            }
         }
-        else {
-            return -1;  /* file is not an executable so return -1 */
+        if (found == 0) {
+            restore_flags(flags);
+            return -1;  /* nothing to wait for */
+        }
+        if (options & WAIT_NOHANG) {
+            restore_flags(flags);
+            return 0;
         }
+        /* sleep until one of our children halts */
+        sleep_on(&cur_pcb->child_wait);
+    }
+}
+
+/*
+ * check_executable()
+ *  Description: Checks that a file exists, is a regular file, and starts with the
+ *               ELF magic number, then reads its entry point out of the header.
+ *  Inputs: name -- the name of the file to check
+ *          dentry -- filled in with the file's directory entry
+ *          eip -- filled in with the program's entry point
+ *  Outputs: none
+ *  Return value: 0 if the file is an executable, -1 otherwise
+ *  Side effects: none
+ */
+int32_t check_executable(const uint8_t* name, struct dentry_t* dentry, uint32_t* eip) {
+    inode_t * exec_inode;
+    uint8_t * exec_data_block;
+    if (read_dentry_by_name(name, dentry) == -1) {
+        return -1;          // the exec file does not exist or its name is larger than 32 characters
     }
     // Name of File is not a regular file (labeled 2): either a directory (label 1) or rtc (label 0)
-    else{
+    if (dentry->file_type != EXEC_FILE_TYPE) {
         return -1;
-        }
-
+    }
+    exec_inode = (inode_t *)(in_memory_FS + ( (dentry->inode_number + 1) * FILE_BLOCK_SIZE) );
+    exec_data_block = (uint8_t *)(in_memory_FS + ((boot_block->inodes_N + 1 + exec_inode->data_block[0]) * FILE_BLOCK_SIZE) );
+    /* Check for MAGIC NUMBER, IDENTIFIER " ELF" */
+    if (exec_data_block[0] != EXEC_IDENT_0 || exec_data_block[1] != EXEC_IDENT_1 || exec_data_block[2] != EXEC_IDENT_2 || exec_data_block[3] != EXEC_IDENT_3) {
+        return -1;  /* file is not an executable so return -1 */
+    }
+    /* GET PROGAM EIP */
+    *eip = (uint32_t)exec_data_block[EIP_1] << 24 | (uint32_t)exec_data_block[EIP_2] << 16 | (uint32_t)exec_data_block[EIP_3] << 8 | (uint32_t)exec_data_block[EIP_4]; // cocatenate four 1 B values into one 32 bit value 
     return 0;
 }
 
@@ -232,11 +811,72 @@ int32_t sys_halt (uint8_t status) {
     else {
         retval = 0; /* otherwise set return value to 0 */
     }
-    /* close all of the files (stdin and stdout will NOT be closed due to parameter checks) */
-    for (i = 0; i < NUM_FILES; i++) {
-        sys_close(i);
-    }
     pcb_t* process = (pcb_t*)get_pcb_from_pid(cur_pid); /* obtain a pointer to the current PCB */
+    cli();
+    timer_pcb_release(process);     /* the PCB may be reused before a timer would go off */
+    /* the process' threads cannot outlive its address space, so they are
+     * stopped before anything they share is torn down */
+    if (process->group_pid == process->pid) {
+        for (i = 0; i < NUM_PROCESS; i++) {
+            pcb_t* thread = (pcb_t*)get_pcb_from_pid(i);
+            if (thread->active != 0 && thread->pid != process->pid && thread->kthread == 0 && thread->group_pid == process->pid) {
+                leave_wait_queue(thread);
+                thread->active = 0;
+                timer_pcb_release(thread);
+            }
+        }
+    }
+    /* the files belong to the whole process, so a thread leaves them open */
+    if (process->group_pid == process->pid) {
+        /* close all of the files (stdin and stdout will NOT be closed due to parameter checks) */
+        for (i = 0; i < NUM_FILES; i++) {
+            sys_close(i);
+        }
+        /* stdin and stdout may be pipe ends, whose other side waits for them to close */
+        for (i = STDIN; i <= STDOUT; i++) {
+            if (process->fd_table[i].flags == 1) {
+                process->fd_table[i].flags = 0;
+                process->fd_table[i].fotp.close(i);
+            }
+        }
+        kmem_cache_free(fd_table_cache, process->fd_table);
+        process->fd_table = NULL;
+        shm_detach_all(process->pid);
+        ipc_release(process->pid);
+        heap_release(process->pid);
+        user_release(process->pid);
+        if (process->image != NULL) {
+            image_cache_unmap(process->image);
+            process->image = NULL;
+        }
+    }
+    /* children we spawned but never collected are freed when they halt */
+    for (i = 0; i < NUM_PROCESS; i++) {
+        pcb_t* child = (pcb_t*)get_pcb_from_pid(i);
+        if (child->active != 0 && child->detached != 0 && child->parent_id == cur_pid) {
+            child->parent_id = -1;
+            if (child->state == PROC_ZOMBIE) {
+                child->active = 0;
+            }
+        }
+    }
+    /* a spawned process stays around as a zombie until its parent collects it */
+    if (process->detached != 0) {
+        process->exit_status = (retval == EXCEPTION) ? EXCEPTION : status;
+        process->state = PROC_ZOMBIE;
+        if (process->parent_id == -1) {
+            process->active = 0;    /* nobody will collect it */
+        }
+        else {
+            /* a parent in waitpid checks its children again */
+            wake_up(&((pcb_t*)get_pcb_from_pid(process->parent_id))->child_wait);
+        }
+        if (process->group_pid == process->pid) {
+            unload_vidmem(process->pid);
+            tlb_commit();
+        }
+        schedule();     /* never comes back */
+    }
     /* if the process is active, set it to inactive */
     if (process->active != 0){
         process->active = 0;
@@ -244,8 +884,8 @@ int32_t sys_halt (uint8_t status) {
     /* check if the current process is the base process */
     if (process->parent_id == -1) {
         cur_pid = -1;
-        update_term_pid(cur_pid);
-        sys_exec((const uint8_t*)"shell");  /* if it is, execute shell to re-initialize everything */
+        set_term_pid(process->term, cur_pid);
+        exec_process((const uint8_t*)"shell", -1, process->term);  /* if it is, execute shell to re-initialize everything */
     }
     else {
         /* otherwise, obtain a pointer to the PCB of the parent process */    
@@ -257,17 +897,22 @@ int32_t sys_halt (uint8_t status) {
 
         /* Unmap Current Process Frame From the  Physical Space */
         unload_user_program(cur_pid);
-        /* Map Current Parent's Process Page Physical Space */
-        load_user_program(parent->pid);
 
-        /* Unmap Video Mem Page */
-        unload_vidmem();
+        /* Unmap Video Mem Page, which a thread shares with the rest of its group */
+        if (process->group_pid == process->pid) {
+            unload_vidmem(process->pid);
+        }
 
-        flush_tlb();    /* flush TLB */
+        /* Switch back to the parent's page directory, this also flushes the TLB */
+        switch_directory(parent->group_pid);
 
         parent->active = 1; /* set the parent process to active */
+        make_runnable(parent);  /* the parent's exec returns now */
+        /* give the terminal back to the parent */
+        if (get_term_pid(process->term) == process->pid) {
+            set_term_pid(process->term, parent->pid);
+        }
         cur_pid = parent->pid;  /* set the current PID to the parent's PID */
-        update_term_pid(cur_pid);
         //dec_term_proc(get_cur_term());
         halt_return(process->esp, process->ebp, status);
     }
@@ -288,9 +933,10 @@ int32_t sys_open(const uint8_t* filename){
     /* parameter check */
     if (filename == NULL) {return -1;}
     dentry_t entry;
+    /* kernel special files have no directory entry */
+    int special = is_meminfo(filename);
     /* obtain directory entry corresponding to the filename */
-    int retval = read_dentry_by_name((const uint8_t*)filename, &entry);
-    if(retval == -1) {
+    if (special == 0 && read_dentry_by_name((const uint8_t*)filename, &entry) == -1) {
         return -1;  /* return -1 if read_dentry failed */
     }
     uint32_t fd = 0;
@@ -301,37 +947,48 @@ int32_t sys_open(const uint8_t* filename){
     for (i = 0; i < NUM_FILES; i++) {
         fd = i;
         /* if flags is 0, the current fd is not in-use so break */
-        if (cur_pcb->file_descriptor[fd].flags == 0) {break;}
+        if (cur_pcb->fd_table[fd].flags == 0) {break;}
     }
     if (i == NUM_FILES) {return -1;}    /* all fd's are in-use, so return -1 */
+    /* check if file is the memory statistics */
+    if (special == 1) {
+        cur_pcb->fd_table[fd].fotp = meminfo_fops;
+        cur_pcb->fd_table[fd].inode = 0; /* no snapshot until the first read */
+        cur_pcb->fd_table[fd].file_position = 0;
+        cur_pcb->fd_table[fd].flags = 1;
+        cur_pcb->fd_table[fd].status_flags = 0;
+    }
     /* check if file is the RTC */
-    if (entry.file_type == RTC_TYPE) {
+    else if (entry.file_type == RTC_TYPE) {
         /* set the file ops table pointer to that of the RTC */
-        cur_pcb->file_descriptor[fd].fotp = fops_table[RTC_FOTP];
-        cur_pcb->file_descriptor[fd].inode = 0; /* inode field is 0 for RTC */
-        cur_pcb->file_descriptor[fd].file_position = 0; /* set position to 0 */
-        cur_pcb->file_descriptor[fd].flags = 1; /* set file descriptor to in-use */
+        cur_pcb->fd_table[fd].fotp = fops_table[RTC_FOTP];
+        cur_pcb->fd_table[fd].inode = 0; /* inode field is 0 for RTC */
+        cur_pcb->fd_table[fd].file_position = 0; /* set position to 0 */
+        cur_pcb->fd_table[fd].flags = 1; /* set file descriptor to in-use */
+        cur_pcb->fd_table[fd].status_flags = 0;
     }
     /* check if file is a directory */
     else if (entry.file_type == DIR_TYPE) {
         /* set the file ops table pointer to that of a directory */
-        cur_pcb->file_descriptor[fd].fotp = fops_table[DIR_FOTP];
-        cur_pcb->file_descriptor[fd].inode = 0; /* inode field is 0 for directory */
-        cur_pcb->file_descriptor[fd].file_position = 0; /* set position to 0 */
-        cur_pcb->file_descriptor[fd].flags = 1; /* set file descriptor to in-use */
+        cur_pcb->fd_table[fd].fotp = fops_table[DIR_FOTP];
+        cur_pcb->fd_table[fd].inode = 0; /* inode field is 0 for directory */
+        cur_pcb->fd_table[fd].file_position = 0; /* set position to 0 */
+        cur_pcb->fd_table[fd].flags = 1; /* set file descriptor to in-use */
+        cur_pcb->fd_table[fd].status_flags = 0;
     }
     else if (entry.file_type == F_TYPE) {
         /* set the file ops table pointer to that of a file */
-        cur_pcb->file_descriptor[fd].fotp = fops_table[FILE_FOTP];
-        cur_pcb->file_descriptor[fd].inode = entry.inode_number; /* set inode field to inode of this file */
-        cur_pcb->file_descriptor[fd].file_position = 0; /* set position to 0 */
-        cur_pcb->file_descriptor[fd].flags = 1; /* set file descriptor to in-use */
+        cur_pcb->fd_table[fd].fotp = fops_table[FILE_FOTP];
+        cur_pcb->fd_table[fd].inode = entry.inode_number; /* set inode field to inode of this file */
+        cur_pcb->fd_table[fd].file_position = 0; /* set position to 0 */
+        cur_pcb->fd_table[fd].flags = 1; /* set file descriptor to in-use */
+        cur_pcb->fd_table[fd].status_flags = 0;
     }
     else {
         return -1;
     }
     /* call the file's corresponding open function */
-    int ret = cur_pcb->file_descriptor[fd].fotp.open(filename);
+    int ret = cur_pcb->fd_table[fd].fotp.open(filename);
     if (ret == -1) {
         return -1;  /* if the open failed, return -1 */
     }
@@ -354,12 +1011,12 @@ int32_t sys_close(uint32_t fd){
     if (fd < FIRST_NON_STD || fd > NUM_FILES-1) {return -1;}
     /* obtain a pointer to the current PCB */
     pcb_t* cur_pcb = (pcb_t*)get_pcb_from_pid(cur_pid);
-    if (cur_pcb->file_descriptor[fd].flags != 1) {
+    if (cur_pcb->fd_table[fd].flags != 1) {
         return -1;
     }
-    cur_pcb->file_descriptor[fd].flags = 0; /* mark file descriptor as not in-use */
+    cur_pcb->fd_table[fd].flags = 0; /* mark file descriptor as not in-use */
     /* call the file's corresponding close function */
-    return cur_pcb->file_descriptor[fd].fotp.close(fd);
+    return cur_pcb->fd_table[fd].fotp.close(fd);
 }
 
 /*
@@ -376,11 +1033,11 @@ int32_t sys_write(uint32_t fd, const void* buf, uint32_t nbytes){
     /* obtain a pointer to the current PCB */
     pcb_t* available_pcb = (pcb_t*)get_pcb_from_pid(cur_pid);
     /* parameter checks */
-    if (fd < 0 || fd > NUM_FILES-1 || buf == NULL || nbytes < 0 || available_pcb->file_descriptor[fd].flags == 0){
+    if (fd < 0 || fd > NUM_FILES-1 || buf == NULL || nbytes < 0 || available_pcb->fd_table[fd].flags == 0){
         return -1;
     }
     /* call the file's corresponding write function */
-    return available_pcb->file_descriptor[fd].fotp.write(fd, buf, nbytes);
+    return available_pcb->fd_table[fd].fotp.write(fd, buf, nbytes);
 }
 
 /*
@@ -397,11 +1054,23 @@ int32_t sys_read(uint32_t fd, void* buf, uint32_t nbytes){
     /* obtain a pointer to the current PCB */
     pcb_t* available_pcb = (pcb_t*)get_pcb_from_pid(cur_pid);
     /* parameter checks */
-    if (fd < 0 || fd > NUM_FILES-1 || buf == NULL || nbytes < 0 || available_pcb->file_descriptor[fd].flags == 0){
+    if (fd < 0 || fd > NUM_FILES-1 || buf == NULL || nbytes < 0 || available_pcb->fd_table[fd].flags == 0){
         return -1;
     }
     /* call the file's corresponding read function */
-    return available_pcb->file_descriptor[fd].fotp.read(fd, buf, nbytes);
+    return available_pcb->fd_table[fd].fotp.read(fd, buf, nbytes);
+}
+
+/*
+ * fd_table_init()
+ *  Description: Makes the slab cache for descriptor tables
+ *  Inputs: none
+ *  Outputs: none
+ *  Return value: none
+ *  Side effects: call after kmem_init
+ */
+void fd_table_init() {
+    fd_table_cache = kmem_cache_create((const int8_t*)"fd_table", NUM_FILES * sizeof(file_descriptor_t));
 }
 
 /*
@@ -416,38 +1085,98 @@ int32_t get_cur_pid() {
     return cur_pid; /* return the current PCB's PID */
 }
 
+/*
+ * syscall_enter()
+ *  Description: Notes the system call the current process entered, so TLB
+ *               flushes are counted against it. Called by system_call.
+ *  Inputs: num -- the system call number
+ *  Outputs: none
+ *  Return value: none
+ *  Side effects: sets the PCB's syscall field
+ */
+void syscall_enter(uint32_t num) {
+    if (cur_pid != -1) {
+        ((pcb_t*)get_pcb_from_pid(cur_pid))->syscall = num;
+    }
+}
+
+/*
+ * syscall_exit()
+ *  Description: Notes that the current process left its system call
+ *  Inputs: none
+ *  Outputs: none
+ *  Return value: none
+ *  Side effects: clears the PCB's syscall field
+ */
+void syscall_exit() {
+    if (cur_pid != -1) {
+        ((pcb_t*)get_pcb_from_pid(cur_pid))->syscall = 0;
+    }
+}
+
+/*
+ * set_cur_pid()
+ *  Description: Sets the PID of the running process, used by the scheduler.
+ *  Inputs: pid -- the PID of the process being switched to
+ *  Outputs: none
+ *  Return value: none
+ *  Side effects: changes which PCB the system calls operate on
+ */
+void set_cur_pid(int32_t pid) {
+    cur_pid = pid;
+}
+
 /*
  * sys_getargs()
- *  Description: Store the arguments of the current process into a passed in buffer.
+ *  Description: Compatibility shim for programs written before argv. Joins
+ *               argv[1] onward with single spaces into a passed in buffer.
  *  Inputs: buf -- the buffer to copy the arguments into
- *          nbytes -- number of bytes to copy into buffer
+ *          nbytes -- size of the buffer
  *  Outputs: none
- *  Return value: 0 on success, -1 on failure
+ *  Return value: 0 on success, -1 if there are no arguments or they and a
+ *                null byte do not fit in nbytes
  *  Side effects: none
  */
 int32_t sys_getargs (uint8_t* buf, int32_t nbytes){
     pcb_t* cur_pcb = (pcb_t*)get_pcb_from_pid(cur_pid);
+    uint32_t i;
+    int32_t length = 0;
+    uint8_t* arg;
     /* No Arguments */
-    if(strlen((const int8_t*)cur_pcb->arguments) == 0){
+    if (cur_pcb->argc <= 1 || nbytes <= 0) {
         return -1;
     }
-    /* Invalid number of bytes to be copied to buffer */
-    if (nbytes <= 0) {
+    if (user_range_check(buf, nbytes) == -1) {
         return -1;
     }
-    /* nbytes is greater than length of arguments, so only copy the length of arguments */
-    if(nbytes > (strlen((const int8_t*)cur_pcb->arguments) + 1)){
-         strncpy((int8_t*)buf, (int8_t*)cur_pcb->arguments, (strlen((const int8_t*)cur_pcb->arguments) + 1));
-         return 0;
+    for (i = 1; i < cur_pcb->argc; i++) {
+        arg = cur_pcb->argv[i];
+        /* argv lives in user memory, the program may have changed it */
+        if ((uint32_t)arg < VIRTUAL_USER_PROG || (uint32_t)arg >= USER_PAGE_END) {
+            return -1;
+        }
+        if (i > 1) {
+            if (length + 1 >= nbytes) {
+                return -1;
+            }
+            buf[length++] = ' ';
+        }
+        for (; (uint32_t)arg < USER_PAGE_END && *arg != '\0'; arg++) {
+            if (length + 1 >= nbytes) {
+                return -1;
+            }
+            buf[length++] = *arg;
+        }
     }
-    /* Otherwise, copy nbytes from current arguments into the buffer */
-    strncpy((int8_t*)buf, (int8_t*)cur_pcb->arguments, nbytes);
+    buf[length] = '\0';
     return 0;
 }
 
 /*
  * sys_vidmap()
- *  Description: Maps virtual video memory to physical video memory and updates screen_start.
+ *  Description: Maps virtual video memory to the screen of the caller's terminal and updates
+ *               screen_start. While the terminal is hidden that is its save page, so a
+ *               program in the background never draws over the displayed terminal.
  *  Inputs: screen_start -- pointer in the user program page to set to virtual video memory
  *  Outputs: none
  *  Return value: updated screen_start on success, -1 on failure
@@ -456,14 +1185,21 @@ int32_t sys_getargs (uint8_t* buf, int32_t nbytes){
 int32_t sys_vidmap (uint8_t** screen_start){
  
     /* Check if within range of user-level page */
-    if ((uint32_t)screen_start < VIRTUAL_USER_PROG || (uint32_t)screen_start > USER_PAGE_END) {
+    if (user_range_check(screen_start, sizeof(uint8_t*)) == -1) {
         return -1;
     }
 
     /* Dereference screen_start and set it to the virtual address of video memory */
+    uint32_t flags;
+    pcb_t* leader = (pcb_t*)get_pcb_from_pid(((pcb_t*)get_pcb_from_pid(cur_pid))->group_pid);
     *screen_start = (uint8_t*)(USER_VIDMEM);
-    load_vidmem(*screen_start); // set up new page for video memory
-    flush_tlb();
+    /* the group's own page, showing its terminal's screen wherever that is now;
+       a terminal switch can't move it in between */
+    cli_and_save(flags);
+    load_vidmem(leader->pid, term_video_page(leader->term));
+    tlb_invalidate(USER_VIDMEM);    // a second vidmap may find it mapped
+    tlb_commit();
+    restore_flags(flags);
     /* Return updated value of screen_start */
     return (int32_t)screen_start;
 }
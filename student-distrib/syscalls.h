@@ -5,6 +5,9 @@
 #include "rtc.h"
 #include "keyboard.h"
 #include "file_system_driver.h"
+#include "paging.h"
+#include "scheduling.h"
+#include "timer.h"
 #define EXEC_FILE_TYPE  2
 #define EXEC_IDENT_0    0x7F
 #define EXEC_IDENT_1    0x45
@@ -13,8 +16,9 @@
 #define NUM_FOPS        5
 #define EIGHT_MB        0x800000
 #define EIGHT_KB        0x2000
-#define NUM_PROCESS     6
+#define NUM_PROCESS     8
 #define NUM_FILES       8
+#define NUM_SHM_SLOTS   16
 #define PADDING         4
 #define EXCEPTION       256
 #define FIRST_NON_STD   2
@@ -32,6 +36,17 @@
 #define EIP_3           25
 #define EIP_4           24
 #define USER_PAGE_END   0x8400000
+#define USER_STACK      0x83FFFFC
+#define ELF_HEADER_SIZE 52      /* bytes of the ELF header */
+#define ELF_PHOFF       28      /* offset of the program header table */
+#define ELF_PHNUM       44      /* number of program headers, 16 bits */
+#define ELF_PT_LOAD     1       /* program header type of a loaded segment */
+#define ARG_MAX         4096    /* bytes of argument strings a command may have */
+#define WAIT_NOHANG     1
+#define F_GETFL         3       /* fcntl: return a descriptor's status flags */
+#define F_SETFL         4       /* fcntl: replace a descriptor's status flags */
+#define O_NONBLOCK      0x800   /* reads and writes return WOULD_BLOCK instead of waiting */
+#define WOULD_BLOCK     (-2)    /* returned by a non-blocking read or write that would wait */
 
 // Function prototypes for checkpoint 3
 
@@ -42,7 +57,7 @@ extern void system_call();
 extern void flush_tlb();
 
 /* Sets up stack and iret */
-extern void iret_call(uint32_t program_eip);
+extern void iret_call(uint32_t program_eip, uint32_t user_esp);
 
 /* Returns to parent process to halt program */
 extern void halt_return(uint32_t save_esp, uint32_t save_ebp, uint8_t status);
@@ -74,6 +89,36 @@ extern int32_t sys_getargs (uint8_t* buf, int32_t nbytes);
 /* Maps virtual video memory to physical video memory */
 extern int32_t sys_vidmap (uint8_t** screen_start);
 
+/* Starts a program in the background and returns its PID */
+extern int32_t sys_spawn(const uint8_t* command);
+
+/* Collects the exit status of a spawned child */
+extern int32_t sys_waitpid(int32_t pid, int32_t* status, int32_t options);
+
+/* Starts a thread in the caller's address space */
+extern int32_t sys_clone(void (*func)(void* arg), void* arg, uint8_t* stack);
+
+/* Creates a pipe and returns its read and write descriptors */
+extern int32_t sys_pipe(int32_t* fds);
+
+/* Starts a program in the background with its stdin or stdout on a pipe */
+extern int32_t sys_spawnio(const uint8_t* command, int32_t in_fd, int32_t out_fd);
+
+/* Returns 1 if a descriptor is the terminal */
+extern int32_t sys_isatty(int32_t fd);
+
+/* Gets or sets a descriptor's status flags */
+extern int32_t sys_fcntl(int32_t fd, int32_t cmd, uint32_t arg);
+
+/* Returns 1 if a descriptor of the current process is in non-blocking mode */
+extern int32_t fd_nonblocking(uint32_t fd);
+
+/* Loads a program as a new runnable process without switching to it */
+extern int32_t spawn_process(const uint8_t* command, int32_t parent_id, int32_t term);
+
+/* Sets the PID of the running process */
+extern void set_cur_pid(int32_t pid);
+
 /* Returns -1 */
 extern int32_t sys_set_handler (int32_t signum, void* handler_address);
 
@@ -86,6 +131,7 @@ typedef struct file_ops{
     int32_t (*read)(uint32_t fd, void* buf, uint32_t nbytes);   /* read function */
     int32_t (*write)(uint32_t fd, const void* buf, uint32_t nbytes);    /* write function */
     int32_t (*close)(uint32_t fd);  /* close function */
+    int32_t (*poll)(uint32_t fd);   /* returns the POLLIN/POLLOUT/POLLHUP events that are ready */
 } file_ops_t;
 
 /* Structure for the file descriptor of a PCB */
@@ -94,21 +140,80 @@ typedef struct file_descriptor{
     uint32_t inode; /* inode number for this file */
     uint32_t file_position; /* current position within the file */
     uint32_t flags; /* 1 if file is open, 0 otherwise */
+    uint32_t status_flags;  /* O_NONBLOCK or 0, set with fcntl */
 } file_descriptor_t;
 
+/* ELF program header, one per segment */
+typedef struct elf_phdr {
+    uint32_t type;      /* ELF_PT_LOAD for the segments in memory */
+    uint32_t offset;
+    uint32_t vaddr;     /* where the segment starts */
+    uint32_t paddr;
+    uint32_t filesz;
+    uint32_t memsz;     /* bytes in memory, past filesz is bss */
+    uint32_t flags;
+    uint32_t align;
+} elf_phdr_t;
+
+struct exec_image;
+
 /* Structure for a PCB */
 typedef struct pcb{
     int32_t pid;    /* process ID */
     int32_t parent_id;  /* parent's process ID */
-    file_descriptor_t file_descriptor[8];   /* file descriptor table for this process */
     uint32_t esp;   /* saved stack pointer */
     uint32_t ebp;   /* saved base pointer */
     uint32_t term_esp;
     uint32_t term_ebp;
     uint32_t active;    /* 1 if PCB is active, 0 otherwise */
-    uint8_t arguments[128];
+    uint32_t argc;      /* number of words in the command, including the program name */
+    uint8_t** argv;     /* argument vector on the user stack of the thread group */
+    uint32_t state;     /* PROC_RUNNING, PROC_WAITING or PROC_ZOMBIE */
+    uint32_t sched_esp; /* kernel stack pointer saved when the scheduler switches away */
+    int32_t run_next;   /* next pid on the same run queue, -1 at the tail */
+    uint32_t on_rq;     /* 1 while queued, the state may have changed since */
+    uint32_t cpu_ticks; /* PIT ticks the process was running for */
+    uint32_t prio;      /* feedback level, 0 is served first */
+    uint32_t slice_ticks;   /* ticks run at this level since the slice started */
+    int32_t term;       /* terminal the process runs on */
+    uint32_t detached;  /* 1 if started by spawn, so the parent collects it with waitpid */
+    int32_t exit_status;    /* halt status kept for waitpid */
+    uint32_t kthread;   /* 1 for kernel threads, which have no user program page */
+    int32_t group_pid;  /* process whose user page this runs in, own PID unless it is a thread */
+    file_descriptor_t* fd_table;    /* NUM_FILES descriptors from the kernel heap, shared by the threads of a process */
+    void* wait_channel; /* wait queue the process sleeps on, NULL if none */
+    int8_t shm_map[NUM_SHM_SLOTS];  /* shared memory segment attached in each 4MB slot from 192MB, -1 if none */
+    uint32_t futex_key; /* key of the futex the process sleeps on, see futex_key */
+    uint32_t syscall;   /* system call the process is in, 0 if none */
+    uint32_t brk;       /* end of the heap, kept by the group leader */
+    struct exec_image* image;   /* snapshot the program pages are shared from, NULL if none */
+    int8_t name[PROC_NAME_LEN];   /* program name, for sys_resident */
+    uint32_t bss_start; /* demand-zero pages past the image, kept by the group leader */
+    uint32_t bss_end;
+    uint32_t stack_low; /* lowest mapped user stack page, the guard page is below it */
+    uint32_t rss_image;     /* resident pages, kept by the group leader: image pages in the own frame */
+    uint32_t rss_anon;      /* bss and stack pages */
+    uint32_t rss_heap;      /* heap pages */
+    uint32_t rss_shared;    /* image pages mapped from a snapshot */
+    uint32_t rss_swap;      /* heap, bss and stack pages compressed into the swap store */
+    ktimer_t sleep_timer;   /* ends a sleep_ms or poll timeout */
+    wait_queue_t child_wait;    /* waitpid sleeps here until a spawned child halts */
+    ktimer_t alarm;         /* set by sys_alarm */
+    uint32_t alarm_rang;    /* 1 once the alarm went off, until sleep_ms sees it */
+    wait_queue_t sleep_queue;   /* sleep_ms and kernel sleeps wait here */
 } pcb_t;
 
+/* Checks that a file is an executable and reads its entry point */
+struct dentry_t;
+int32_t check_executable(const uint8_t* name, struct dentry_t* dentry, uint32_t* eip);
+
+/* Makes the slab cache descriptor tables come from */
+extern void fd_table_init();
+
+/* Record which system call the current process is in, for the TLB counters */
+extern void syscall_enter(uint32_t num);
+extern void syscall_exit();
+
 /* Finds the first available PCB in memory and returns its address */
 int32_t find_available_pcb();
 
@@ -6,9 +6,23 @@
 #include "file_system_driver.h"
 #include "keyboard.h"
 #include "syscalls.h"
+#include "paging.h"
+#include "image_cache.h"
+#include "workqueue.h"
+#include "ipc.h"
+#include "slab.h"
+#include "zswap.h"
+#include "scheduling.h"
+#include "pit.h"
+#include "timer.h"
+#include "clock.h"
 
 #define PASS 1
 #define FAIL 0
+#define CONTEXT_SWITCHES 10000
+#define SLAB_LIVE 256
+#define SLAB_ROUNDS 20000
+#define SHARE_TICKS 100
 
 /* format these macros as you see fit */
 #define TEST_HEADER 	\
@@ -611,9 +625,710 @@ void ls_test() {
 }
 
 /* Checkpoint 4 tests */
+
+/* PERFORMANCE TESTS BEGIN */
+
+/*
+ * image_cache_test()
+ *   DESCRIPTION: Times loading the shell the old way (dentry lookup, ELF check and
+ *                read_data) against mapping its snapshot, checks both match, and
+ *                checks that a write to a mapped page gets a private copy
+ *   INPUTS: none
+ *   OUTPUTS: cycles taken by each load
+ *   RETURN VALUE: PASS if the snapshot matches the file, FAIL otherwise
+ *   SIDE EFFECTS: maps and overwrites the user page of process 0, must run before any exec
+ */
+int image_cache_test() {
+	TEST_HEADER;
+	dentry_t dentry;
+	uint32_t eip, start, cold, warm, length, i;
+	uint8_t* user = (uint8_t*)VIRT_USER_LOAD;
+	p_table_entry_4k_p* entry = &user_page_tables[0][(VIRT_USER_LOAD >> 12) & TEN_LSB_MASK];
+	exec_image_t* image = image_cache_lookup((const uint8_t*)"shell");
+	if (image == NULL) {
+		return FAIL;
+	}
+	load_user_program(0);
+
+	start = rdtsc();
+	map_user_image(0, image->length);
+	if (check_executable((const uint8_t*)"shell", &dentry, &eip) == -1) {
+		return FAIL;
+	}
+	length = ((inode_t*)(in_memory_FS + (dentry.inode_number + 1) * FILE_BLOCK_SIZE))->length;
+	read_data(dentry.inode_number, 0, user, length);
+	cold = rdtsc() - start;
+	if (eip != image->eip || length != image->length) {
+		return FAIL;
+	}
+	for (i = 0; i < length; i++) {
+		if (user[i] != image->snapshot[i]) {
+			return FAIL;
+		}
+	}
+
+	start = rdtsc();
+	image = image_cache_lookup((const uint8_t*)"shell");
+	image_cache_map(image, 0);
+	warm = rdtsc() - start;
+
+	printf("shell load: file system %u cycles, shared snapshot %u cycles\n", cold, warm);
+	if (user[0] != image->snapshot[0] || (entry->avail & PTE_COW) == 0) {
+		return FAIL;
+	}
+	/* the write faults and the page becomes private, the snapshot stays as it was */
+	user[0] = user[0] + 1;
+	if ((entry->avail & PTE_COW) != 0 || user[0] != (uint8_t)(image->snapshot[0] + 1)) {
+		return FAIL;
+	}
+	image_cache_unmap(image);
+	return PASS;
+}
+
+/*
+ * demand_zero_test()
+ *   DESCRIPTION: Reserves a two page bss and an empty stack for process 0, then
+ *                touches them: the bss and the guard page below the stack get
+ *                zeroed frames, a touch further down is left unmapped
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: PASS if only the touched pages were mapped, FAIL otherwise
+ *   SIDE EFFECTS: maps the user page of process 0, must run before any exec
+ */
+int demand_zero_test() {
+	TEST_HEADER;
+	pcb_t* pcb = (pcb_t*)get_pcb_from_pid(0);
+	p_table_entry_4k_p* table = user_page_tables[0];
+	uint32_t bss = VIRT_USER_LOAD + PAGE_4K_SIZE;
+	int result = PASS;
+
+	load_user_program(0);
+	map_user_image(0, PAGE_4K_SIZE);
+	if (user_reserve(0, bss, bss + 2 * PAGE_4K_SIZE) == -1) {
+		return FAIL;
+	}
+	if (table[(bss >> 12) & TEN_LSB_MASK].present != 0 || pcb->stack_low != USER_PAGE_END) {
+		result = FAIL;
+	}
+	/* first touches fault the pages in */
+	if (*(volatile uint32_t*)(bss + PAGE_4K_SIZE) != 0 || *(volatile uint32_t*)(USER_PAGE_END - 4) != 0) {
+		result = FAIL;
+	}
+	if (table[((bss + PAGE_4K_SIZE) >> 12) & TEN_LSB_MASK].present != 1 || table[(bss >> 12) & TEN_LSB_MASK].present != 0) {
+		result = FAIL;
+	}
+	if (pcb->stack_low != USER_PAGE_END - PAGE_4K_SIZE) {
+		result = FAIL;
+	}
+	/* two pages below the stack skips the guard page, which is a real fault */
+	if (user_demand_fault(USER_PAGE_END - 3 * PAGE_4K_SIZE) != -1) {
+		result = FAIL;
+	}
+	user_release(0);
+	load_page_directory(page_directory);
+	return result;
+}
+
+/* Pages for lz_test */
+static uint8_t lz_page[PAGE_4K_SIZE];
+static uint8_t lz_packed[PAGE_4K_SIZE];
+static uint8_t lz_unpacked[PAGE_4K_SIZE];
+
+/*
+ * lz_test()
+ *   DESCRIPTION: Compresses a page of the file system image, a page of small
+ *                integers like a heap of counters, and a page of noise, checks
+ *                that each comes back unchanged and prints the compressed size
+ *                and the cycles both ways; then checks a truncated block is refused
+ *   INPUTS: none
+ *   OUTPUTS: sizes and cycles for each page
+ *   RETURN VALUE: PASS if every page round trips and noise is not stored, FAIL otherwise
+ *   SIDE EFFECTS: none
+ */
+int lz_test() {
+	TEST_HEADER;
+	uint32_t kind, i, seed = 391, start, pack_cycles, unpack_cycles, length;
+	int result = PASS;
+
+	for (kind = 0; kind < 3; kind++) {
+		for (i = 0; i < PAGE_4K_SIZE; i++) {
+			if (kind == 0) {
+				lz_page[i] = ((uint8_t*)in_memory_FS)[FILE_BLOCK_SIZE + i];
+			}
+			else if (kind == 1) {
+				lz_page[i] = (i % 4 == 0) ? (uint8_t)(i / 64) : 0;
+			}
+			else {
+				seed = seed * 1103515245 + 12345;
+				lz_page[i] = seed >> 16;
+			}
+		}
+		start = rdtsc();
+		length = lz_compress(lz_page, PAGE_4K_SIZE, lz_packed, PAGE_4K_SIZE);
+		pack_cycles = rdtsc() - start;
+		if (kind == 2) {
+			/* noise does not fit where zswap would store it */
+			if (lz_compress(lz_page, PAGE_4K_SIZE, lz_packed, ZSWAP_MAX_STORED) != 0) {
+				result = FAIL;
+			}
+			continue;
+		}
+		start = rdtsc();
+		if (length == 0 || lz_decompress(lz_packed, length, lz_unpacked, PAGE_4K_SIZE) != PAGE_4K_SIZE) {
+			result = FAIL;
+		}
+		unpack_cycles = rdtsc() - start;
+		for (i = 0; i < PAGE_4K_SIZE; i++) {
+			if (lz_page[i] != lz_unpacked[i]) {
+				result = FAIL;
+			}
+		}
+		printf("page %d: %d bytes, %d cycles in, %d cycles out\n", kind, length, pack_cycles, unpack_cycles);
+		if (lz_decompress(lz_packed, length - 1, lz_unpacked, PAGE_4K_SIZE) == PAGE_4K_SIZE) {
+			result = FAIL;
+		}
+	}
+	return result;
+}
+
+/*
+ * work_nop()
+ *   DESCRIPTION: Empty work item for worker_latency_test
+ *   INPUTS: arg -- unused
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void work_nop(void* arg) {
+}
+
+/*
+ * worker_latency_test()
+ *   DESCRIPTION: Times the terminal switch work keyboard_handler used to do
+ *                with interrupts off against queueing it for the worker thread,
+ *                and prints the worst keyboard interrupt seen so far
+ *   INPUTS: none
+ *   OUTPUTS: cycles taken by each path
+ *   RETURN VALUE: PASS if the work was queued, FAIL otherwise
+ *   SIDE EFFECTS: switches the screen to terminal 1 and back
+ */
+int worker_latency_test() {
+	TEST_HEADER;
+	uint32_t flags, start, inline_cycles, queued_cycles;
+	int32_t ret;
+
+	cli_and_save(flags);
+	start = rdtsc();
+	update_term(1);
+	inline_cycles = rdtsc() - start;
+	update_term(0);
+
+	start = rdtsc();
+	ret = queue_work(work_nop, NULL);
+	queued_cycles = rdtsc() - start;
+	restore_flags(flags);
+
+	printf("terminal switch in handler %u cycles, queued %u cycles\n", inline_cycles, queued_cycles);
+	printf("worst keyboard interrupt so far %u ns\n", get_kb_max_ns());
+	return (ret == 0) ? PASS : FAIL;
+}
+
+/*
+ * switch_touch()
+ *   DESCRIPTION: Switches page directories and touches the memory a context
+ *                switch usually does: PCBs, the kernel stack, video memory,
+ *                the image cache, the IPC pool and the user page
+ *   INPUTS: pid -- directory to switch to
+ *   OUTPUTS: none
+ *   RETURN VALUE: sum of the bytes read, so the reads are not optimized out
+ *   SIDE EFFECTS: loads CR3
+ */
+static uint32_t switch_touch(uint32_t pid) {
+	volatile uint8_t* user = (volatile uint8_t*)VIRT_USER_LOAD;
+	switch_directory(pid);
+	return ((pcb_t*)get_pcb_from_pid(pid))->state + *(volatile uint8_t*)VIDEO_MEM_START +
+		*(volatile uint8_t*)IMAGE_CACHE_START + *(volatile uint8_t*)IPC_POOL_START + user[0];
+}
+
+/*
+ * context_switch_test()
+ *   DESCRIPTION: Times page directory switches between two processes with
+ *                CR4.PGE off, which throws away kernel TLB entries like the old
+ *                shared directory plus flush_tlb did, and with it on
+ *   INPUTS: none
+ *   OUTPUTS: cycles per switch each way
+ *   RETURN VALUE: PASS
+ *   SIDE EFFECTS: builds the directories of processes 0 and 1, must run before any exec
+ */
+int context_switch_test() {
+	TEST_HEADER;
+	uint32_t flags, start, i, sum = 0;
+	uint32_t cycles[2];
+	uint32_t pge;
+
+	cli_and_save(flags);
+	load_user_program(0);
+	map_user_image(0, PAGE_4K_SIZE);
+	load_user_program(1);
+	map_user_image(1, PAGE_4K_SIZE);
+	for (pge = 0; pge < 2; pge++) {
+		set_global_pages(pge);
+		start = rdtsc();
+		for (i = 0; i < CONTEXT_SWITCHES; i++) {
+			sum += switch_touch(i & 1);
+		}
+		cycles[pge] = (rdtsc() - start) / CONTEXT_SWITCHES;
+	}
+	load_page_directory(page_directory);
+	restore_flags(flags);
+
+	printf("per switch: PGE off %u cycles, PGE on %u cycles (%u)\n", cycles[0], cycles[1], sum & 1);
+	return PASS;
+}
+
+/*
+ * slab_stress_test()
+ *   DESCRIPTION: Allocates and frees objects of random sizes in random order,
+ *                filling each with a pattern that is checked before it is
+ *                freed, then times a warm alloc/free pair on a cache
+ *   INPUTS: none
+ *   OUTPUTS: cycles per pair and the allocator statistics
+ *   RETURN VALUE: PASS if no object was overwritten and every one came back
+ *   SIDE EFFECTS: leaves pages with the kmalloc caches
+ */
+int slab_stress_test() {
+	TEST_HEADER;
+	static uint8_t* live[SLAB_LIVE];
+	static uint32_t sizes[SLAB_LIVE];
+	uint32_t seed = 391, i, j, slot, start, cycles;
+	int result = PASS;
+	void* obj;
+	kmem_cache_t* cache = kmem_cache_create((const int8_t*)"stress-48", 48);
+
+	if (cache == NULL) {
+		return FAIL;
+	}
+	for (i = 0; i < SLAB_LIVE; i++) {
+		live[i] = NULL;
+	}
+	for (i = 0; i < SLAB_ROUNDS; i++) {
+		seed = seed * 1103515245 + 12345;
+		slot = (seed >> 16) % SLAB_LIVE;
+		if (live[slot] != NULL) {
+			for (j = 0; j < sizes[slot]; j++) {
+				if (live[slot][j] != (uint8_t)(slot + j)) {
+					result = FAIL;
+				}
+			}
+			if (sizes[slot] == 48) {
+				kmem_cache_free(cache, live[slot]);
+			} else {
+				kfree(live[slot]);
+			}
+			live[slot] = NULL;
+			continue;
+		}
+		/* sizes up to a page, with the stress cache standing in for one of them */
+		sizes[slot] = 1 + (seed >> 4) % KMALLOC_MAX_SIZE;
+		if ((seed & 7) == 0) {
+			sizes[slot] = 48;
+			live[slot] = (uint8_t*)kmem_cache_alloc(cache);
+		} else {
+			if (sizes[slot] == 48) {
+				sizes[slot] = 49;
+			}
+			live[slot] = (uint8_t*)kmalloc(sizes[slot]);
+		}
+		if (live[slot] == NULL) {
+			result = FAIL;
+			continue;
+		}
+		for (j = 0; j < sizes[slot]; j++) {
+			live[slot][j] = (uint8_t)(slot + j);
+		}
+	}
+	for (i = 0; i < SLAB_LIVE; i++) {
+		if (live[i] == NULL) {
+			continue;
+		}
+		if (sizes[i] == 48) {
+			kmem_cache_free(cache, live[i]);
+		} else {
+			kfree(live[i]);
+		}
+	}
+	if (cache->in_use != 0) {
+		result = FAIL;
+	}
+
+	/* the freed object comes straight back, so this is the O(1) fast path */
+	start = rdtsc();
+	for (i = 0; i < SLAB_ROUNDS; i++) {
+		obj = kmem_cache_alloc(cache);
+		kmem_cache_free(cache, obj);
+	}
+	cycles = (rdtsc() - start) / SLAB_ROUNDS;
+
+	printf("alloc/free pair %u cycles\n", cycles);
+	kmem_print_stats();
+	return result;
+}
+
+/* PERFORMANCE TESTS END */
+
 /* Checkpoint 5 tests */
 
 
+/* Counters started by terminal_share_test, one per terminal */
+static int32_t share_pids[NUM_TERMINALS];
+
+/*
+ * share_check()
+ *   DESCRIPTION: Kernel thread of terminal_share_test: lets the counters run
+ *                for SHARE_TICKS, yielding whenever it is picked, then checks
+ *                the displayed terminal's counter got the most time and the
+ *                background ones were not starved
+ *   INPUTS: arg -- unused
+ *   OUTPUTS: the ticks each counter ran for
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: prints the test result on the displayed terminal
+ */
+static void share_check(void* arg) {
+	uint32_t deadline = get_pit_ticks() + SHARE_TICKS;
+	uint32_t ticks[NUM_TERMINALS];
+	int term, result = PASS;
+	pcb_t* pcb;
+
+	while (get_pit_ticks() < deadline) {
+		schedule();
+	}
+	for (term = 0; term < NUM_TERMINALS; term++) {
+		pcb = (pcb_t*)get_pcb_from_pid(share_pids[term]);
+		ticks[term] = pcb->cpu_ticks;
+		if (pcb->active == 0 || strncmp(pcb->name, (const int8_t*)"counter", PROC_NAME_LEN) != 0 || ticks[term] == 0) {
+			result = FAIL;
+		}
+	}
+	/* the displayed terminal is boosted */
+	for (term = 0; term < NUM_TERMINALS; term++) {
+		if (ticks[term] > ticks[get_cur_term()]) {
+			result = FAIL;
+		}
+	}
+	printf("counter ticks: %d %d %d of %d\n", ticks[0], ticks[1], ticks[2], SHARE_TICKS);
+	TEST_OUTPUT("Terminal Share Test", result);
+}
+
+/*
+ * terminal_share_test()
+ *   DESCRIPTION: Starts counter on all three terminals at once as their base
+ *                programs and hands the CPU to the scheduler; a kernel thread
+ *                reports how the ticks were shared. Use instead of exec_test,
+ *                each terminal gets its shell once its counter is done.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: never returns, the boot context is left behind
+ */
+void terminal_share_test() {
+	TEST_HEADER;
+	int term;
+	for (term = 0; term < NUM_TERMINALS; term++) {
+		if ((share_pids[term] = spawn_process((const uint8_t*)"counter 2", -1, term)) == -1) {
+			TEST_OUTPUT("Terminal Share Test", FAIL);
+			return;
+		}
+	}
+	if (kthread_create(share_check, NULL) == -1) {
+		TEST_OUTPUT("Terminal Share Test", FAIL);
+		return;
+	}
+	schedule();
+}
+
+/*
+ * idle_check()
+ *   DESCRIPTION: Kernel thread of idle_shells_test: lets SHARE_TICKS pass,
+ *                yielding whenever it is picked, and checks the shells ran
+ *                for almost none of them
+ *   INPUTS: arg -- unused
+ *   OUTPUTS: the ticks the shells ran for
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: prints the test result on the displayed terminal
+ */
+static void idle_check(void* arg) {
+	uint32_t deadline = get_pit_ticks() + SHARE_TICKS, busy = 0;
+	int term;
+	while (get_pit_ticks() < deadline) {
+		schedule();
+	}
+	for (term = 0; term < NUM_TERMINALS; term++) {
+		busy += ((pcb_t*)get_pcb_from_pid(share_pids[term]))->cpu_ticks;
+	}
+	printf("shell ticks: %d of %d\n", busy, SHARE_TICKS);
+	TEST_OUTPUT("Idle Shells Test", busy <= SHARE_TICKS / 20);
+}
+
+/*
+ * idle_shells_test()
+ *   DESCRIPTION: Starts a shell on every terminal and hands the CPU to the
+ *                scheduler; the shells sleep waiting for a line, so they
+ *                should use no CPU while a kernel thread watches. Use
+ *                instead of exec_test.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: never returns, the boot context is left behind
+ */
+void idle_shells_test() {
+	TEST_HEADER;
+	int term;
+	for (term = 0; term < NUM_TERMINALS; term++) {
+		if ((share_pids[term] = spawn_process((const uint8_t*)"shell", -1, term)) == -1) {
+			TEST_OUTPUT("Idle Shells Test", FAIL);
+			return;
+		}
+	}
+	if (kthread_create(idle_check, NULL) == -1) {
+		TEST_OUTPUT("Idle Shells Test", FAIL);
+		return;
+	}
+	schedule();
+}
+
+/*
+ * tickless_check()
+ *   DESCRIPTION: Kernel thread of tickless_test: sleeps SHARE_TICKS with the
+ *                periodic tick and again with the tick stopped while idle,
+ *                counting the timer interrupts each nap took
+ *   INPUTS: arg -- unused
+ *   OUTPUTS: the interrupts each nap took
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: prints the test result on the displayed terminal
+ */
+static void tickless_check(void* arg) {
+	uint32_t irqs[2], ticks[2];
+	uint32_t on;
+	for (on = 0; on < 2; on++) {
+		pit_set_tickless(on);
+		irqs[on] = get_pit_irqs();
+		ticks[on] = get_pit_ticks();
+		sleep_ticks(SHARE_TICKS);
+		irqs[on] = get_pit_irqs() - irqs[on];
+		ticks[on] = get_pit_ticks() - ticks[on];
+	}
+	printf("timer interrupts: %d periodic, %d tickless over %d ticks\n", irqs[0], irqs[1], SHARE_TICKS);
+	TEST_OUTPUT("Tickless Test", ticks[0] >= SHARE_TICKS && ticks[1] >= SHARE_TICKS && irqs[1] < irqs[0] / 2);
+}
+
+/*
+ * tickless_test()
+ *   DESCRIPTION: Starts a shell on every terminal, which sleep waiting for
+ *                a line, and hands the CPU to the scheduler; a kernel thread
+ *                compares the timer interrupts an idle system takes with and
+ *                without the tick stopped. Use instead of exec_test.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: never returns, the boot context is left behind
+ */
+void tickless_test() {
+	TEST_HEADER;
+	int term;
+	for (term = 0; term < NUM_TERMINALS; term++) {
+		if ((share_pids[term] = spawn_process((const uint8_t*)"shell", -1, term)) == -1) {
+			TEST_OUTPUT("Tickless Test", FAIL);
+			return;
+		}
+	}
+	if (kthread_create(tickless_check, NULL) == -1) {
+		TEST_OUTPUT("Tickless Test", FAIL);
+		return;
+	}
+	schedule();
+}
+
+/* Timers armed by timer_wheel_test, due up to TIMER_TEST_SPAN ticks away */
+#define TIMER_TEST_COUNT	10000
+#define TIMER_TEST_SPAN		300
+static ktimer_t test_timers[TIMER_TEST_COUNT];
+static uint32_t timers_fired, timers_early, timers_wrong, timers_late;
+
+/*
+ * test_timer_fired()
+ *   DESCRIPTION: Timer function of timer_wheel_test, checks the timer ran
+ *                on its tick and was not cancelled
+ *   INPUTS: arg -- index of the timer, odd ones are cancelled
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: updates the counts
+ */
+static void test_timer_fired(void* arg) {
+	uint32_t i = (uint32_t)arg;
+	uint32_t late = get_pit_ticks() - test_timers[i].expires;
+	timers_fired++;
+	if ((int32_t)late < 0) {
+		timers_early++;
+	}
+	else if (late > timers_late) {
+		timers_late = late;
+	}
+	if (i & 1) {
+		timers_wrong++;
+	}
+}
+
+/*
+ * timer_wheel_test()
+ *   DESCRIPTION: Arms TIMER_TEST_COUNT timers spread over TIMER_TEST_SPAN
+ *                ticks, cancels half and waits for the rest, checking each
+ *                ran on time and only the armed ones ran
+ *   INPUTS: none
+ *   OUTPUTS: cycles per add and cancel, and the nanoseconds timer_tick
+ *            took on the PIT interrupt while the timers ran
+ *   RETURN VALUE: PASS/FAIL
+ *   SIDE EFFECTS: takes TIMER_TEST_SPAN ticks
+ */
+int timer_wheel_test() {
+	TEST_HEADER;
+	uint32_t i, seed = 391, flags, start, add_cycles, cancel_cycles, avg, max;
+	uint32_t deadline = get_pit_ticks() + TIMER_TEST_SPAN + 2;
+	timers_fired = timers_early = timers_wrong = timers_late = 0;
+	timer_tick_ns(&max);
+	cli_and_save(flags);
+	start = rdtsc();
+	for (i = 0; i < TIMER_TEST_COUNT; i++) {
+		seed = seed * 1103515245 + 12345;
+		timer_setup(&test_timers[i], test_timer_fired, (void*)i);
+		timer_add(&test_timers[i], get_pit_ticks() + 1 + (seed >> 8) % TIMER_TEST_SPAN);
+	}
+	add_cycles = (rdtsc() - start) / TIMER_TEST_COUNT;
+	start = rdtsc();
+	for (i = 1; i < TIMER_TEST_COUNT; i += 2) {
+		timer_cancel(&test_timers[i]);
+	}
+	cancel_cycles = (rdtsc() - start) / (TIMER_TEST_COUNT / 2);
+	restore_flags(flags);
+	while (timers_fired < TIMER_TEST_COUNT / 2 && (int32_t)(get_pit_ticks() - deadline) < 0) {
+		asm volatile ("hlt");
+	}
+	avg = timer_tick_ns(&max);
+	printf("add %u cancel %u cycles, tick avg %u max %u ns\n", add_cycles, cancel_cycles, avg, max);
+	printf("%u fired, %u early, %u cancelled ones, %u ticks late at most\n", timers_fired, timers_early, timers_wrong, timers_late);
+	for (i = 0; i < TIMER_TEST_COUNT; i++) {
+		timer_cancel(&test_timers[i]);
+	}
+	return (timers_fired == TIMER_TEST_COUNT / 2 && timers_early == 0 && timers_wrong == 0) ? PASS : FAIL;
+}
+
+/* clock_test reads the clock CLOCK_TEST_READS times in a row, then times
+   CLOCK_TEST_TICKS PIT ticks with it */
+#define CLOCK_TEST_READS	100000
+#define CLOCK_TEST_TICKS	100
+
+/*
+ * clock_test()
+ *   DESCRIPTION: Checks the clock never goes backwards between back to back
+ *                reads, and that it agrees with the PIT to within 1% over a
+ *                second of ticks
+ *   INPUTS: none
+ *   OUTPUTS: the TSC rate, the cost of a read and both measures of the second
+ *   RETURN VALUE: PASS/FAIL
+ *   SIDE EFFECTS: takes about a second
+ */
+int clock_test() {
+	TEST_HEADER;
+	uint64_t last, now;
+	uint32_t i, flags, start, read_cycles, backwards = 0, ticks, expected_us, clock_us;
+	cli_and_save(flags);
+	start = rdtsc();
+	last = clock_ns();
+	for (i = 0; i < CLOCK_TEST_READS; i++) {
+		now = clock_ns();
+		if (now < last) {
+			backwards++;
+		}
+		last = now;
+	}
+	read_cycles = (rdtsc() - start) / CLOCK_TEST_READS;
+	restore_flags(flags);
+
+	/* start right after a tick so both measures cover whole ticks */
+	ticks = get_pit_ticks();
+	while (get_pit_ticks() == ticks) {
+		asm volatile ("hlt");
+	}
+	ticks = get_pit_ticks();
+	last = clock_ns();
+	sleep_ticks(CLOCK_TEST_TICKS);
+	clock_us = (uint32_t)div64_32(clock_ns() - last, 1000, NULL);
+	expected_us = (get_pit_ticks() - ticks) * (1000000 / PIT_HZ);
+
+	printf("TSC %u kHz, clock_ns %u cycles, %u went backwards\n", clock_tsc_khz(), read_cycles, backwards);
+	printf("PIT %u us, clock %u us\n", expected_us, clock_us);
+	return (backwards == 0 && clock_us + expected_us / 100 >= expected_us &&
+			clock_us <= expected_us + expected_us / 100) ? PASS : FAIL;
+}
+
+/* Shells get a line every LATENCY_GAP ticks, LATENCY_LINES times per setting */
+#define LATENCY_GAP		3
+#define LATENCY_LINES	20
+
+/*
+ * latency_check()
+ *   DESCRIPTION: Kernel thread of line_latency_test: presses Enter on the
+ *                displayed terminal every few ticks, first with plain round
+ *                robin and then with the feedback levels, and compares how
+ *                long the shell took to read each line
+ *   INPUTS: arg -- unused
+ *   OUTPUTS: the average and worst waits for each setting
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: prints the test result on the displayed terminal
+ */
+static void latency_check(void* arg) {
+	uint32_t avg[2], max[2];
+	uint32_t on, i;
+	for (on = 0; on < 2; on++) {
+		sched_set_mlfq(on);
+		sleep_ticks(LATENCY_GAP);
+		get_line_latency(&max[on]);
+		for (i = 0; i < LATENCY_LINES; i++) {
+			terminal_submit_line();
+			sleep_ticks(LATENCY_GAP);
+		}
+		avg[on] = get_line_latency(&max[on]);
+	}
+	printf("Enter to shell: round robin avg %u max %u, feedback avg %u max %u ns\n", avg[0], max[0], avg[1], max[1]);
+	TEST_OUTPUT("Line Latency Test", avg[1] != 0 && avg[1] < avg[0]);
+}
+
+/*
+ * line_latency_test()
+ *   DESCRIPTION: Starts a shell on the displayed terminal and counter on the
+ *                other two, then hands the CPU to the scheduler; a kernel
+ *                thread measures how fast the shell answers Enter while the
+ *                counters hog the CPU. Use instead of exec_test.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: never returns, the boot context is left behind
+ */
+void line_latency_test() {
+	TEST_HEADER;
+	int term;
+	for (term = 0; term < NUM_TERMINALS; term++) {
+		if (spawn_process((const uint8_t*)((term == get_cur_term()) ? "shell" : "counter 2"), -1, term) == -1) {
+			TEST_OUTPUT("Line Latency Test", FAIL);
+			return;
+		}
+	}
+	if (kthread_create(latency_check, NULL) == -1) {
+		TEST_OUTPUT("Line Latency Test", FAIL);
+		return;
+	}
+	schedule();
+}
+
 /* Test suite entry point */
 void launch_tests(){
 	/* CHECKPOINT 1
@@ -648,6 +1363,19 @@ void launch_tests(){
 	/* CHECPOINT 3 */
 	//TEST_OUTPUT("Open Bad Exec Command 1", bad_exec_name_1());
 	//TEST_OUTPUT("Open Bad Exec Command 2", bad_exec_name_2());
+	/* PERFORMANCE */
+	//TEST_OUTPUT("Image Cache Test", image_cache_test());
+	//TEST_OUTPUT("Demand Zero Test", demand_zero_test());
+	//TEST_OUTPUT("LZ Test", lz_test());
+	//TEST_OUTPUT("Worker Latency Test", worker_latency_test());
+	//TEST_OUTPUT("Context Switch Test", context_switch_test());
+	//TEST_OUTPUT("Slab Stress Test", slab_stress_test());
+	//TEST_OUTPUT("Timer Wheel Test", timer_wheel_test());
+	//TEST_OUTPUT("Clock Test", clock_test());
+	//terminal_share_test();
+	//idle_shells_test();
+	//tickless_test();
+	//line_latency_test();
 	exec_test();
 	// launch your tests here
 }
@@ -0,0 +1,464 @@
+/* timer.c - Kernel timers on a hierarchical timing wheel driven by the PIT
+ * tick. Adding and cancelling a timer is O(1); each tick runs one slot of
+ * the first wheel, and every 64 ticks a slot of the next wheel is spread
+ * over the ones below it. Backs the poll timeout, sleep_ms and alarm.
+ * vim:ts=4 noexpandtab
+ */
+
+#include "timer.h"
+#include "pit.h"
+#include "lib.h"
+#include "syscalls.h"
+#include "scheduling.h"
+#include "clock.h"
+
+/* Local variables */
+static ktimer_t* wheels[NUM_TIMER_WHEELS][TIMER_WHEEL_SIZE];   /* slots, each a list of timers */
+static ktimer_t* expiring = NULL;   /* timers of the slot being run */
+static uint32_t wheel_time = 0;     /* next tick to run the timers of */
+static uint32_t tick_max_ns = 0;    /* longest timer_tick */
+static uint64_t tick_total_ns = 0;
+static uint32_t tick_count = 0;     /* timer_tick calls the average covers */
+
+/*
+ * timer_link()
+ *   DESCRIPTION: Puts a timer at the head of a list
+ *   INPUTS: timer -- the timer, not on any list
+ *           head -- the list
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call with interrupts disabled
+ */
+static void timer_link(ktimer_t* timer, ktimer_t** head) {
+    timer->next = *head;
+    if (*head != NULL) {
+        (*head)->pprev = &timer->next;
+    }
+    timer->pprev = head;
+    *head = timer;
+}
+
+/*
+ * timer_unlink()
+ *   DESCRIPTION: Takes a timer off whichever list it is on
+ *   INPUTS: timer -- a pending timer
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call with interrupts disabled
+ */
+static void timer_unlink(ktimer_t* timer) {
+    *timer->pprev = timer->next;
+    if (timer->next != NULL) {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+/*
+ * timer_enqueue()
+ *   DESCRIPTION: Puts a timer in the slot its expiry falls in: the first
+ *                wheel if it is due within 64 ticks, otherwise the wheel
+ *                whose slots are just wide enough. An overdue timer goes in
+ *                the slot run next.
+ *   INPUTS: timer -- the timer, not on any list
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call with interrupts disabled
+ */
+static void timer_enqueue(ktimer_t* timer) {
+    uint32_t delta = timer->expires - wheel_time;
+    uint32_t level = 0;
+    if ((int32_t)delta < 0) {
+        timer_link(timer, &wheels[0][wheel_time & TIMER_WHEEL_MASK]);
+        return;
+    }
+    if (delta > TIMER_MAX_TICKS) {
+        timer->expires = wheel_time + TIMER_MAX_TICKS;
+        delta = TIMER_MAX_TICKS;
+    }
+    while (level < NUM_TIMER_WHEELS - 1 && delta >= (1U << (TIMER_WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+    timer_link(timer, &wheels[level][(timer->expires >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK]);
+}
+
+/*
+ * timer_cascade()
+ *   DESCRIPTION: Spreads the timers of a slot over the wheels below, now
+ *                that the slot's range of ticks has come up
+ *   INPUTS: level -- the wheel
+ *           index -- the slot
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call with interrupts disabled
+ */
+static void timer_cascade(uint32_t level, uint32_t index) {
+    ktimer_t* list = wheels[level][index];
+    ktimer_t* timer;
+    wheels[level][index] = NULL;
+    while (list != NULL) {
+        timer = list;
+        list = timer->next;
+        timer_enqueue(timer);
+    }
+}
+
+/*
+ * timer_run_tick()
+ *   DESCRIPTION: Runs the timers due at wheel_time and moves on a tick,
+ *                cascading first if the first wheel wrapped around
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call with interrupts disabled
+ */
+static void timer_run_tick() {
+    uint32_t index = wheel_time & TIMER_WHEEL_MASK;
+    uint32_t level;
+    ktimer_t* timer;
+    if (index == 0) {
+        for (level = 1; level < NUM_TIMER_WHEELS; level++) {
+            index = (wheel_time >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+            timer_cascade(level, index);
+            if (index != 0) {
+                break;
+            }
+        }
+        index = 0;
+    }
+    /* Move the slot to its own list, so a function may add or cancel any
+       timer while the rest of it runs */
+    expiring = wheels[0][index];
+    wheels[0][index] = NULL;
+    if (expiring != NULL) {
+        expiring->pprev = &expiring;
+    }
+    wheel_time++;
+    while (expiring != NULL) {
+        timer = expiring;
+        timer_unlink(timer);
+        timer->func(timer->arg);
+    }
+}
+
+/*
+ * timer_init()
+ *   DESCRIPTION: Empties the wheels
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call before any timer is added
+ */
+void timer_init() {
+    memset((void*)wheels, 0, sizeof(wheels));
+    expiring = NULL;
+    wheel_time = get_pit_ticks();
+}
+
+/*
+ * timer_setup()
+ *   DESCRIPTION: Sets up a timer that is not pending
+ *   INPUTS: timer -- the timer
+ *           func -- function run when it is due
+ *           arg -- argument passed to func
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void timer_setup(ktimer_t* timer, void (*func)(void* arg), void* arg) {
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->expires = 0;
+    timer->func = func;
+    timer->arg = arg;
+}
+
+/*
+ * timer_add()
+ *   DESCRIPTION: Makes a timer due at a tick, or moves it there if it is
+ *                already pending. An expiry in the past runs it on the next
+ *                tick.
+ *   INPUTS: timer -- a timer from timer_setup
+ *           expires -- the tick
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: safe to call from interrupt handlers and timer functions
+ */
+void timer_add(ktimer_t* timer, uint32_t expires) {
+    uint32_t flags;
+    cli_and_save(flags);
+    if (timer->pprev != NULL) {
+        timer_unlink(timer);
+    }
+    timer->expires = expires;
+    timer_enqueue(timer);
+    restore_flags(flags);
+}
+
+/*
+ * timer_cancel()
+ *   DESCRIPTION: Stops a timer if it is pending
+ *   INPUTS: timer -- a timer from timer_setup
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if it was pending, 0 if it already ran or was never added
+ *   SIDE EFFECTS: safe to call from interrupt handlers and timer functions
+ */
+int32_t timer_cancel(ktimer_t* timer) {
+    uint32_t flags;
+    int32_t pending = 0;
+    cli_and_save(flags);
+    if (timer->pprev != NULL) {
+        timer_unlink(timer);
+        pending = 1;
+    }
+    restore_flags(flags);
+    return pending;
+}
+
+/*
+ * timer_pending()
+ *   DESCRIPTION: Checks whether a timer is waiting to run
+ *   INPUTS: timer -- a timer from timer_setup
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if it is pending, 0 otherwise
+ *   SIDE EFFECTS: none
+ */
+int32_t timer_pending(ktimer_t* timer) {
+    return timer->pprev != NULL;
+}
+
+/*
+ * timer_tick()
+ *   DESCRIPTION: Runs every timer due by a tick. After an idle stretch the
+ *                PIT skipped, catches up one tick at a time.
+ *   INPUTS: ticks -- the current tick
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: called from the PIT interrupt with interrupts disabled
+ */
+void timer_tick(uint32_t ticks) {
+    uint64_t start = clock_ns();
+    uint32_t took;
+    while ((int32_t)(ticks - wheel_time) >= 0) {
+        timer_run_tick();
+    }
+    took = (uint32_t)(clock_ns() - start);
+    if (took > tick_max_ns) {
+        tick_max_ns = took;
+    }
+    tick_total_ns += took;
+    tick_count++;
+}
+
+/*
+ * timer_idle_ticks()
+ *   DESCRIPTION: Finds how long the PIT may stay quiet: the ticks until the
+ *                first slot with timers in it, or until a slot of the next
+ *                wheel has to be spread out
+ *   INPUTS: limit -- the most ticks the caller can sleep for
+ *   OUTPUTS: none
+ *   RETURN VALUE: ticks from now, between 1 and limit
+ *   SIDE EFFECTS: call with interrupts disabled
+ */
+uint32_t timer_idle_ticks(uint32_t limit) {
+    uint32_t now = get_pit_ticks();
+    uint32_t t, next;
+    if ((int32_t)(wheel_time - now) <= 0) {
+        return 1;   /* ticks are waiting to be run */
+    }
+    for (t = wheel_time; t - now < limit; t++) {
+        if (wheels[0][t & TIMER_WHEEL_MASK] != NULL) {
+            return t - now;
+        }
+        if ((t & TIMER_WHEEL_MASK) == 0) {
+            next = (t >> TIMER_WHEEL_BITS) & TIMER_WHEEL_MASK;
+            if (next == 0 || wheels[1][next] != NULL) {
+                return t - now;
+            }
+        }
+    }
+    return limit;
+}
+
+/*
+ * timer_tick_ns()
+ *   DESCRIPTION: Returns how long timer_tick took since the last call, and
+ *                starts counting again
+ *   INPUTS: none
+ *   OUTPUTS: max_ns -- the longest call
+ *   RETURN VALUE: the average call in nanoseconds, 0 if there was none
+ *   SIDE EFFECTS: clears the counts
+ */
+uint32_t timer_tick_ns(uint32_t* max_ns) {
+    uint32_t flags, avg;
+    cli_and_save(flags);
+    avg = (tick_count == 0) ? 0 : (uint32_t)div64_32(tick_total_ns, tick_count, NULL);
+    *max_ns = tick_max_ns;
+    tick_max_ns = tick_count = 0;
+    tick_total_ns = 0;
+    restore_flags(flags);
+    return avg;
+}
+
+/*
+ * ms_to_ticks()
+ *   DESCRIPTION: Converts milliseconds to PIT ticks
+ *   INPUTS: ms -- the time
+ *   OUTPUTS: none
+ *   RETURN VALUE: the ticks, rounded up so a wait is never cut short
+ *   SIDE EFFECTS: none
+ */
+uint32_t ms_to_ticks(uint32_t ms) {
+    return (ms / 1000) * PIT_HZ + ((ms % 1000) * PIT_HZ + 999) / 1000;
+}
+
+/*
+ * timer_wake()
+ *   DESCRIPTION: Timer function that wakes a wait queue
+ *   INPUTS: arg -- the wait queue
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void timer_wake(void* arg) {
+    wake_up((wait_queue_t*)arg);
+}
+
+/*
+ * alarm_ring()
+ *   DESCRIPTION: Timer function of a process' alarm. The kernel has no
+ *                signal handlers, so ALARM only ends a sleep_ms early.
+ *   INPUTS: arg -- the PCB
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void alarm_ring(void* arg) {
+    pcb_t* pcb = (pcb_t*)arg;
+    pcb->alarm_rang = 1;
+    wake_up(&pcb->sleep_queue);
+}
+
+/*
+ * timer_pcb_init()
+ *   DESCRIPTION: Sets up the timers of a new process or thread
+ *   INPUTS: pcb -- the PCB, whose timers are not pending
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void timer_pcb_init(pcb_t* pcb) {
+    timer_setup(&pcb->sleep_timer, timer_wake, &pcb->sleep_queue);
+    timer_setup(&pcb->alarm, alarm_ring, pcb);
+    pcb->alarm_rang = 0;
+    pcb->sleep_queue.waiters = 0;
+}
+
+/*
+ * timer_pcb_release()
+ *   DESCRIPTION: Stops the timers of a halting process or thread, whose PCB
+ *                may be reused
+ *   INPUTS: pcb -- the PCB
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void timer_pcb_release(pcb_t* pcb) {
+    timer_cancel(&pcb->sleep_timer);
+    timer_cancel(&pcb->alarm);
+}
+
+/*
+ * sleep_until()
+ *   DESCRIPTION: Sleeps the current process until a tick
+ *   INPUTS: pcb -- the current process
+ *           expires -- the tick to wake at
+ *           alarm -- 1 to wake early if the process' alarm goes off
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call with interrupts disabled
+ */
+static void sleep_until(pcb_t* pcb, uint32_t expires, uint32_t alarm) {
+    timer_setup(&pcb->sleep_timer, timer_wake, &pcb->sleep_queue);
+    timer_add(&pcb->sleep_timer, expires);
+    while (timer_pending(&pcb->sleep_timer) && (alarm == 0 || pcb->alarm_rang == 0)) {
+        sleep_on(&pcb->sleep_queue);
+    }
+    timer_cancel(&pcb->sleep_timer);
+}
+
+/*
+ * sleep_ticks()
+ *   DESCRIPTION: Sleeps the current process or kernel thread for a number
+ *                of ticks; the boot context waits with hlt instead
+ *   INPUTS: ticks -- ticks to sleep for
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void sleep_ticks(uint32_t ticks) {
+    uint32_t flags, expires = get_pit_ticks() + ticks;
+    cli_and_save(flags);
+    if (get_cur_pid() == -1) {
+        while ((int32_t)(get_pit_ticks() - expires) < 0) {
+            asm volatile ("sti; hlt; cli" : : : "memory");
+        }
+    }
+    else {
+        sleep_until((pcb_t*)get_pcb_from_pid(get_cur_pid()), expires, 0);
+    }
+    restore_flags(flags);
+}
+
+/*
+ * sys_sleep_ms()
+ *  Description: Sleeps the calling process for a number of milliseconds,
+ *               rounded up to whole ticks. The process' alarm going off
+ *               ends the sleep early.
+ *  Inputs: ms -- the time to sleep
+ *  Outputs: none
+ *  Return value: 0 after the whole time, or the milliseconds left if the
+ *                alarm ended it
+ *  Side effects: none
+ */
+int32_t sys_sleep_ms(uint32_t ms) {
+    uint32_t flags, expires, left = 0;
+    pcb_t* pcb = (pcb_t*)get_pcb_from_pid(get_cur_pid());
+    if (ms == 0) {
+        return 0;
+    }
+    cli_and_save(flags);
+    expires = get_pit_ticks() + ms_to_ticks(ms);
+    pcb->alarm_rang = 0;    /* an alarm that went off before is ignored */
+    sleep_until(pcb, expires, 1);
+    if (pcb->alarm_rang == 1 && (int32_t)(expires - get_pit_ticks()) > 0) {
+        left = (expires - get_pit_ticks()) * 1000 / PIT_HZ;
+    }
+    pcb->alarm_rang = 0;
+    restore_flags(flags);
+    return left;
+}
+
+/*
+ * sys_alarm()
+ *  Description: Sets the calling process' alarm to go off in a number of
+ *               milliseconds, replacing the one set before
+ *  Inputs: ms -- the time until the alarm, 0 to only cancel it
+ *  Outputs: none
+ *  Return value: milliseconds the earlier alarm had left, 0 if none was set
+ *  Side effects: none
+ */
+int32_t sys_alarm(uint32_t ms) {
+    uint32_t flags, left = 0;
+    pcb_t* pcb = (pcb_t*)get_pcb_from_pid(get_cur_pid());
+    cli_and_save(flags);
+    if (timer_cancel(&pcb->alarm) == 1 && (int32_t)(pcb->alarm.expires - get_pit_ticks()) > 0) {
+        left = (pcb->alarm.expires - get_pit_ticks()) * 1000 / PIT_HZ;
+    }
+    if (ms != 0) {
+        timer_add(&pcb->alarm, get_pit_ticks() + ms_to_ticks(ms));
+    }
+    restore_flags(flags);
+    return left;
+}
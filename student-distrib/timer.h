@@ -0,0 +1,74 @@
+/* timer.h - Defines for kernel timers on a hierarchical timing wheel
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _TIMER_H
+#define _TIMER_H
+
+#include "types.h"
+
+/* Four wheels of 64 slots. The first holds the timers due in the next 64
+ * ticks, one slot per tick; each next wheel's slots cover 64 times as many
+ * ticks, and are moved down a wheel as time reaches them */
+#define TIMER_WHEEL_BITS    6
+#define TIMER_WHEEL_SIZE    (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK    (TIMER_WHEEL_SIZE - 1)
+#define NUM_TIMER_WHEELS    4
+#define TIMER_MAX_TICKS     ((1 << (TIMER_WHEEL_BITS * NUM_TIMER_WHEELS)) - 1)  /* about 46 hours */
+
+/* A timer, usually embedded in whatever it times out. func runs from the
+ * PIT interrupt with interrupts disabled, and may add timers again */
+typedef struct ktimer {
+    struct ktimer* next;        /* next timer in the slot */
+    struct ktimer** pprev;      /* pointer that points at this timer, NULL if not pending */
+    uint32_t expires;           /* tick the timer is due at */
+    void (*func)(void* arg);    /* function called when it is due */
+    void* arg;                  /* argument passed to func */
+} ktimer_t;
+
+/* Empties the wheels */
+void timer_init();
+
+/* Sets up a timer that is not pending */
+void timer_setup(ktimer_t* timer, void (*func)(void* arg), void* arg);
+
+/* Makes a timer due at a tick, moving it if it is pending */
+void timer_add(ktimer_t* timer, uint32_t expires);
+
+/* Stops a pending timer, returns 1 if it was pending and 0 otherwise */
+int32_t timer_cancel(ktimer_t* timer);
+
+/* Returns 1 if a timer is waiting to run */
+int32_t timer_pending(ktimer_t* timer);
+
+/* Runs the timers due by a tick, called on every PIT interrupt */
+void timer_tick(uint32_t ticks);
+
+/* Returns how many ticks the idle PIT may sleep for, at most limit */
+uint32_t timer_idle_ticks(uint32_t limit);
+
+/* Average and longest cost of timer_tick in nanoseconds */
+uint32_t timer_tick_ns(uint32_t* max_ns);
+
+/* Timer function that wakes the wait queue in arg */
+void timer_wake(void* arg);
+
+struct pcb;
+
+/* Sets up the sleep and alarm timers of a new process or thread */
+void timer_pcb_init(struct pcb* pcb);
+
+/* Stops the timers of a halting process or thread */
+void timer_pcb_release(struct pcb* pcb);
+
+/* Converts milliseconds to ticks, rounding up */
+uint32_t ms_to_ticks(uint32_t ms);
+
+/* Sleeps the current process for a number of ticks */
+void sleep_ticks(uint32_t ticks);
+
+/* System calls */
+int32_t sys_sleep_ms(uint32_t ms);
+int32_t sys_alarm(uint32_t ms);
+
+#endif /* _TIMER_H */
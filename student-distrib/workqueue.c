@@ -0,0 +1,86 @@
+/* workqueue.c - A kernel worker thread that runs work queued by interrupt
+ * handlers, so the handlers can return right away
+ * vim:ts=4 noexpandtab
+ */
+
+#include "workqueue.h"
+#include "scheduling.h"
+#include "syscalls.h"
+#include "lib.h"
+
+/* Local variables */
+work_t work_queue[WORK_QUEUE_SIZE];     /* ring buffer of pending work */
+uint32_t work_head = 0;     /* index of the next work to run */
+uint32_t work_count = 0;    /* number of pending works */
+int32_t worker_pid = -1;    /* PID of the worker thread */
+
+/*
+ * worker_thread()
+ *   DESCRIPTION: Body of the worker thread, runs queued work in order and
+ *                sleeps while the queue is empty
+ *   INPUTS: arg -- unused
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: never returns
+ */
+static void worker_thread(void* arg) {
+    uint32_t flags;
+    work_t work;
+    pcb_t* self = (pcb_t*)get_pcb_from_pid(worker_pid);
+    while (1) {
+        cli_and_save(flags);
+        if (work_count == 0) {
+            /* nothing to do, sleep until queue_work wakes us */
+            self->state = PROC_WAITING;
+            restore_flags(flags);
+            schedule();
+            continue;
+        }
+        work = work_queue[work_head];
+        work_head = (work_head + 1) % WORK_QUEUE_SIZE;
+        work_count--;
+        restore_flags(flags);
+        work.func(work.arg);
+    }
+}
+
+/*
+ * workqueue_init()
+ *   DESCRIPTION: Starts the kernel worker thread
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: takes one PCB slot for the worker
+ */
+void workqueue_init() {
+    work_head = 0;
+    work_count = 0;
+    worker_pid = kthread_create(worker_thread, NULL);
+}
+
+/*
+ * queue_work()
+ *   DESCRIPTION: Adds work to the queue and wakes the worker
+ *   INPUTS: func -- function to call from the worker thread
+ *           arg -- argument to pass to func
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the queue is full or there is no worker
+ *   SIDE EFFECTS: none
+ */
+int32_t queue_work(void (*func)(void* arg), void* arg) {
+    uint32_t flags;
+    if (func == NULL || worker_pid == -1) {
+        return -1;
+    }
+    cli_and_save(flags);
+    if (work_count == WORK_QUEUE_SIZE) {
+        restore_flags(flags);
+        return -1;
+    }
+    work_queue[(work_head + work_count) % WORK_QUEUE_SIZE].func = func;
+    work_queue[(work_head + work_count) % WORK_QUEUE_SIZE].arg = arg;
+    work_count++;
+    make_runnable((pcb_t*)get_pcb_from_pid(worker_pid));
+    restore_flags(flags);
+    return 0;
+}
@@ -0,0 +1,24 @@
+/* workqueue.h - Defines for kernel worker threads and deferred work
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _WORKQUEUE_H
+#define _WORKQUEUE_H
+
+#include "types.h"
+
+#define WORK_QUEUE_SIZE     16
+
+/* A piece of work deferred from an interrupt handler */
+typedef struct work {
+    void (*func)(void* arg);    /* function the worker calls */
+    void* arg;                  /* argument passed to func */
+} work_t;
+
+/* Starts the kernel worker thread */
+void workqueue_init();
+
+/* Queues work for the worker thread, safe to call from interrupt handlers */
+int32_t queue_work(void (*func)(void* arg), void* arg);
+
+#endif /* _WORKQUEUE_H */
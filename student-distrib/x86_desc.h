@@ -22,6 +22,11 @@
 #define NUM_VEC     256
 #define P_DIREC_SIZE    1024
 #define P_TABLE_SIZE    1024
+#define NUM_IPC_TABLES  8       /* one IPC window page table per process, matches NUM_PROCESS */
+#define NUM_PAGE_DIRS   8       /* one page directory per process, matches NUM_PROCESS */
+#define NUM_HEAP_TABLES 8       /* one heap page table per process, matches NUM_PROCESS */
+#define NUM_USER_TABLES 8       /* one program page table per process, matches NUM_PROCESS */
+#define NUM_VIDMAP_TABLES 8     /* one vidmap page table per process, matches NUM_PROCESS */
 
 #ifndef ASM
 
@@ -0,0 +1,626 @@
+/* zswap.c - Compressed swap kept in memory. When the user frame pool runs
+ * low, heap, bss and stack pages that idle processes have not touched since
+ * the last aging pass are compressed into a store, their frames go back to
+ * the pool and their page table entries are marked not present. A fault on
+ * one of them expands it into a fresh frame.
+ * vim:ts=4 noexpandtab
+ */
+
+#include "zswap.h"
+#include "lib.h"
+#include "syscalls.h"
+#include "scheduling.h"
+#include "keyboard.h"
+#include "workqueue.h"
+#include "timer.h"
+#include "pit.h"
+
+/* Compressor tuning, an LZ4 style block format: each sequence is a token
+ * (literal count and match length in 4 bits each), the literals, a 2 byte
+ * offset back into the output and the match length past LZ_MIN_MATCH */
+#define LZ_HASH_BITS    12
+#define LZ_MIN_MATCH    4
+#define LZ_LAST_LITERALS    5   /* a block always ends with this many literals */
+#define LZ_MATCH_LIMIT  12      /* no match starts this close to the end */
+#define LZ_RUN_MASK     15
+
+/* One swapped page */
+typedef struct zswap_entry {
+    uint32_t unit;      /* first unit of the compressed page in the store */
+    uint16_t length;    /* compressed bytes, 0 for a zero page */
+    uint16_t in_use;
+} zswap_entry_t;
+
+/* Local variables */
+static uint16_t lz_table[1 << LZ_HASH_BITS];    /* last position of each 4 byte hash */
+static uint8_t zswap_buf[PAGE_4K_SIZE];         /* compressor output before it is stored */
+static uint32_t unit_map[ZSWAP_UNITS / 32];     /* bit set for every unit in use */
+static uint32_t unit_hint = 0;                  /* where the next search starts */
+static zswap_entry_t entries[ZSWAP_MAX_ENTRIES];
+static uint16_t free_entries[ZSWAP_MAX_ENTRIES];
+static uint32_t num_free_entries = 0;
+static zswap_stats_t stats;
+static uint32_t reclaim_hand = 0;               /* process the next scan starts at */
+static ktimer_t scan_timer;                     /* queues the aging passes */
+
+static void zswap_scan(void* arg);
+
+/*
+ * read32()
+ *   DESCRIPTION: Reads 4 bytes that may not be aligned
+ *   INPUTS: p -- the bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: the bytes as a little endian word
+ *   SIDE EFFECTS: none
+ */
+static inline uint32_t read32(const uint8_t* p) {
+    return *(const uint32_t*)p;     /* x86 does unaligned loads */
+}
+
+/*
+ * lz_put_length()
+ *   DESCRIPTION: Writes the part of a length that did not fit in the token,
+ *                as 255s followed by the remainder
+ *   INPUTS: op -- where to write
+ *           oend -- end of the output
+ *           len -- what is left of the length
+ *   OUTPUTS: none
+ *   RETURN VALUE: the new output position, NULL if the output is full
+ *   SIDE EFFECTS: none
+ */
+static uint8_t* lz_put_length(uint8_t* op, uint8_t* oend, uint32_t len) {
+    while (len >= 255) {
+        if (op >= oend) {
+            return NULL;
+        }
+        *op++ = 255;
+        len -= 255;
+    }
+    if (op >= oend) {
+        return NULL;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+/*
+ * lz_put_sequence()
+ *   DESCRIPTION: Writes one sequence: a run of literals and, unless it is the
+ *                last one, a match
+ *   INPUTS: op -- where to write
+ *           oend -- end of the output
+ *           lit -- the literals
+ *           nlit -- how many
+ *           offset -- distance back to the match, 0 for the last sequence
+ *           mlen -- match length minus LZ_MIN_MATCH
+ *   OUTPUTS: none
+ *   RETURN VALUE: the new output position, NULL if the output is full
+ *   SIDE EFFECTS: none
+ */
+static uint8_t* lz_put_sequence(uint8_t* op, uint8_t* oend, const uint8_t* lit, uint32_t nlit, uint32_t offset, uint32_t mlen) {
+    uint8_t* token = op++;
+    if (token >= oend) {
+        return NULL;
+    }
+    *token = (nlit >= LZ_RUN_MASK ? LZ_RUN_MASK : nlit) << 4;
+    if (nlit >= LZ_RUN_MASK && (op = lz_put_length(op, oend, nlit - LZ_RUN_MASK)) == NULL) {
+        return NULL;
+    }
+    if (op + nlit > oend) {
+        return NULL;
+    }
+    memcpy(op, lit, nlit);
+    op += nlit;
+    if (offset == 0) {
+        return op;
+    }
+    if (op + 2 > oend) {
+        return NULL;
+    }
+    *op++ = offset & 0xFF;
+    *op++ = offset >> 8;
+    *token |= (mlen >= LZ_RUN_MASK ? LZ_RUN_MASK : mlen);
+    if (mlen >= LZ_RUN_MASK) {
+        op = lz_put_length(op, oend, mlen - LZ_RUN_MASK);
+    }
+    return op;
+}
+
+/*
+ * lz_compress()
+ *   DESCRIPTION: Compresses a block with a single probe hash table: each 4
+ *                byte sequence is looked up where it was last seen, and a hit
+ *                is extended as far as it matches
+ *   INPUTS: src -- the data, at most 64KB
+ *           len -- its size
+ *           dst -- the output
+ *           max -- room in the output
+ *   OUTPUTS: none
+ *   RETURN VALUE: compressed size, 0 if it would not fit in max
+ *   SIDE EFFECTS: uses a static table, call with interrupts disabled
+ */
+uint32_t lz_compress(const uint8_t* src, uint32_t len, uint8_t* dst, uint32_t max) {
+    const uint8_t* ip = src;
+    const uint8_t* anchor = src;
+    const uint8_t* iend = src + len;
+    const uint8_t* mflimit = (len > LZ_MATCH_LIMIT) ? iend - LZ_MATCH_LIMIT : src;
+    const uint8_t* ref;
+    uint8_t* op = dst;
+    uint8_t* oend = dst + max;
+    uint32_t seq, h, offset;
+
+    memset(lz_table, 0, sizeof(lz_table));
+    while (ip < mflimit) {
+        seq = read32(ip);
+        h = (seq * 2654435761U) >> (32 - LZ_HASH_BITS);
+        ref = src + lz_table[h];
+        lz_table[h] = ip - src;
+        if (ref >= ip || read32(ref) != seq) {
+            ip++;
+            continue;
+        }
+        offset = ip - ref;
+        /* extend the match, keeping the last literals out of it */
+        const uint8_t* mstart = ip;
+        ip += LZ_MIN_MATCH;
+        ref += LZ_MIN_MATCH;
+        while (ip < iend - LZ_LAST_LITERALS && *ip == *ref) {
+            ip++;
+            ref++;
+        }
+        op = lz_put_sequence(op, oend, anchor, mstart - anchor, offset, ip - mstart - LZ_MIN_MATCH);
+        if (op == NULL) {
+            return 0;
+        }
+        anchor = ip;
+    }
+    op = lz_put_sequence(op, oend, anchor, iend - anchor, 0, 0);
+    return (op == NULL) ? 0 : op - dst;
+}
+
+/*
+ * lz_get_length()
+ *   DESCRIPTION: Reads the rest of a length that did not fit in the token
+ *   INPUTS: ip -- the input position, advanced past the length
+ *           iend -- end of the input
+ *           len -- the 4 bits from the token
+ *   OUTPUTS: none
+ *   RETURN VALUE: the whole length, -1 if the input ends first
+ *   SIDE EFFECTS: none
+ */
+static int32_t lz_get_length(const uint8_t** ip, const uint8_t* iend, uint32_t len) {
+    uint8_t b;
+    if (len != LZ_RUN_MASK) {
+        return len;
+    }
+    do {
+        if (*ip >= iend) {
+            return -1;
+        }
+        b = *(*ip)++;
+        len += b;
+    } while (b == 255);
+    return len;
+}
+
+/*
+ * lz_decompress()
+ *   DESCRIPTION: Expands a block made by lz_compress, checking every length
+ *                and offset against both buffers
+ *   INPUTS: src -- the block
+ *           len -- its size
+ *           dst -- the output
+ *           max -- room in the output
+ *   OUTPUTS: none
+ *   RETURN VALUE: expanded size, -1 if the block is corrupt
+ *   SIDE EFFECTS: none
+ */
+int32_t lz_decompress(const uint8_t* src, uint32_t len, uint8_t* dst, uint32_t max) {
+    const uint8_t* ip = src;
+    const uint8_t* iend = src + len;
+    uint8_t* op = dst;
+    uint8_t* oend = dst + max;
+    const uint8_t* ref;
+    int32_t nlit, mlen;
+    uint8_t token;
+
+    while (ip < iend) {
+        token = *ip++;
+        if ((nlit = lz_get_length(&ip, iend, token >> 4)) == -1 || ip + nlit > iend || op + nlit > oend) {
+            return -1;
+        }
+        memcpy(op, ip, nlit);
+        op += nlit;
+        ip += nlit;
+        if (ip == iend) {
+            break;      /* the last sequence has no match */
+        }
+        if (ip + 2 > iend) {
+            return -1;
+        }
+        ref = op - (ip[0] | (ip[1] << 8));
+        ip += 2;
+        if ((mlen = lz_get_length(&ip, iend, token & LZ_RUN_MASK)) == -1) {
+            return -1;
+        }
+        mlen += LZ_MIN_MATCH;
+        if (ref < dst || ref >= op || op + mlen > oend) {
+            return -1;
+        }
+        /* byte by byte, a match may overlap the bytes it produces */
+        while (mlen-- > 0) {
+            *op++ = *ref++;
+        }
+    }
+    return op - dst;
+}
+
+/*
+ * units_alloc()
+ *   DESCRIPTION: Finds n free units in a row in the store, first fit from
+ *                where the last search ended
+ *   INPUTS: n -- units wanted
+ *   OUTPUTS: none
+ *   RETURN VALUE: the first unit, or -1 if the store is too fragmented or full
+ *   SIDE EFFECTS: marks the units used
+ */
+static int32_t units_alloc(uint32_t n) {
+    uint32_t tried, start, run = 0, i;
+    for (tried = 0, i = unit_hint; tried < ZSWAP_UNITS + n; tried++, i++) {
+        if (i == ZSWAP_UNITS) {
+            i = 0;
+            run = 0;
+        }
+        if (unit_map[i / 32] & (1 << (i % 32))) {
+            run = 0;
+            continue;
+        }
+        if (++run == n) {
+            start = i + 1 - n;
+            for (i = start; i < start + n; i++) {
+                unit_map[i / 32] |= 1 << (i % 32);
+            }
+            unit_hint = start + n;
+            return start;
+        }
+    }
+    return -1;
+}
+
+/*
+ * units_free()
+ *   DESCRIPTION: Gives units back to the store
+ *   INPUTS: start -- the first unit
+ *           n -- how many
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void units_free(uint32_t start, uint32_t n) {
+    uint32_t i;
+    for (i = start; i < start + n; i++) {
+        unit_map[i / 32] &= ~(1 << (i % 32));
+    }
+}
+
+/*
+ * zswap_init()
+ *   DESCRIPTION: Marks every unit and entry of the store free
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call after page_init has mapped the store
+ */
+void zswap_init() {
+    int i;
+    memset(unit_map, 0, sizeof(unit_map));
+    unit_hint = 0;
+    for (i = 0; i < ZSWAP_MAX_ENTRIES; i++) {
+        entries[i].in_use = 0;
+        free_entries[i] = ZSWAP_MAX_ENTRIES - 1 - i;
+    }
+    num_free_entries = ZSWAP_MAX_ENTRIES;
+    memset(&stats, 0, sizeof(stats));
+    timer_setup(&scan_timer, zswap_scan, NULL);
+    timer_add(&scan_timer, get_pit_ticks() + ZSWAP_SCAN_TICKS);
+}
+
+/*
+ * swap_out()
+ *   DESCRIPTION: Compresses the page behind an entry into the store and gives
+ *                its frame back to the pool
+ *   INPUTS: pte -- a present entry backed by a pool frame
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the page stays resident
+ *   SIDE EFFECTS: the caller invalidates the page if its directory is loaded
+ */
+static int32_t swap_out(p_table_entry_4k_p* pte) {
+    const uint32_t* page = (const uint32_t*)(pte->page_base_address << 12);   /* the pool is mapped 1:1 */
+    uint32_t index, length = 0, i;
+    int32_t unit = 0;
+    if (num_free_entries == 0) {
+        return -1;
+    }
+    for (i = 0; i < PAGE_4K_SIZE / sizeof(uint32_t) && page[i] == 0; i++);
+    if (i < PAGE_4K_SIZE / sizeof(uint32_t)) {
+        length = lz_compress((const uint8_t*)page, PAGE_4K_SIZE, zswap_buf, ZSWAP_MAX_STORED);
+        if (length == 0) {
+            stats.rejected++;
+            return -1;
+        }
+        if ((unit = units_alloc((length + ZSWAP_UNIT - 1) / ZSWAP_UNIT)) == -1) {
+            return -1;
+        }
+        memcpy((void*)(ZSWAP_START + unit * ZSWAP_UNIT), zswap_buf, length);
+        stats.stored_bytes += length;
+    }
+    else {
+        stats.zero_pages++;
+    }
+    index = free_entries[--num_free_entries];
+    entries[index].unit = unit;
+    entries[index].length = length;
+    entries[index].in_use = 1;
+    pool_give(pte->page_base_address);
+    pte->present = 0;
+    pte->avail = PTE_SWAPPED;
+    pte->page_base_address = index;
+    stats.stored_pages++;
+    stats.swapouts++;
+    return 0;
+}
+
+/*
+ * zswap_drop()
+ *   DESCRIPTION: Frees the store entry behind a swapped page
+ *   INPUTS: pte -- an entry marked PTE_SWAPPED
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: clears the entry
+ */
+void zswap_drop(p_table_entry_4k_p* pte) {
+    uint32_t flags;
+    zswap_entry_t* entry = &entries[pte->page_base_address];
+    cli_and_save(flags);
+    if (entry->length != 0) {
+        units_free(entry->unit, (entry->length + ZSWAP_UNIT - 1) / ZSWAP_UNIT);
+        stats.stored_bytes -= entry->length;
+    }
+    else {
+        stats.zero_pages--;
+    }
+    entry->in_use = 0;
+    free_entries[num_free_entries++] = pte->page_base_address;
+    stats.stored_pages--;
+    pte->avail = 0;
+    pte->page_base_address = 0;
+    restore_flags(flags);
+}
+
+/*
+ * group_idle()
+ *   DESCRIPTION: A process is idle if none of its threads is runnable on the
+ *                displayed terminal, like a shell parked on a background one
+ *   INPUTS: pid -- the thread group leader
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if idle, 0 otherwise
+ *   SIDE EFFECTS: none
+ */
+static int32_t group_idle(int32_t pid) {
+    int32_t i;
+    pcb_t* pcb;
+    for (i = 0; i < NUM_PROCESS; i++) {
+        pcb = (pcb_t*)get_pcb_from_pid(i);
+        if (pcb->active != 0 && pcb->kthread == 0 && pcb->group_pid == pid &&
+            pcb->state == PROC_RUNNING && pcb->term == get_cur_term()) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * scan_page()
+ *   DESCRIPTION: One step of the clock: a page used since the last pass gets
+ *                its accessed bit cleared and another chance, an unused one
+ *                is swapped out if swapping is wanted
+ *   INPUTS: pte -- the entry
+ *           process -- the group leader, whose counters change
+ *           counter -- the resident counter the page is charged to
+ *           evict -- 1 to swap out cold pages, 0 to only age them
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the page was swapped out, 0 otherwise
+ *   SIDE EFFECTS: none
+ */
+static uint32_t scan_page(p_table_entry_4k_p* pte, pcb_t* process, uint32_t* counter, uint32_t evict) {
+    if (pte->present == 0) {
+        return 0;
+    }
+    if (pte->accessed == 1) {
+        pte->accessed = 0;  /* the directory is not loaded, so no TLB entry holds the old bit */
+        return 0;
+    }
+    if (evict == 0 || swap_out(pte) == -1) {
+        return 0;
+    }
+    (*counter)--;
+    process->rss_swap++;
+    return 1;
+}
+
+/*
+ * zswap_reclaim()
+ *   DESCRIPTION: Runs the clock over the pool pages of idle processes, oldest
+ *                first, until npages are swapped out. The process whose
+ *                directory is loaded is never touched. Two passes give pages
+ *                that were only aged in the first one a chance to go.
+ *   INPUTS: npages -- pages wanted, 0 to only age the pages
+ *           urgent -- 1 to take pages from busy processes too
+ *   OUTPUTS: none
+ *   RETURN VALUE: pages swapped out
+ *   SIDE EFFECTS: frees frames in the pool
+ */
+uint32_t zswap_reclaim(uint32_t npages, uint32_t urgent) {
+    uint32_t flags, done = 0, pass, n, addr, i;
+    int32_t loaded = loaded_group();
+    pcb_t* process;
+    p_table_entry_4k_p* table;
+    cli_and_save(flags);
+    for (pass = 0; pass < 2 && (npages == 0 || done < npages); pass++) {
+        for (n = 0; n < NUM_PROCESS && (npages == 0 || done < npages); n++) {
+            int32_t pid = reclaim_hand;
+            reclaim_hand = (reclaim_hand + 1) % NUM_PROCESS;
+            process = (pcb_t*)get_pcb_from_pid(pid);
+            if (process->active == 0 || process->kthread != 0 || process->group_pid != pid ||
+                process->state == PROC_ZOMBIE || pid == loaded || (urgent == 0 && group_idle(pid) == 0)) {
+                continue;
+            }
+            table = heap_page_tables[pid];
+            for (i = 0; i < P_TABLE_SIZE && (npages == 0 || done < npages); i++) {
+                done += scan_page(&table[i], process, &process->rss_heap, npages != 0);
+            }
+            table = user_page_tables[pid];
+            for (addr = process->bss_start; addr < process->bss_end && (npages == 0 || done < npages); addr += PAGE_4K_SIZE) {
+                done += scan_page(&table[(addr >> 12) & TEN_LSB_MASK], process, &process->rss_anon, npages != 0);
+            }
+            for (addr = process->stack_low; addr < USER_PAGE_END && (npages == 0 || done < npages); addr += PAGE_4K_SIZE) {
+                done += scan_page(&table[(addr >> 12) & TEN_LSB_MASK], process, &process->rss_anon, npages != 0);
+            }
+        }
+        if (npages == 0) {
+            break;  /* aging needs one pass */
+        }
+    }
+    restore_flags(flags);
+    return done;
+}
+
+/*
+ * zswap_age()
+ *   DESCRIPTION: Work item run once per ZSWAP_SCAN_TICKS: keeps
+ *                ZSWAP_LOW_FRAMES frames free by swapping out cold pages,
+ *                otherwise just ages the pages for the next time
+ *   INPUTS: arg -- unused
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: runs on the worker thread
+ */
+static void zswap_age(void* arg) {
+    uint32_t free = pool_free_frames();
+    zswap_reclaim(free < ZSWAP_LOW_FRAMES ? ZSWAP_LOW_FRAMES - free : 0, 0);
+}
+
+/*
+ * zswap_scan()
+ *   DESCRIPTION: Timer function that queues an aging pass every
+ *                ZSWAP_SCAN_TICKS
+ *   INPUTS: arg -- unused
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: runs from the PIT interrupt, adds its timer again
+ */
+static void zswap_scan(void* arg) {
+    queue_work(zswap_age, NULL);
+    timer_add(&scan_timer, scan_timer.expires + ZSWAP_SCAN_TICKS);
+}
+
+/*
+ * zswap_fault()
+ *   DESCRIPTION: Expands a swapped heap, bss or stack page of the loaded
+ *                process into a fresh frame. The page leaves the store, so
+ *                if every frame is spoken for another page goes in first.
+ *   INPUTS: addr -- the faulting address
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if the page is back, -1 if it was not swapped or no
+ *                 frame could be found for it
+ *   SIDE EFFECTS: takes a frame from the pool
+ */
+int32_t zswap_fault(uint32_t addr) {
+    uint32_t flags, index;
+    int32_t pid = loaded_group();
+    p_table_entry_4k_p* pte;
+    zswap_entry_t* entry;
+    pcb_t* process;
+    uint32_t* counter;
+    uint8_t* page;
+    if (pid == -1) {
+        return -1;
+    }
+    process = (pcb_t*)get_pcb_from_pid(pid);
+    if (addr >= HEAP_START && addr < HEAP_START + HEAP_MAX_SIZE) {
+        pte = &heap_page_tables[pid][(addr - HEAP_START) >> 12];
+        counter = &process->rss_heap;
+    }
+    else if (addr >= VIRTUAL_USER_PROG && addr < USER_PAGE_END) {
+        pte = &user_page_tables[pid][(addr >> 12) & TEN_LSB_MASK];
+        counter = &process->rss_anon;
+    }
+    else {
+        return -1;
+    }
+    cli_and_save(flags);
+    if (pte->present == 1 || (pte->avail & PTE_SWAPPED) == 0) {
+        restore_flags(flags);
+        return -1;
+    }
+    if (pool_committed_frames() - (stats.stored_pages - 1) > HEAP_POOL_FRAMES && zswap_reclaim(1, 1) == 0) {
+        restore_flags(flags);
+        return -1;  /* nothing else can be swapped out, the process is out of memory */
+    }
+    index = pte->page_base_address;
+    entry = &entries[index];
+    pte->page_base_address = pool_take();
+    page = (uint8_t*)(pte->page_base_address << 12);
+    if (entry->length != 0 && lz_decompress((const uint8_t*)(ZSWAP_START + entry->unit * ZSWAP_UNIT), entry->length, page, PAGE_4K_SIZE) != PAGE_4K_SIZE) {
+        printf("zswap: entry %d is corrupt\n", index);
+    }
+    /* give the entry back, zswap_drop reads its index from the frame number */
+    if (entry->length != 0) {
+        units_free(entry->unit, (entry->length + ZSWAP_UNIT - 1) / ZSWAP_UNIT);
+        stats.stored_bytes -= entry->length;
+    }
+    else {
+        stats.zero_pages--;
+    }
+    entry->in_use = 0;
+    free_entries[num_free_entries++] = index;
+    stats.stored_pages--;
+    stats.swapins++;
+    pte->avail = 0;
+    pte->accessed = 0;
+    pte->dirty = 0;
+    pte->present = 1;
+    (*counter)++;
+    process->rss_swap--;
+    /* the entry was not present, so the TLB has nothing to drop */
+    restore_flags(flags);
+    return 0;
+}
+
+/*
+ * zswap_swapped_pages()
+ *   DESCRIPTION: Returns the number of pages in the store, which hold a
+ *                commitment but no frame
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: page count
+ *   SIDE EFFECTS: none
+ */
+uint32_t zswap_swapped_pages() {
+    return stats.stored_pages;
+}
+
+/*
+ * zswap_get_stats()
+ *   DESCRIPTION: Copies the counters
+ *   INPUTS: out -- filled in
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void zswap_get_stats(zswap_stats_t* out) {
+    uint32_t flags;
+    cli_and_save(flags);
+    memcpy(out, &stats, sizeof(stats));
+    restore_flags(flags);
+}
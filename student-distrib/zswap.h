@@ -0,0 +1,60 @@
+/* zswap.h - Defines for the compressed in-memory swap
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _ZSWAP_H
+#define _ZSWAP_H
+
+#include "types.h"
+#include "paging.h"
+#include "heap.h"
+
+/* Compressed pages live in a 4MB store right after the user frame pool */
+#define ZSWAP_START         (HEAP_POOL_START + HEAP_POOL_SIZE)
+#define ZSWAP_SIZE          SIZE_4MB
+#define ZSWAP_UNIT          64      /* the store is handed out in 64 byte units */
+#define ZSWAP_UNITS         (ZSWAP_SIZE / ZSWAP_UNIT)
+#define ZSWAP_MAX_ENTRIES   4096    /* pages that can be swapped out at once */
+#define ZSWAP_MAX_STORED    (PAGE_4K_SIZE * 3 / 4)  /* pages compressing worse stay resident */
+#define ZSWAP_SCAN_TICKS    60      /* PIT ticks between agings, about a second */
+#define ZSWAP_LOW_FRAMES    (HEAP_POOL_FRAMES / 8)  /* free frames kept by the aging pass */
+
+/* avail bit of a page table entry whose page is in the store, the frame
+   number then holds the entry index */
+#define PTE_SWAPPED         0x2
+
+/* Counters shown in meminfo */
+typedef struct zswap_stats {
+    uint32_t stored_pages;  /* pages in the store, zero pages included */
+    uint32_t zero_pages;    /* of those, pages that were all zero and take no room */
+    uint32_t stored_bytes;  /* bytes of the store in use */
+    uint32_t swapouts;      /* lifetime pages compressed */
+    uint32_t swapins;       /* lifetime pages faulted back */
+    uint32_t rejected;      /* pages that did not compress well enough */
+} zswap_stats_t;
+
+/* Empties the store */
+void zswap_init();
+
+/* Compresses up to npages cold pages of idle processes, returns how many */
+uint32_t zswap_reclaim(uint32_t npages, uint32_t urgent);
+
+/* Brings a swapped page back for a fault on it */
+int32_t zswap_fault(uint32_t addr);
+
+/* Frees the store entry of a swapped page that is being unmapped */
+void zswap_drop(p_table_entry_4k_p* pte);
+
+/* Pages in the store */
+uint32_t zswap_swapped_pages();
+
+/* Copies the counters */
+void zswap_get_stats(zswap_stats_t* stats);
+
+/* Compresses len bytes into at most max, returns the size or 0 if it does not fit */
+uint32_t lz_compress(const uint8_t* src, uint32_t len, uint8_t* dst, uint32_t max);
+
+/* Expands a block from lz_compress, returns the size or -1 if it is corrupt */
+int32_t lz_decompress(const uint8_t* src, uint32_t len, uint8_t* dst, uint32_t max);
+
+#endif /* _ZSWAP_H */
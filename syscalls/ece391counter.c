@@ -10,12 +10,15 @@ int main ()
     uint32_t i, cnt, max = 0;
     uint8_t buf[BUFSIZE];
 
-    ece391_fdputs(1, (uint8_t*)"Enter the Test Number: (0): 100, (1): 10000, (2): 100000\n");
-    if (-1 == (cnt = ece391_read(0, buf, BUFSIZE-1)) ) {
-        ece391_fdputs(1, (uint8_t*)"Can't read the number from keyboard.\n");
-     return 3;
+    /* "counter 2" skips the prompt, so several can be started at once */
+    if (0 != ece391_getargs(buf, BUFSIZE) || '\0' == buf[0]) {
+        ece391_fdputs(1, (uint8_t*)"Enter the Test Number: (0): 100, (1): 10000, (2): 100000\n");
+        if (-1 == (cnt = ece391_read(0, buf, BUFSIZE-1)) ) {
+            ece391_fdputs(1, (uint8_t*)"Can't read the number from keyboard.\n");
+         return 3;
+        }
+        buf[cnt] = '\0';
     }
-    buf[cnt] = '\0';
 
     if ((ece391_strlen(buf) > 2) || ((ece391_strlen(buf) == 2) && ((buf[0] < '0') || (buf[0] > '2')))) {
         ece391_fdputs(1, (uint8_t*)"Wrong Choice!\n");
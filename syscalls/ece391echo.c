@@ -0,0 +1,18 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/* Prints its arguments, one space apart, straight from argv */
+int main (int32_t argc, uint8_t** argv, uint8_t** envp)
+{
+    int32_t i;
+
+    for (i = 1; i < argc; i++) {
+        if (i > 1)
+            ece391_fdputs (1, (uint8_t*)" ");
+        ece391_fdputs (1, argv[i]);
+    }
+    ece391_fdputs (1, (uint8_t*)"\n");
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define NUM_WORKERS 3
+#define ITERATIONS  200000
+
+static ece391_mutex_t mutex;
+static volatile int32_t spin;
+static volatile uint32_t counter;
+static volatile uint32_t padding[8];    /* a little work inside the lock */
+
+static void critical_section (void)
+{
+    int32_t i;
+
+    counter++;
+    for (i = 0; i < 8; i++)
+        padding[i] += counter;
+}
+
+static int32_t mutex_worker (void* arg)
+{
+    int32_t i;
+
+    for (i = 0; i < ITERATIONS; i++) {
+        ece391_mutex_lock (&mutex);
+        critical_section ();
+        ece391_mutex_unlock (&mutex);
+    }
+    return 0;
+}
+
+static int32_t spin_worker (void* arg)
+{
+    int32_t i, v;
+
+    for (i = 0; i < ITERATIONS; i++) {
+        do {
+            v = 1;
+            asm volatile ("xchgl %0, %1" : "+r" (v), "+m" (spin) : : "memory");
+        } while (0 != v);
+        critical_section ();
+        asm volatile ("" : : : "memory");
+        spin = 0;
+    }
+    return 0;
+}
+
+/* Run NUM_WORKERS copies of worker and report the time they took */
+static int32_t run (const char* name, int32_t (*worker)(void* arg))
+{
+    int32_t tids[NUM_WORKERS];
+    int32_t i, status;
+    uint32_t start, us;
+    uint8_t num[16];
+
+    counter = 0;
+    start = ece391_clock_us ();
+    for (i = 0; i < NUM_WORKERS; i++) {
+        if (-1 == (tids[i] = ece391_thread_create (worker, 0))) {
+            ece391_fdputs (1, (uint8_t*)"thread create failed\n");
+            return -1;
+        }
+    }
+    for (i = 0; i < NUM_WORKERS; i++)
+        ece391_thread_join (tids[i], &status);
+    us = ece391_clock_us () - start;
+
+    ece391_fdputs (1, (uint8_t*)name);
+    ece391_fdputs (1, (uint8_t*)": ");
+    ece391_fdputs (1, ece391_itoa (us / 1000, num, 10));
+    ece391_fdputs (1, (uint8_t*)" ms\n");
+    if (NUM_WORKERS * ITERATIONS != counter) {
+        ece391_fdputs (1, (uint8_t*)"lost updates\n");
+        return -1;
+    }
+    return 0;
+}
+
+int main ()
+{
+    mutex.state = 0;
+    spin = 0;
+    if (-1 == run ("futex mutex", mutex_worker))
+        return 2;
+    if (-1 == run ("spinlock", spin_worker))
+        return 3;
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define REQUEST_KEY 392
+#define REPLY_KEY   393
+#define ROUNDS      1000
+#define PAGE_SIZE   4096
+
+/* Echoes every request back, pages and all, until an empty message arrives */
+static int32_t serve (int32_t request, int32_t reply)
+{
+    ece391_msg_t msg;
+
+    while (1) {
+        if (-1 == ece391_msg_recv (request, &msg))
+            return 1;
+        if (0 == msg.length && 0 == msg.npages)
+            return 0;
+        /* touch the payload so the pages really are ours */
+        if (0 != msg.npages)
+            ((uint8_t*)msg.pages)[0]++;
+        if (-1 == ece391_msg_send (reply, &msg))
+            return 1;
+    }
+}
+
+/* Sends ROUNDS requests of npages pages plus length inline bytes and waits for
+   each reply; prints the average round trip in nanoseconds */
+static int32_t round_trips (int32_t request, int32_t reply, uint32_t length, uint32_t npages, const char* label)
+{
+    ece391_msg_t msg;
+    uint8_t num[16];
+    uint32_t i, start, us;
+    uint8_t* pages = 0;
+
+    if (0 != npages && (void*)-1 == (pages = ece391_ipc_alloc (npages))) {
+        ece391_fdputs (1, (uint8_t*)"ipc_alloc failed\n");
+        return -1;
+    }
+    for (i = 0; i < length; i++)
+        msg.data[i] = (uint8_t)i;
+
+    start = ece391_clock_us ();
+    for (i = 0; i < ROUNDS; i++) {
+        msg.length = length;
+        msg.pages = (uint32_t)pages;
+        msg.npages = npages;
+        if (0 != npages)
+            pages[0] = (uint8_t)i;
+        if (-1 == ece391_msg_send (request, &msg) || -1 == ece391_msg_recv (reply, &msg))
+            return -1;
+        if (msg.length != length || msg.npages != npages)
+            return -1;
+        /* the same frames come back, mapped wherever the window had room */
+        pages = (uint8_t*)msg.pages;
+        if (0 != npages && pages[0] != (uint8_t)(i + 1))
+            return -1;
+    }
+    us = ece391_clock_us () - start;
+    if (0 != npages)
+        ece391_ipc_free (pages, npages);
+
+    ece391_fdputs (1, (uint8_t*)label);
+    ece391_fdputs (1, (uint8_t*)" round trip: ");
+    ece391_fdputs (1, ece391_itoa (us / ROUNDS * 1000 + us % ROUNDS * 1000 / ROUNDS, num, 10));
+    ece391_fdputs (1, (uint8_t*)" ns\n");
+    return 0;
+}
+
+int main ()
+{
+    int32_t request, reply, pid, status, server_status;
+    uint8_t args[16];
+    ece391_msg_t quit;
+
+    if (-1 == (request = ece391_port_create (REQUEST_KEY)) ||
+        -1 == (reply = ece391_port_create (REPLY_KEY))) {
+        ece391_fdputs (1, (uint8_t*)"can't create ports\n");
+        return 2;
+    }
+    if (0 == ece391_getargs (args, 16) && 0 == ece391_strcmp (args, (uint8_t*)"server"))
+        return serve (request, reply);
+
+    if (-1 == (pid = ece391_spawn ((uint8_t*)"ipcbench server"))) {
+        ece391_fdputs (1, (uint8_t*)"can't start the server\n");
+        return 3;
+    }
+    status = 0;
+    if (-1 == round_trips (request, reply, 64, 0, "64B inline") ||
+        -1 == round_trips (request, reply, 8, 1, "4KB (1 page)") ||
+        -1 == round_trips (request, reply, 8, 1024 * 1024 / PAGE_SIZE, "1MB (256 pages)")) {
+        ece391_fdputs (1, (uint8_t*)"round trip failed\n");
+        status = 4;
+    }
+    quit.length = 0;
+    quit.npages = 0;
+    ece391_msg_send (request, &quit);
+    ece391_waitpid (pid, &server_status, 0);
+    return status;
+}
@@ -0,0 +1,92 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define ROUNDS      10000
+#define LIVE        512
+#define PAGE_SIZE   4096
+
+/* Print nanoseconds per operation, given microseconds for n operations */
+static void report (const char* label, uint32_t us, uint32_t n)
+{
+    uint8_t num[16];
+
+    ece391_fdputs (1, (uint8_t*)label);
+    ece391_fdputs (1, (uint8_t*)": ");
+    ece391_fdputs (1, ece391_itoa (us / n * 1000 + us % n * 1000 / n, num, 10));
+    ece391_fdputs (1, (uint8_t*)" ns\n");
+}
+
+int main ()
+{
+    static uint8_t* live[LIVE];
+    uint32_t i, start, seed = 391, size;
+    uint8_t* p;
+    uint8_t* heap;
+
+    /* first touches: every new heap page faults in a zeroed frame */
+    if ((void*)-1 == (heap = ece391_sbrk (64 * PAGE_SIZE))) {
+        ece391_fdputs (1, (uint8_t*)"sbrk failed\n");
+        return 2;
+    }
+    start = ece391_clock_us ();
+    for (i = 0; i < 64; i++) {
+        if (0 != heap[i * PAGE_SIZE]) {
+            ece391_fdputs (1, (uint8_t*)"heap page not zeroed\n");
+            return 3;
+        }
+    }
+    report ("demand-zero page fault", ece391_clock_us () - start, 64);
+    ece391_sbrk (-64 * PAGE_SIZE);
+
+    /* fresh blocks come off the bump pointer */
+    start = ece391_clock_us ();
+    for (i = 0; i < LIVE; i++) {
+        if (0 == (live[i] = ece391_malloc (32))) {
+            ece391_fdputs (1, (uint8_t*)"malloc failed\n");
+            return 4;
+        }
+    }
+    report ("malloc(32), bump", ece391_clock_us () - start, LIVE);
+    for (i = 0; i < LIVE; i++)
+        ece391_free (live[i]);
+
+    /* a free and a malloc of one class is a pop and a push */
+    for (size = 16; size <= 2048; size *= 8) {
+        start = ece391_clock_us ();
+        for (i = 0; i < ROUNDS; i++) {
+            p = ece391_malloc (size);
+            p[0] = (uint8_t)i;
+            ece391_free (p);
+        }
+        report (size == 16 ? "malloc+free(16)" : size == 128 ? "malloc+free(128)" : "malloc+free(1024)",
+                ece391_clock_us () - start, ROUNDS);
+    }
+
+    /* random sizes and lifetimes, checking that blocks never overlap */
+    for (i = 0; i < LIVE; i++)
+        live[i] = 0;
+    start = ece391_clock_us ();
+    for (i = 0; i < ROUNDS; i++) {
+        seed = seed * 1103515245 + 12345;
+        p = live[(seed >> 16) % LIVE];
+        if (0 != p) {
+            if (p[0] != (uint8_t)((seed >> 16) % LIVE)) {
+                ece391_fdputs (1, (uint8_t*)"block overwritten\n");
+                return 5;
+            }
+            ece391_free (p);
+            live[(seed >> 16) % LIVE] = 0;
+            continue;
+        }
+        if (0 == (p = ece391_malloc (1 + (seed >> 4) % 3000))) {
+            ece391_fdputs (1, (uint8_t*)"malloc failed\n");
+            return 4;
+        }
+        p[0] = (uint8_t)((seed >> 16) % LIVE);
+        live[(seed >> 16) % LIVE] = p;
+    }
+    report ("random malloc/free", ece391_clock_us () - start, ROUNDS);
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define MEMINFO_SIZE    2048
+
+static uint8_t text[MEMINFO_SIZE + 1];
+
+static void put_num (uint32_t n)
+{
+    uint8_t num[16];
+    ece391_fdputs (1, ece391_itoa (n, num, 10));
+}
+
+/* Puts n right-aligned in a column of width characters */
+static void put_col (uint32_t n, uint32_t width)
+{
+    uint8_t num[16];
+    uint32_t len;
+
+    ece391_itoa (n, num, 10);
+    for (len = ece391_strlen (num); len < width; len++)
+        ece391_fdputs (1, (uint8_t*)" ");
+    ece391_fdputs (1, num);
+}
+
+/* Returns the number after "name: " in the meminfo text, 0 if it is missing */
+static uint32_t field (const char* name)
+{
+    uint32_t len = ece391_strlen ((uint8_t*)name);
+    uint32_t value = 0;
+    uint8_t* line = text;
+
+    while ('\0' != *line) {
+        if (0 == ece391_strncmp (line, (uint8_t*)name, len) && ':' == line[len]) {
+            for (line += len + 1; ' ' == *line; line++);
+            while (*line >= '0' && *line <= '9')
+                value = value * 10 + (*line++ - '0');
+            return value;
+        }
+        while ('\0' != *line && '\n' != *line++);
+    }
+    return 0;
+}
+
+static void row (const char* label, uint32_t total, uint32_t used)
+{
+    ece391_fdputs (1, (uint8_t*)label);
+    put_col (total, 8);
+    put_col (used, 8);
+    put_col (total - used, 8);
+    ece391_fdputs (1, (uint8_t*)"\n");
+}
+
+/* Summarizes the kernel's meminfo file: how full each memory pool is, then
+   the resident memory of each process */
+int main ()
+{
+    int32_t fd, cnt;
+    uint32_t len = 0;
+    uint8_t* procs;
+
+    if (-1 == (fd = ece391_open ((uint8_t*)"meminfo"))) {
+        ece391_fdputs (1, (uint8_t*)"can't open meminfo\n");
+        return 2;
+    }
+    while (len < MEMINFO_SIZE && 0 < (cnt = ece391_read (fd, text + len, MEMINFO_SIZE - len)))
+        len += cnt;
+    ece391_close (fd);
+    text[len] = '\0';
+
+    ece391_fdputs (1, (uint8_t*)"kB            total    used    free\n");
+    row ("kernel heap ", field ("KernelHeapTotal"), field ("KernelHeapTotal") - field ("KernelHeapFree"));
+    row ("user pool   ", field ("UserPoolTotal"), field ("UserPoolTotal") - field ("UserPoolFree"));
+    row ("swap store  ", field ("SwapTotal"), field ("SwapCompressed"));
+    row ("image cache ", field ("ImageCacheTotal"), field ("ImageCacheUsed"));
+    ece391_fdputs (1, (uint8_t*)"kernel heap: ");
+    put_num (field ("KernelSlab"));
+    ece391_fdputs (1, (uint8_t*)" kB in slabs, ");
+    put_num (field ("KernelPages"));
+    ece391_fdputs (1, (uint8_t*)" kB in pages, ");
+    put_num (field ("KernelObjects"));
+    ece391_fdputs (1, (uint8_t*)" kB handed out\nuser pool: ");
+    put_num (field ("UserPoolCommitted"));
+    ece391_fdputs (1, (uint8_t*)" kB committed\nswap: ");
+    put_num (field ("SwapStored"));
+    ece391_fdputs (1, (uint8_t*)" kB of pages stored in ");
+    put_num (field ("SwapCompressed"));
+    ece391_fdputs (1, (uint8_t*)" kB\nfile system: ");
+    put_num (field ("FileSystem"));
+    ece391_fdputs (1, (uint8_t*)" kB\n\n");
+
+    /* the process table follows the fields, print it as the kernel wrote it */
+    for (procs = text; '\0' != *procs; procs++)
+        if ((procs == text || '\n' == procs[-1]) && 0 == ece391_strncmp (procs, (uint8_t*)"pid ", 4))
+            break;
+    ece391_fdputs (1, procs);
+    return 0;
+}
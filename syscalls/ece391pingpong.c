@@ -11,6 +11,37 @@
 #define LOOPMAX BUFMAX-ENDING-1
 #define STARTCHAR 'A'
 #define ENDCHAR 'Z'
+#define LINEMAX 1024
+
+/* Sleeps until the next RTC tick without spinning. A line typed meanwhile
+   picks the character to bounce, and "q" quits. Returns -1 to quit. */
+static int32_t wait_tick (int32_t rtc_fd, uint8_t* curchar)
+{
+    ece391_pollfd_t fds[2];
+    uint8_t line[LINEMAX];
+    int32_t garbage;
+    int32_t cnt;
+
+    fds[0].fd = rtc_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = 0;
+    fds[1].events = POLLIN;
+    while (1) {
+        if (-1 == ece391_poll (fds, 2, -1))
+            return -1;
+        if (fds[1].revents & POLLIN) {
+            cnt = ece391_read (0, line, LINEMAX-1);
+            if (cnt > 0 && 'q' == line[0])
+                return -1;
+            if (cnt > 0 && line[0] >= STARTCHAR && line[0] <= ENDCHAR)
+                *curchar = line[0];
+        }
+        if (fds[0].revents & POLLIN) {
+            ece391_read (rtc_fd, &garbage, 4);
+            return 0;
+        }
+    }
+}
 
 int main ()
 {
@@ -19,7 +50,6 @@ int main ()
     uint8_t curchar = STARTCHAR;
     uint8_t update = 1;
     int ret_val;
-    int garbage;
     int rtc_fd;
     uint8_t buf[BUFMAX];
     
@@ -54,7 +84,8 @@ int main ()
 		ece391_fdputs (1, buf);
 
 		// Wait for RTC tick
-		ece391_read(rtc_fd, &garbage, 4);
+		if (-1 == wait_tick(rtc_fd, &curchar))
+			return 0;
 	}
 	
 	// Bounce back
@@ -71,7 +102,8 @@ int main ()
 		ece391_fdputs (1, buf);
 
 		// Wait for RTC tick
-		ece391_read(rtc_fd, &garbage, 4);
+		if (-1 == wait_tick(rtc_fd, &curchar))
+			return 0;
     	}
 
 	// Edge case on characters
@@ -0,0 +1,69 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define TOTAL_BYTES (64 * 1024 * 1024)
+#define MAX_CHUNK   16384
+#define NUM_SIZES   4
+
+static const uint32_t sizes[NUM_SIZES] = {64, 512, 4096, 16384};
+static uint8_t write_buf[MAX_CHUNK];
+static uint8_t read_buf[MAX_CHUNK];
+static int32_t pipe_fds[2];
+static uint32_t chunk;
+
+/* Pushes TOTAL_BYTES through the pipe in chunk sized writes */
+static int32_t writer (void* arg)
+{
+    uint32_t done;
+
+    for (done = 0; done < TOTAL_BYTES; done += chunk) {
+        if (-1 == ece391_write (pipe_fds[1], write_buf, chunk))
+            return 1;
+    }
+    ece391_close (pipe_fds[1]);
+    return 0;
+}
+
+int main ()
+{
+    int32_t i, tid, cnt, status;
+    uint32_t total, start, us;
+    uint8_t num[16];
+
+    for (i = 0; i < MAX_CHUNK; i++)
+        write_buf[i] = (uint8_t)i;
+
+    for (i = 0; i < NUM_SIZES; i++) {
+        chunk = sizes[i];
+        if (-1 == ece391_pipe (pipe_fds)) {
+            ece391_fdputs (1, (uint8_t*)"pipe failed\n");
+            return 2;
+        }
+        start = ece391_clock_us ();
+        if (-1 == (tid = ece391_thread_create (writer, 0))) {
+            ece391_fdputs (1, (uint8_t*)"thread create failed\n");
+            return 3;
+        }
+        total = 0;
+        while (0 < (cnt = ece391_read (pipe_fds[0], read_buf, MAX_CHUNK)))
+            total += cnt;
+        ece391_thread_join (tid, &status);
+        us = ece391_clock_us () - start;
+        ece391_close (pipe_fds[0]);
+
+        ece391_fdputs (1, (uint8_t*)"write size ");
+        ece391_fdputs (1, ece391_itoa (chunk, num, 10));
+        ece391_fdputs (1, (uint8_t*)": ");
+        ece391_fdputs (1, ece391_itoa (total >> 20, num, 10));
+        ece391_fdputs (1, (uint8_t*)" MB in ");
+        ece391_fdputs (1, ece391_itoa (us / 1000, num, 10));
+        ece391_fdputs (1, (uint8_t*)" ms\n");
+        if (TOTAL_BYTES != total || 0 != status) {
+            ece391_fdputs (1, (uint8_t*)"short transfer\n");
+            return 4;
+        }
+    }
+    return 0;
+}
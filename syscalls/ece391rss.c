@@ -0,0 +1,56 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define NUM_PIDS    8
+#define PAGE_KB     4
+
+static void put_num (uint32_t n)
+{
+    uint8_t num[16];
+    ece391_fdputs (1, ece391_itoa (n, num, 10));
+}
+
+/* Prints the program memory of every process: pages it owns, pages it
+   shares with the other instances of the same program, and its
+   proportional share (private plus shared split among the sharers) */
+int main ()
+{
+    ece391_resident_t info;
+    uint32_t pid, pss, total_private = 0, total_pss = 0;
+
+    ece391_fdputs (1, (uint8_t*)"pid  program  private  shared (sharers)  pss\n");
+    for (pid = 0; pid < NUM_PIDS; pid++) {
+        if (-1 == ece391_resident (pid, &info)) {
+            ece391_fdputs (1, (uint8_t*)"resident failed\n");
+            return 1;
+        }
+        if ('\0' == info.name[0])
+            continue;
+        pss = info.private_pages * PAGE_KB;
+        if (0 != info.sharers)
+            pss += info.shared_pages * PAGE_KB / info.sharers;
+        total_private += info.private_pages * PAGE_KB;
+        total_pss += pss;
+
+        put_num (pid);
+        ece391_fdputs (1, (uint8_t*)"  ");
+        ece391_fdputs (1, (uint8_t*)info.name);
+        ece391_fdputs (1, (uint8_t*)"  ");
+        put_num (info.private_pages * PAGE_KB);
+        ece391_fdputs (1, (uint8_t*)"KB  ");
+        put_num (info.shared_pages * PAGE_KB);
+        ece391_fdputs (1, (uint8_t*)"KB (");
+        put_num (info.sharers);
+        ece391_fdputs (1, (uint8_t*)")  ");
+        put_num (pss);
+        ece391_fdputs (1, (uint8_t*)"KB\n");
+    }
+    ece391_fdputs (1, (uint8_t*)"total private ");
+    put_num (total_private);
+    ece391_fdputs (1, (uint8_t*)"KB, pss ");
+    put_num (total_pss);
+    ece391_fdputs (1, (uint8_t*)"KB\n");
+    return 0;
+}
@@ -4,14 +4,97 @@
 #include "ece391syscall.h"
 
 #define BUFSIZE 1024
+#define MAX_STAGES 4
+
+/* Report background jobs that have finished since the last prompt */
+static void reap_jobs ()
+{
+    int32_t pid, status;
+    uint8_t num[16];
+
+    while (0 < (pid = ece391_waitpid (-1, &status, WAIT_NOHANG))) {
+        ece391_fdputs (1, (uint8_t*)"[");
+        ece391_fdputs (1, ece391_itoa (pid, num, 10));
+        ece391_fdputs (1, (uint8_t*)"] done\n");
+    }
+}
+
+/* Run "a | b | ..." with each stage's stdout piped into the next stage's stdin */
+static void run_pipeline (uint8_t* buf)
+{
+    uint8_t* stages[MAX_STAGES];
+    int32_t pids[MAX_STAGES];
+    int32_t fds[2];
+    int32_t n_stages, i, in_fd, out_fd, status;
+    uint8_t* end;
+
+    /* split at each '|' and trim the spaces around every stage */
+    n_stages = 0;
+    while (1) {
+        while (' ' == *buf)
+            buf++;
+        if (MAX_STAGES == n_stages) {
+            ece391_fdputs (1, (uint8_t*)"too many pipeline stages\n");
+            return;
+        }
+        stages[n_stages++] = buf;
+        while ('\0' != *buf && '|' != *buf)
+            buf++;
+        end = buf;
+        while (end > stages[n_stages - 1] && ' ' == end[-1])
+            end--;
+        if ('\0' == *buf) {
+            *end = '\0';
+            break;
+        }
+        *end = '\0';
+        buf++;
+    }
+    for (i = 0; i < n_stages; i++) {
+        if ('\0' == stages[i][0]) {
+            ece391_fdputs (1, (uint8_t*)"empty pipeline stage\n");
+            return;
+        }
+    }
+
+    in_fd = -1;
+    for (i = 0; i < n_stages; i++) {
+        out_fd = -1;
+        if (i < n_stages - 1) {
+            if (-1 == ece391_pipe (fds)) {
+                ece391_fdputs (1, (uint8_t*)"pipe failed\n");
+                break;
+            }
+            out_fd = fds[1];
+        }
+        pids[i] = ece391_spawnio (stages[i], in_fd, out_fd);
+        if (-1 == pids[i])
+            ece391_fdputs (1, (uint8_t*)"no such command\n");
+        /* the children hold their own ends now */
+        if (-1 != in_fd)
+            ece391_close (in_fd);
+        if (-1 != out_fd)
+            ece391_close (out_fd);
+        in_fd = (-1 != out_fd) ? fds[0] : -1;
+    }
+    if (-1 != in_fd)
+        ece391_close (in_fd);
+    /* wait for the stages we managed to start */
+    while (--i >= 0) {
+        if (-1 != pids[i])
+            ece391_waitpid (pids[i], &status, 0);
+    }
+}
 
 int main ()
 {
-    int32_t cnt, rval;
+    int32_t cnt, rval, background;
     uint8_t buf[BUFSIZE];
+    uint8_t num[16];
     ece391_fdputs (1, (uint8_t*)"Starting 391 Shell\n");
 
     while (1) {
+        reap_jobs ();
         ece391_fdputs (1, (uint8_t*)"391OS> ");
 	if (-1 == (cnt = ece391_read (0, buf, BUFSIZE-1))) {
 	    ece391_fdputs (1, (uint8_t*)"read from keyboard failed\n");
@@ -24,6 +107,33 @@ int main ()
 	    return 0;
 	if ('\0' == buf[0])
 	    continue;
+	/* a trailing '&' runs the command in the background */
+	background = 0;
+	while (cnt > 0 && ' ' == buf[cnt - 1])
+	    buf[--cnt] = '\0';
+	if (cnt > 0 && '&' == buf[cnt - 1]) {
+	    background = 1;
+	    buf[--cnt] = '\0';
+	    while (cnt > 0 && ' ' == buf[cnt - 1])
+		buf[--cnt] = '\0';
+	    if ('\0' == buf[0])
+		continue;
+	}
+	for (rval = 0; '\0' != buf[rval] && '|' != buf[rval]; rval++);
+	if ('|' == buf[rval]) {
+	    run_pipeline (buf);
+	    continue;
+	}
+	if (background) {
+	    if (-1 == (rval = ece391_spawn (buf))) {
+		ece391_fdputs (1, (uint8_t*)"no such command\n");
+	    } else {
+		ece391_fdputs (1, (uint8_t*)"[");
+		ece391_fdputs (1, ece391_itoa (rval, num, 10));
+		ece391_fdputs (1, (uint8_t*)"]\n");
+	    }
+	    continue;
+	}
 	rval = ece391_execute (buf);
 	if (-1 == rval)
 	    ece391_fdputs (1, (uint8_t*)"no such command\n");
@@ -0,0 +1,86 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define SHM_KEY     391
+#define TOTAL_BYTES (100 * 1024 * 1024)
+#define RING_SIZE   (1024 * 1024)
+#define CHUNK       4096
+
+/* Ring at the start of the shared segment; head and tail count bytes moved */
+typedef struct ring {
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    uint8_t data[RING_SIZE];
+} ring_t;
+
+#define barrier() asm volatile ("" : : : "memory")
+
+/* Reads every chunk out of the ring and checks it */
+static int32_t consume (ring_t* ring)
+{
+    uint32_t i, n;
+    uint8_t* chunk;
+
+    for (n = 0; n < TOTAL_BYTES; n += CHUNK) {
+        while (ring->head == ring->tail);
+        barrier ();
+        chunk = &ring->data[ring->tail % RING_SIZE];
+        for (i = 0; i < CHUNK; i++) {
+            if (chunk[i] != (uint8_t)(n / CHUNK))
+                return 1;
+        }
+        barrier ();
+        ring->tail += CHUNK;
+    }
+    return 0;
+}
+
+int main ()
+{
+    int32_t id, pid, status, i;
+    uint32_t n, spins, start, us;
+    uint8_t args[16];
+    uint8_t num[16];
+    ring_t* ring = (ring_t*)SHM_BASE;
+
+    if (-1 == (id = ece391_shm_create (SHM_KEY)) || -1 == ece391_shm_attach (id, ring)) {
+        ece391_fdputs (1, (uint8_t*)"shared memory failed\n");
+        return 2;
+    }
+    if (0 == ece391_getargs (args, 16) && 0 == ece391_strcmp (args, (uint8_t*)"consumer"))
+        return consume (ring);
+
+    if (-1 == (pid = ece391_spawn ((uint8_t*)"shmbench consumer"))) {
+        ece391_fdputs (1, (uint8_t*)"can't start the consumer\n");
+        return 3;
+    }
+    start = ece391_clock_us ();
+    for (n = 0; n < TOTAL_BYTES; n += CHUNK) {
+        /* wait for room, giving up if the consumer died */
+        for (spins = 0; ring->head - ring->tail > RING_SIZE - CHUNK; spins++) {
+            if (0 == (spins & 0xFFFF) && 0 != ece391_waitpid (pid, &status, WAIT_NOHANG)) {
+                ece391_fdputs (1, (uint8_t*)"consumer quit early\n");
+                return 4;
+            }
+        }
+        for (i = 0; i < CHUNK; i++)
+            ring->data[ring->head % RING_SIZE + i] = (uint8_t)(n / CHUNK);
+        barrier ();
+        ring->head += CHUNK;
+    }
+    ece391_waitpid (pid, &status, 0);
+    us = ece391_clock_us () - start;
+    ece391_shm_detach (ring);
+
+    ece391_fdputs (1, ece391_itoa (TOTAL_BYTES >> 20, num, 10));
+    ece391_fdputs (1, (uint8_t*)" MB through shared memory in ");
+    ece391_fdputs (1, ece391_itoa (us / 1000, num, 10));
+    ece391_fdputs (1, (uint8_t*)" ms\n");
+    if (0 != status) {
+        ece391_fdputs (1, (uint8_t*)"consumer saw bad data\n");
+        return 5;
+    }
+    return 0;
+}
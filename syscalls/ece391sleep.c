@@ -0,0 +1,35 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+static uint32_t parse (const uint8_t* s)
+{
+    uint32_t n = 0;
+
+    while (*s >= '0' && *s <= '9')
+        n = n * 10 + (*s++ - '0');
+    return n;
+}
+
+/* "sleep ms" sleeps for ms milliseconds; "sleep ms alarm_ms" sets the alarm
+   first and reports how much of the sleep it cut off */
+int main (int32_t argc, uint8_t** argv, uint8_t** envp)
+{
+    uint8_t num[16];
+    int32_t left;
+
+    if (argc < 2 || argc > 3) {
+        ece391_fdputs (1, (uint8_t*)"usage: sleep ms [alarm_ms]\n");
+        return 1;
+    }
+    if (3 == argc)
+        ece391_alarm (parse (argv[2]));
+    left = ece391_sleep_ms (parse (argv[1]));
+    if (0 != left) {
+        ece391_fdputs (1, (uint8_t*)"woken by the alarm, ");
+        ece391_fdputs (1, ece391_itoa (left, num, 10));
+        ece391_fdputs (1, (uint8_t*)" ms early\n");
+    }
+    return 0;
+}
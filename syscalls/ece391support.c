@@ -102,3 +102,257 @@ uint8_t* ece391_strrev(uint8_t* s)
    return s;
 }
 
+/* One thread started by ece391_thread_create; tid is -1 while the slot is free */
+typedef struct thread_slot {
+    int32_t tid;
+    int32_t (*func)(void* arg);
+    void* arg;
+} thread_slot_t;
+
+static thread_slot_t threads[MAX_THREADS] = {{-1}, {-1}, {-1}, {-1}};
+static uint8_t thread_stacks[MAX_THREADS][THREAD_STACK_SIZE];
+
+/* First function a new thread runs, halts it with func's return value */
+static void thread_start(void* arg)
+{
+    thread_slot_t* slot = (thread_slot_t*)arg;
+    ece391_halt((uint8_t)slot->func(slot->arg));
+}
+
+/* Start func(arg) in a new thread, returns its ID or -1 if none is free */
+int32_t ece391_thread_create(int32_t (*func)(void* arg), void* arg)
+{
+    int32_t i;
+
+    for (i = 0; i < MAX_THREADS; i++) {
+        if (threads[i].tid == -1) {
+            threads[i].tid = 0;     /* reserve the slot */
+            threads[i].func = func;
+            threads[i].arg = arg;
+            threads[i].tid = ece391_clone(thread_start, &threads[i], thread_stacks[i] + THREAD_STACK_SIZE);
+            return threads[i].tid;
+        }
+    }
+    return -1;
+}
+
+/* Wait for a thread made by the caller to finish and free its stack */
+int32_t ece391_thread_join(int32_t tid, int32_t* status)
+{
+    int32_t i;
+
+    if (-1 == ece391_waitpid(tid, status, 0))
+        return -1;
+    for (i = 0; i < MAX_THREADS; i++) {
+        if (threads[i].tid == tid)
+            threads[i].tid = -1;
+    }
+    return 0;
+}
+
+/* Atomically set *p to v if it holds old, returns what *p held */
+static inline int32_t cmpxchg(volatile int32_t* p, int32_t old, int32_t v)
+{
+    int32_t prev;
+    asm volatile ("lock cmpxchgl %2, %1"
+                  : "=a" (prev), "+m" (*p)
+                  : "r" (v), "0" (old)
+                  : "memory");
+    return prev;
+}
+
+/* Atomically swap *p with v, returns what *p held */
+static inline int32_t xchg(volatile int32_t* p, int32_t v)
+{
+    asm volatile ("xchgl %0, %1" : "+r" (v), "+m" (*p) : : "memory");
+    return v;
+}
+
+/* Atomically add v to *p, returns what *p held */
+static inline int32_t xadd(volatile int32_t* p, int32_t v)
+{
+    asm volatile ("lock xaddl %0, %1" : "+r" (v), "+m" (*p) : : "memory");
+    return v;
+}
+
+/* Take the mutex, sleeping in the kernel only if someone holds it */
+void ece391_mutex_lock(ece391_mutex_t* m)
+{
+    int32_t c;
+
+    if (0 == (c = cmpxchg(&m->state, 0, 1)))
+        return;
+    /* mark the mutex contended so the holder wakes us */
+    if (2 != c)
+        c = xchg(&m->state, 2);
+    while (0 != c) {
+        ece391_futex_wait(&m->state, 2);
+        c = xchg(&m->state, 2);
+    }
+}
+
+/* Release the mutex, entering the kernel only if someone sleeps on it */
+void ece391_mutex_unlock(ece391_mutex_t* m)
+{
+    if (1 != xadd(&m->state, -1)) {
+        m->state = 0;
+        ece391_futex_wake(&m->state, 1);
+    }
+}
+
+/* Release m, sleep until signalled, then take m again; m must be held */
+void ece391_cond_wait(ece391_cond_t* c, ece391_mutex_t* m)
+{
+    int32_t seq = c->seq;
+    int32_t s;
+
+    xadd(&c->waiters, 1);
+    ece391_mutex_unlock(m);
+    ece391_futex_wait(&c->seq, seq);
+    xadd(&c->waiters, -1);
+    /* others may have been woken with us, so take m as contended */
+    while (0 != (s = xchg(&m->state, 2)))
+        ece391_futex_wait(&m->state, 2);
+}
+
+/* Wake one thread in ece391_cond_wait; call with the mutex held */
+void ece391_cond_signal(ece391_cond_t* c)
+{
+    xadd(&c->seq, 1);
+    if (0 != c->waiters)
+        ece391_futex_wake(&c->seq, 1);
+}
+
+/* Wake every thread in ece391_cond_wait; call with the mutex held */
+void ece391_cond_broadcast(ece391_cond_t* c)
+{
+    xadd(&c->seq, 1);
+    if (0 != c->waiters)
+        ece391_futex_wake(&c->seq, MAX_THREADS + 1);
+}
+
+/* Sits in front of every block; 8 bytes so payloads stay 8-byte aligned */
+typedef struct malloc_header {
+    uint32_t size;      /* bytes the block holds */
+    uint32_t unused;
+} malloc_header_t;
+
+/* A program's image is copied in without clearing its bss, so the state
+   below is only trusted once malloc_ready has been set from its .data value */
+static int32_t malloc_ready = -1;
+static void* free_lists[MALLOC_NUM_CLASSES];   /* freed blocks of each class */
+static void* big_list;      /* freed blocks above MALLOC_MAX_CLASS, first fit */
+static uint8_t* bump;       /* next byte never handed out */
+static uint8_t* bump_end;   /* the break */
+
+/* Carve n bytes off the end of the heap, growing it a chunk at a time */
+static uint8_t* bump_alloc(uint32_t n)
+{
+    uint8_t* p;
+    uint32_t grow;
+
+    if ((uint32_t)(bump_end - bump) < n) {
+        grow = (n - (bump_end - bump) + MALLOC_CHUNK - 1) & ~(MALLOC_CHUNK - 1);
+        if ((void*)-1 == ece391_sbrk (grow))
+            return 0;
+        bump_end += grow;
+    }
+    p = bump;
+    bump += n;
+    return p;
+}
+
+/* Allocate size bytes, 0 if the heap cannot grow */
+void* ece391_malloc(uint32_t size)
+{
+    malloc_header_t* h;
+    void** prev;
+    uint32_t cls, cap;
+    int32_t i;
+
+    if (-1 == malloc_ready) {
+        for (i = 0; i < MALLOC_NUM_CLASSES; i++)
+            free_lists[i] = 0;
+        big_list = 0;
+        bump = bump_end = (uint8_t*)ece391_sbrk (0);
+        malloc_ready = 1;
+    }
+    if (0 == size)
+        return 0;
+    if (size <= MALLOC_MAX_CLASS) {
+        for (cls = 0, cap = MALLOC_MIN_CLASS; cap < size; cls++, cap <<= 1);
+        if (0 != free_lists[cls]) {
+            h = (malloc_header_t*)free_lists[cls] - 1;
+            free_lists[cls] = *(void**)free_lists[cls];
+            return h + 1;
+        }
+    }
+    else {
+        cap = ((size + sizeof (malloc_header_t) + 4095) & ~4095) - sizeof (malloc_header_t);
+        for (prev = &big_list; 0 != *prev; prev = (void**)*prev) {
+            h = (malloc_header_t*)*prev - 1;
+            if (h->size >= size) {
+                *prev = *(void**)*prev;
+                return h + 1;
+            }
+        }
+    }
+    if (0 == (h = (malloc_header_t*)bump_alloc (cap + sizeof (malloc_header_t))))
+        return 0;
+    h->size = cap;
+    return h + 1;
+}
+
+/* Return a block from ece391_malloc to its free list; 0 is ignored */
+void ece391_free(void* ptr)
+{
+    malloc_header_t* h = (malloc_header_t*)ptr - 1;
+    uint32_t cls, cap;
+
+    if (0 == ptr)
+        return;
+    if (h->size > MALLOC_MAX_CLASS) {
+        *(void**)ptr = big_list;
+        big_list = ptr;
+        return;
+    }
+    for (cls = 0, cap = MALLOC_MIN_CLASS; cap < h->size; cls++, cap <<= 1);
+    *(void**)ptr = free_lists[cls];
+    free_lists[cls] = ptr;
+}
+
+/* Set the end of the heap to addr, returns 0 or -1 */
+int32_t ece391_brk(void* addr)
+{
+    uint8_t* cur = (uint8_t*)ece391_sbrk (0);
+
+    return ((void*)-1 == ece391_sbrk ((uint8_t*)addr - cur)) ? -1 : 0;
+}
+
+/* Nanoseconds since boot, from the TSC and the numbers the kernel leaves in
+   the clock page; the cycles are multiplied 32 bits at a time so nothing
+   overflows */
+uint64_t ece391_clock_ns(void)
+{
+    const ece391_clock_data_t* clock = (const ece391_clock_data_t*)ECE391_CLOCK_PAGE;
+    uint32_t lo, hi;
+    uint64_t cycles;
+
+    asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+    cycles = (((uint64_t)hi << 32) | lo) - clock->base_tsc;
+    return (((uint64_t)(uint32_t)cycles * clock->mult) >> clock->shift) +
+           (((uint64_t)(uint32_t)(cycles >> 32) * clock->mult) << (32 - clock->shift));
+}
+
+/* Microseconds since boot, cut to 32 bits: differences of two readings are
+   right as long as they are less than 71 minutes apart */
+uint32_t ece391_clock_us(void)
+{
+    uint64_t ns = ece391_clock_ns ();
+    uint32_t q, r;
+
+    /* divide in two steps, there is no libgcc for a 64-bit divide */
+    asm ("divl %3" : "=a" (q), "=d" (r)
+         : "a" ((uint32_t)ns), "rm" (1000), "d" ((uint32_t)(ns >> 32) % 1000));
+    return q;
+}
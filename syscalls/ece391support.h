@@ -9,5 +9,46 @@ extern int32_t ece391_strncmp(const uint8_t* s1, const uint8_t* s2, uint32_t n);
 extern uint8_t *ece391_itoa(uint32_t value, uint8_t* buf, int32_t radix);
 extern uint8_t *ece391_strrev(uint8_t* s);
 
+/* Threads, see ece391_thread_create */
+#define MAX_THREADS         4
+#define THREAD_STACK_SIZE   4096
+
+extern int32_t ece391_thread_create(int32_t (*func)(void* arg), void* arg);
+extern int32_t ece391_thread_join(int32_t tid, int32_t* status);
+
+/* Locks built on futexes, zero-initialize them before use.  The
+ * uncontended paths stay in user space. */
+typedef struct ece391_mutex {
+    volatile int32_t state;     /* 0 unlocked, 1 locked, 2 locked with sleepers */
+} ece391_mutex_t;
+
+typedef struct ece391_cond {
+    volatile int32_t seq;       /* bumped by every signal */
+    volatile int32_t waiters;   /* threads sleeping in ece391_cond_wait */
+} ece391_cond_t;
+
+extern void ece391_mutex_lock(ece391_mutex_t* m);
+extern void ece391_mutex_unlock(ece391_mutex_t* m);
+extern void ece391_cond_wait(ece391_cond_t* c, ece391_mutex_t* m);
+extern void ece391_cond_signal(ece391_cond_t* c);
+extern void ece391_cond_broadcast(ece391_cond_t* c);
+
+/* Heap allocation on top of ece391_sbrk.  Requests up to MALLOC_MAX_CLASS
+ * bytes come from power-of-two size classes with one free list each; larger
+ * ones are rounded up to whole pages.  Not safe to call from two threads at
+ * once without a lock. */
+#define MALLOC_MIN_CLASS    16
+#define MALLOC_MAX_CLASS    2048
+#define MALLOC_NUM_CLASSES  8       /* 16, 32, ... 2048 */
+#define MALLOC_CHUNK        16384   /* bytes taken from sbrk at a time */
+
+extern void* ece391_malloc(uint32_t size);
+extern void ece391_free(void* ptr);
+extern int32_t ece391_brk(void* addr);
+
+/* The monotonic clock read straight from the clock page, no system call */
+extern uint64_t ece391_clock_ns(void);
+extern uint32_t ece391_clock_us(void);     /* wraps after about 71 minutes */
+
 #endif /* ECE391SUPPORT_H */
 
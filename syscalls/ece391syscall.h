@@ -21,6 +21,115 @@ extern int32_t ece391_getargs (uint8_t* buf, int32_t nbytes);
 extern int32_t ece391_vidmap (uint8_t** screen_start);
 extern int32_t ece391_set_handler (int32_t signum, void* handler);
 extern int32_t ece391_sigreturn (void);
+extern int32_t ece391_spawn (const uint8_t* command);
+extern int32_t ece391_waitpid (int32_t pid, int32_t* status, int32_t options);
+extern int32_t ece391_clone (void (*func)(void* arg), void* arg, void* stack);
+extern int32_t ece391_pipe (int32_t fds[2]);
+extern int32_t ece391_spawnio (const uint8_t* command, int32_t in_fd, int32_t out_fd);
+extern int32_t ece391_isatty (int32_t fd);
+extern int32_t ece391_shm_create (uint32_t key);
+extern int32_t ece391_shm_attach (int32_t id, void* addr);
+extern int32_t ece391_shm_detach (void* addr);
+extern int32_t ece391_futex_wait (volatile int32_t* addr, int32_t expected);
+extern int32_t ece391_futex_wake (volatile int32_t* addr, int32_t n);
+
+/* A message: length bytes of data are copied, npages pages at pages are
+   moved out of the sender's IPC window and into the receiver's */
+#define MSG_INLINE_SIZE 64
+typedef struct ece391_msg {
+    uint32_t length;
+    uint8_t data[MSG_INLINE_SIZE];
+    uint32_t pages;
+    uint32_t npages;
+} ece391_msg_t;
+
+extern int32_t ece391_port_create (uint32_t key);
+extern int32_t ece391_msg_send (int32_t port, ece391_msg_t* msg);
+extern int32_t ece391_msg_recv (int32_t port, ece391_msg_t* msg);
+extern void* ece391_ipc_alloc (uint32_t npages);
+extern int32_t ece391_ipc_free (void* addr, uint32_t npages);
+
+/* poll events */
+#define POLLIN  0x0001
+#define POLLOUT 0x0004
+#define POLLERR 0x0008
+#define POLLHUP 0x0010
+typedef struct ece391_pollfd {
+    int32_t fd;
+    int16_t events;
+    int16_t revents;
+} ece391_pollfd_t;
+
+extern int32_t ece391_poll (ece391_pollfd_t* fds, uint32_t nfds, int32_t timeout);
+
+/* fcntl commands and flags; a non-blocking read or write that would have
+   to wait returns WOULD_BLOCK */
+#define F_GETFL     3
+#define F_SETFL     4
+#define O_NONBLOCK  0x800
+#define WOULD_BLOCK (-2)
+extern int32_t ece391_fcntl (int32_t fd, int32_t cmd, uint32_t arg);
+
+/* TLB invalidations counted by the kernel, indexed by system call number;
+   row 0 counts the ones made outside any system call (context switches) */
+#define TLB_STAT_SLOTS 35
+typedef struct ece391_tlb_stats {
+    uint32_t full[TLB_STAT_SLOTS];      /* whole TLB flushes (CR3 reloads) */
+    uint32_t invlpg[TLB_STAT_SLOTS];    /* single pages invalidated */
+} ece391_tlb_stats_t;
+
+extern int32_t ece391_tlb_stats (ece391_tlb_stats_t* stats);
+
+/* Moves the end of the heap by increment bytes and returns the old end, or
+   (void*)-1 on failure; new heap memory reads as zero */
+extern void* ece391_sbrk (int32_t increment);
+
+/* Program pages of a process: the ones it touched in its own memory, and the
+   ones still shared with every other process running the same program */
+typedef struct ece391_resident {
+    int8_t name[33];            /* program name, empty if the PID is free */
+    uint32_t private_pages;
+    uint32_t shared_pages;
+    uint32_t sharers;           /* processes sharing them, this one included */
+} ece391_resident_t;
+
+extern int32_t ece391_resident (int32_t pid, ece391_resident_t* info);
+
+/* Sleeps for ms milliseconds, rounded up to 10ms ticks; returns 0, or the
+   milliseconds left if the alarm went off first */
+extern int32_t ece391_sleep_ms (uint32_t ms);
+
+/* Sets the alarm to go off in ms milliseconds, 0 to cancel it; returns the
+   milliseconds the earlier alarm had left. With no signal handlers an alarm
+   only ends a sleep early */
+extern int32_t ece391_alarm (uint32_t ms);
+
+/* Monotonic time since boot. The system call fills sec and nsec; the same
+   clock is readable without a system call from the page at ECE391_CLOCK_PAGE,
+   which every process maps read-only: nanoseconds are
+   ((rdtsc - base_tsc) * mult) >> shift */
+#define CLOCK_MONOTONIC     1
+typedef struct ece391_timespec {
+    uint32_t sec;
+    uint32_t nsec;
+} ece391_timespec_t;
+
+extern int32_t ece391_clock_gettime (int32_t clock_id, ece391_timespec_t* ts);
+
+#define ECE391_CLOCK_PAGE   0x08801000
+typedef struct ece391_clock_data {
+    uint64_t base_tsc;
+    uint32_t mult;
+    uint32_t shift;
+    uint32_t tsc_khz;
+} ece391_clock_data_t;
+
+/* options for ece391_waitpid */
+#define WAIT_NOHANG 1
+
+/* shared memory segments are 4MB and attach at 4MB aligned addresses here */
+#define SHM_BASE    0x0C000000
+#define SHM_SIZE    0x400000
 
 enum signums {
 	DIV_ZERO = 0,
@@ -11,5 +11,29 @@
 #define SYS_VIDMAP  8
 #define SYS_SET_HANDLER  9
 #define SYS_SIGRETURN  10
+#define SYS_SPAWN   11
+#define SYS_WAITPID 12
+#define SYS_CLONE   13
+#define SYS_PIPE    14
+#define SYS_SPAWNIO 15
+#define SYS_ISATTY  16
+#define SYS_SHM_CREATE  17
+#define SYS_SHM_ATTACH  18
+#define SYS_SHM_DETACH  19
+#define SYS_FUTEX_WAIT  20
+#define SYS_FUTEX_WAKE  21
+#define SYS_PORT_CREATE 22
+#define SYS_MSG_SEND    23
+#define SYS_MSG_RECV    24
+#define SYS_IPC_ALLOC   25
+#define SYS_IPC_FREE    26
+#define SYS_POLL        27
+#define SYS_FCNTL       28
+#define SYS_TLB_STATS   29
+#define SYS_SBRK        30
+#define SYS_RESIDENT    31
+#define SYS_SLEEP_MS    32
+#define SYS_ALARM       33
+#define SYS_CLOCK_GETTIME   34
 
 #endif /* ECE391SYSNUM_H */
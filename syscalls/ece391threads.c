@@ -0,0 +1,56 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define RTC_TICKS 8
+
+/* Set by the RTC thread once it is done, polled by the main thread */
+static volatile int32_t ticking = 1;
+
+/* Blocks on the RTC, the main thread keeps computing meanwhile */
+static int32_t rtc_thread(void* arg)
+{
+    int32_t fd = *(int32_t*)arg;
+    int32_t i, garbage;
+
+    for (i = 0; i < RTC_TICKS; i++) {
+        ece391_read(fd, &garbage, 4);
+        ece391_fdputs(1, (uint8_t*)"tick\n");
+    }
+    ticking = 0;
+    return i;
+}
+
+int main ()
+{
+    int32_t fd, tid, status;
+    uint32_t n, d, primes = 0;
+    uint8_t buf[16];
+
+    if (-1 == (fd = ece391_open((uint8_t*)"rtc"))) {
+        ece391_fdputs(1, (uint8_t*)"Can't open the RTC.\n");
+        return 2;
+    }
+    if (-1 == (tid = ece391_thread_create(rtc_thread, &fd))) {
+        ece391_fdputs(1, (uint8_t*)"Can't create a thread.\n");
+        return 3;
+    }
+
+    /* count primes until the RTC thread has seen all of its ticks */
+    for (n = 2; ticking; n++) {
+        for (d = 2; d * d <= n && n % d != 0; d++);
+        if (d * d > n)
+            primes++;
+    }
+
+    if (-1 == ece391_thread_join(tid, &status) || RTC_TICKS != status) {
+        ece391_fdputs(1, (uint8_t*)"Join failed.\n");
+        return 4;
+    }
+    ece391_fdputs(1, (uint8_t*)"Primes found while the RTC thread slept: ");
+    ece391_fdputs(1, ece391_itoa(primes, buf, 10));
+    ece391_fdputs(1, (uint8_t*)"\n");
+    ece391_close(fd);
+    return 0;
+}
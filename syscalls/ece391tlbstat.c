@@ -0,0 +1,68 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+static const char* names[TLB_STAT_SLOTS] = {
+    "(none)", "halt", "execute", "read", "write", "open", "close", "getargs",
+    "vidmap", "set_handler", "sigreturn", "spawn", "waitpid", "clone", "pipe",
+    "spawnio", "isatty", "shm_create", "shm_attach", "shm_detach", "futex_wait",
+    "futex_wake", "port_create", "msg_send", "msg_recv", "ipc_alloc", "ipc_free",
+    "poll", "fcntl", "tlb_stats", "sbrk", "resident", "sleep_ms", "alarm",
+    "clock_gettime"
+};
+
+static void put_num (uint32_t n)
+{
+    uint8_t num[16];
+    ece391_fdputs (1, ece391_itoa (n, num, 10));
+}
+
+/* Prints the TLB invalidations by system call; with a command, runs it and
+   prints only the ones made while it ran */
+int main (int32_t argc, uint8_t** argv, uint8_t** envp)
+{
+    static ece391_tlb_stats_t before, after;
+    uint8_t command[128];
+    int32_t i, pid, status;
+    uint32_t len = 0;
+
+    for (i = 0; i < TLB_STAT_SLOTS; i++)
+        before.full[i] = before.invlpg[i] = 0;
+    if (argc > 1) {
+        command[0] = '\0';
+        for (i = 1; i < argc; i++) {
+            if (len + ece391_strlen (argv[i]) + 2 > sizeof (command)) {
+                ece391_fdputs (1, (uint8_t*)"command too long\n");
+                return 2;
+            }
+            if (i > 1)
+                command[len++] = ' ';
+            ece391_strcpy (command + len, argv[i]);
+            len += ece391_strlen (argv[i]);
+        }
+        ece391_tlb_stats (&before);
+        if (-1 == (pid = ece391_spawn (command))) {
+            ece391_fdputs (1, (uint8_t*)"can't run the command\n");
+            return 3;
+        }
+        ece391_waitpid (pid, &status, 0);
+    }
+    if (-1 == ece391_tlb_stats (&after)) {
+        ece391_fdputs (1, (uint8_t*)"tlb_stats failed\n");
+        return 1;
+    }
+
+    ece391_fdputs (1, (uint8_t*)"syscall      full flushes  invlpg\n");
+    for (i = 0; i < TLB_STAT_SLOTS; i++) {
+        if (after.full[i] == before.full[i] && after.invlpg[i] == before.invlpg[i])
+            continue;
+        ece391_fdputs (1, (uint8_t*)(names[i] != 0 ? names[i] : "?"));
+        ece391_fdputs (1, (uint8_t*)": ");
+        put_num (after.full[i] - before.full[i]);
+        ece391_fdputs (1, (uint8_t*)"  ");
+        put_num (after.invlpg[i] - before.invlpg[i]);
+        ece391_fdputs (1, (uint8_t*)"\n");
+    }
+    return 0;
+}